@@ -0,0 +1,131 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// a buffer arena, for runs over many images that would otherwise malloc and free a file sized input buffer, an output buffer and a few
+// tables and accumulators for every single image. large blocks come straight from mmap() in glibc and go straight back with munmap() on
+// free, so every image paid for a fresh set of page faults, which dominate the cost of converting small images
+// an arena hands out blocks from one big buffer with a bump pointer and takes them all back at once with arenareset(), once per image.
+// blocks that don't fit are malloc()ed and tracked (spills), and at the next reset the buffer grows to fit everything the last image asked
+// for, so after a few images the arena sits at the high water mark of the batch and images stop allocating altogether
+// an arena is not thread safe, give every thread (or every image in flight) its own. all functions accept a NULL arena, meaning the heap,
+// so the converters can be called with or without one
+// the blocks stay valid until the next reset, arenafree() only releases blocks that came from the heap, i.e when the arena is NULL
+
+#define ARENA_ALIGNMENT 64LLU // ALIGNMENT OF EVERY BLOCK, A CACHE LINE, ENOUGH FOR ANY VECTOR LOAD
+
+// the stats hook, see arenatally() and arenareport()
+typedef struct {
+        unsigned long long _nallocs;   // blocks handed out
+        unsigned long long _nreused;   // blocks carved out of memory the arena already held, i.e calls to malloc avoided
+        unsigned long long _nresets;   // number of resets, one per image
+        unsigned long long _ngrows;    // number of times the buffer grew to a new high water mark
+        size_t             _highwater; // size of the buffer, the most any image has asked for
+} arenastats;
+
+typedef struct {
+        unsigned char* _base;
+        size_t         _capacity;
+        size_t         _used;
+        size_t         _demand;        // bytes asked for since the last reset, spills included, the buffer grows to this at the next reset
+        void**         _spills;        // blocks that did not fit and came from malloc(), released at the next reset
+        size_t         _nspills;
+        size_t         _spillcapacity; // number of slots in _spills
+        arenastats     _stats;
+} arena;
+
+// a block of at least size bytes, aligned to ARENA_ALIGNMENT when it comes from the arena, NULL on failure
+static inline void* arenaalloc(arena* const restrict memory, const size_t size) {
+    if (!memory) return malloc(size);
+
+    const size_t rounded  = ((size ? size : 1) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    memory->_demand      += rounded;
+    memory->_stats._nallocs++;
+
+    if (rounded <= memory->_capacity - memory->_used) {
+        void* const block  = memory->_base + memory->_used;
+        memory->_used     += rounded;
+        memory->_stats._nreused++;
+        return block;
+    }
+
+    if (memory->_nspills == memory->_spillcapacity) {
+        const size_t capacity = memory->_spillcapacity ? memory->_spillcapacity * 2 : 8;
+        void** const spills   = realloc(memory->_spills, capacity * sizeof(void*));
+        if (!spills) return NULL;
+        memory->_spills        = spills;
+        memory->_spillcapacity = capacity;
+    }
+    void* const block = malloc(size);
+    if (block) memory->_spills[memory->_nspills++] = block;
+    return block;
+}
+
+// a zeroed block of count x size bytes
+static inline void* arenacalloc(arena* const restrict memory, const size_t count, const size_t size) {
+    if (!memory) return calloc(count, size);
+    if (size && count > SIZE_MAX / size) return NULL;
+    void* const block = arenaalloc(memory, count * size);
+    if (block) memset(block, 0U, count * size);
+    return block;
+}
+
+// releases a block from a NULL arena i.e the heap, blocks from an arena are taken back by arenareset()
+static inline void arenafree(arena* const restrict memory, void* const block) {
+    if (!memory) free(block);
+}
+
+// takes back every block handed out since the last reset, and grows the buffer if the blocks did not all fit in it
+// a failure to grow is not an error, the arena just keeps spilling to the heap
+static inline void arenareset(arena* const restrict memory) {
+    for (size_t i = 0; i < memory->_nspills; ++i) free(memory->_spills[i]);
+    memory->_nspills = 0;
+
+    if (memory->_demand > memory->_capacity) {
+        free(memory->_base);
+        memory->_base     = aligned_alloc(ARENA_ALIGNMENT, memory->_demand); // _demand is a multiple of the alignment
+        memory->_capacity = memory->_base ? memory->_demand : 0;
+        memory->_stats._ngrows++;
+        if (memory->_capacity > memory->_stats._highwater) memory->_stats._highwater = memory->_capacity;
+    }
+
+    memory->_used   = 0;
+    memory->_demand = 0;
+    memory->_stats._nresets++;
+}
+
+// releases everything the arena holds, the stats are kept
+static inline void arenadestroy(arena* const restrict memory) {
+    for (size_t i = 0; i < memory->_nspills; ++i) free(memory->_spills[i]);
+    free(memory->_spills);
+    free(memory->_base);
+    const arenastats stats = memory->_stats;
+    memset(memory, 0U, sizeof(arena));
+    memory->_stats = stats;
+}
+
+// adds the stats of an arena to total, to sum up the arenas of a batch
+static inline void arenatally(arenastats* const restrict total, const arena* const restrict memory) {
+    total->_nallocs   += memory->_stats._nallocs;
+    total->_nreused   += memory->_stats._nreused;
+    total->_nresets   += memory->_stats._nresets;
+    total->_ngrows    += memory->_stats._ngrows;
+    total->_highwater += memory->_stats._highwater; // the arenas are alive at the same time, so their high water marks add up
+}
+
+static inline void arenareport(const arenastats* const restrict stats, FILE* const restrict stream) {
+    fprintf(
+        stream,
+        "arena :: %llu images, %llu allocations, %llu served from reused memory (malloc calls avoided), %llu grows, %zu bytes held\n",
+        stats->_nresets,
+        stats->_nallocs,
+        stats->_nreused,
+        stats->_ngrows,
+        stats->_highwater
+    );
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+// clang-format off
+#include <_prefetch.h>
+#include <_stream.h>
+#include <_threadpool.h>
+// clang-format on
+
+// batch mode, for runs over many images where what matters is the aggregate throughput rather than the latency of any single image
+// instead of splitting every conversion across the pool (see tpoolfor()), whole images are handed out to the workers, each one read and
+// converted on a single thread, so the workers never wait on each other and the file reads of one image overlap the conversions of others
+// results are emitted strictly in the order of the paths, through a reorder buffer of ninflight slots, image i lands in slot i % ninflight
+// and is emitted once every image before it has been. an image is only submitted once its slot has been emitted and released, so at most
+// ninflight images (bitmaps and strings) are alive at any given time, however far ahead the workers get
+// every slot has an arena of its own (see <_arena.h>), which the image in the slot is read into and converted with, and which is reset once
+// the image is emitted. the arenas belong to the slots rather than to the workers since a result outlives the conversion, up until it is
+// emitted, while the worker has moved on to other images
+
+typedef struct batch batch;
+
+typedef struct {
+        const char* _path;
+        char*       _result; // NULL when the image could not be processed
+        bool        _done;   // guarded by the lock of the batch
+        batch*      _batch;
+        arena       _arena;  // kept across the images that go through the slot
+} batchslot;
+
+struct batch {
+        pthread_mutex_t _lock;
+        pthread_cond_t  _ready;  // broadcast when a slot is done
+        batchslot*      _slots;
+        bool            _stream; // whether the images are streamed from disk (see to_streamed_string()) rather than loaded whole
+};
+
+// receives the results in the order of the paths, string is NULL if the image at path could not be processed
+// the string is released by the batch once the callback returns
+typedef void (*batchemit)(const char* const restrict path, const char* const restrict string, void* const restrict context);
+
+static inline void batchconvert(void* const _slot) {
+    batchslot* const slot   = _slot;
+    char*            result = NULL;
+
+    if (slot->_batch->_stream)
+        result = to_streamed_string(slot->_path, &slot->_arena);
+    else {
+        bitmap image = bmpread(slot->_path, &slot->_arena);
+        // the pool is busy with other images, a conversion must not wait on it (see tpoolfor())
+        result       = to_string(&image, NULL, NULL, &slot->_arena);
+        bmpclose(&image);
+    }
+
+    pthread_mutex_lock(&slot->_batch->_lock);
+    slot->_result = result;
+    slot->_done   = true;
+    pthread_cond_broadcast(&slot->_batch->_ready);
+    pthread_mutex_unlock(&slot->_batch->_lock);
+}
+
+// converts the npaths images at paths on the pool, with at most ninflight of them alive at once, and emits them in order
+// a NULL pool converts them one after the other, on the calling thread. returns false if the reorder buffer could not be allocated
+// prefetch (NULL for none) is kept posted on the images submitted so far, it should be prefetching paths for this batch (see <_prefetch.h>)
+// the counters of the arenas of the slots are added to stats, unless it's NULL
+static inline bool batchrun(
+    threadpool* const        pool,
+    prefetcher* const        prefetch,
+    const char* const* const paths,
+    const long long          npaths,
+    const unsigned           ninflight,
+    const bool               stream,
+    const batchemit          emit,
+    void* const restrict     context,
+    arenastats* const        stats
+) {
+    assert(ninflight);
+    batch batch = { ._slots = calloc(ninflight, sizeof(batchslot)), ._stream = stream };
+    if (!batch._slots) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        return false;
+    }
+    pthread_mutex_init(&batch._lock, NULL);
+    pthread_cond_init(&batch._ready, NULL);
+
+    for (long long next = 0, submitted = 0; next < npaths; ++next) { // NOLINT(readability-isolate-declaration)
+        // keep the reorder buffer full, the slots of the images after next are free since their previous occupants were emitted
+        for (; submitted < npaths && submitted < next + ninflight; ++submitted) {
+            batchslot* const slot = batch._slots + submitted % ninflight;
+            slot->_path           = paths[submitted];
+            slot->_result         = NULL;
+            slot->_done           = false;
+            slot->_batch          = &batch;
+            if (!pool || !tpoolsubmit(pool, batchconvert, slot)) batchconvert(slot); // no pool, or the queue could not grow, do it here
+        }
+        prefetchadvance(prefetch, submitted); // the images in flight are being read already, the ones after them are up next
+
+        batchslot* const slot = batch._slots + next % ninflight;
+        pthread_mutex_lock(&batch._lock);
+        while (!slot->_done) pthread_cond_wait(&batch._ready, &batch._lock);
+        pthread_mutex_unlock(&batch._lock);
+
+        emit(slot->_path, slot->_result, context);
+        arenareset(&slot->_arena); // takes the result back, along with everything else the image needed
+        slot->_result = NULL;
+    }
+
+    for (unsigned i = 0; i < ninflight; ++i) {
+        if (stats) arenatally(stats, &batch._slots[i]._arena);
+        arenadestroy(&batch._slots[i]._arena);
+    }
+    pthread_mutex_destroy(&batch._lock);
+    pthread_cond_destroy(&batch._ready);
+    free(batch._slots);
+    return true;
+}
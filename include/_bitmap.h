@@ -13,9 +13,14 @@
 typedef struct {
         BITMAPFILEHEADER _fileheader;
         BITMAPINFOHEADER _infoheader;
-        RGBQUAD*         _pixels; // this points to the start of pixels in the file buffer i.e (_buffer + 54)
-        // _pixels IS NOT A SEPARATE BUFFER, IT IS JUST A REFERENCE TO A BYTE FEW STRIDES (54 BYTES) INTO THE ACTUAL BYTES BUFFER
+        unsigned char*   _pixels; // this points to the start of pixels in the file buffer i.e (_buffer + bfOffBits)
+        // _pixels IS NOT A SEPARATE BUFFER, IT IS JUST A REFERENCE TO A BYTE FEW STRIDES (bfOffBits BYTES) INTO THE ACTUAL BYTES BUFFER
+        // PIXELS ARE KEPT IN THEIR ON DISK FORMAT (see bmpsupported()), CONVERTERS UNPACK THEM ON THE FLY (see <_unpack.h>)
         unsigned char*   _buffer; // this will point to the original file buffer, this is the one that needs deallocation!
+        // bmpread maps the file into memory whenever it can, in which case _buffer points to the start of the mapping and _mapsize is the
+        // length of the mapping. _mapsize is 0 when _buffer is a heap buffer, bmpclose uses this to decide between munmap and free
+        long             _mapsize;
+        arena*           _arena; // the arena _buffer came from when it's not a mapping, NULL for the heap (see <_arena.h>)
 } bitmap;
 
 // order of pixels in the BMP buffer.
@@ -29,7 +34,7 @@ typedef enum { RGB, RLE8, RLE4, BITFIELDS, UNKNOWN } BITMAP_COMPRESSION_KIND;
 static const unsigned short START_TAG_BE = L'B' << 8 | L'M';
 static const unsigned short START_TAG_LE = L'M' << 8 | L'B';
 
-static inline BITMAPFILEHEADER fileheader(const unsigned char* const restrict imstream, const unsigned size) {
+static inline BITMAPFILEHEADER fileheader(const unsigned char* const restrict imstream, [[maybe_unused]] const unsigned size) {
     assert(size >= sizeof(BITMAPFILEHEADER));
     BITMAPFILEHEADER header = { .bfType = 0, .bfSize = 0, .bfReserved1 = 0, .bfReserved2 = 0, .bfOffBits = 0 };
 
@@ -41,8 +46,7 @@ static inline BITMAPFILEHEADER fileheader(const unsigned char* const restrict im
             __FILE__,
             __LINE__
         );
-        free(imstream);
-        return header;
+        return header; // the buffer could be a heap buffer or a mapping, so releasing it is left to the caller
     }
 
     header.bfType    = START_TAG_LE;
@@ -51,19 +55,20 @@ static inline BITMAPFILEHEADER fileheader(const unsigned char* const restrict im
     return header;
 }
 
-static inline BITMAPINFOHEADER infoheader(const unsigned char* const imstream, const unsigned size) {
+static inline BITMAPINFOHEADER infoheader(const unsigned char* const imstream, [[maybe_unused]] const unsigned size) {
     assert(size >= (sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER)));
     BITMAPINFOHEADER header = { 0 };
 
-    if (*((unsigned*) (imstream + 14U)) > 40U) {
+    // BITMAPV4HEADER and BITMAPV5HEADER (108 and 124 bytes) extend BITMAPINFOHEADER, their first 40 bytes can be parsed as one
+    // the older 12 byte BITMAPCOREHEADER has a different layout altogether
+    if (*((unsigned*) (imstream + 14U)) < 40U || *((unsigned*) (imstream + 14U)) > 124U) {
         fprintf(
             stderr,
-            "Error in function %s in file %s at line %d, the bitmap contains an unparsable file info header",
+            "Error in function %s in file %s at line %d, the bitmap contains an unparsable file info header\n",
             __FUNCTION__,
             __FILE__,
             __LINE__
         );
-        free(imstream);
         return header;
     }
 
@@ -86,31 +91,270 @@ static inline BITMAP_PIXEL_ORDERING pixelorder(const BITMAPINFOHEADER* const res
     return (header->biHeight >= 0) ? BOTTOMUP : TOPDOWN;
 }
 
-// reads in a bmp file from disk and deserializes it into a bitmap_t struct
-static inline bitmap bmpread(const char* const filepath) {
-    long   size  = 0;
+// number of bytes a scanline takes up in the pixel buffer, scanlines are padded to a multiple of 4 bytes
+static inline long long bmpstride(const BITMAPINFOHEADER* const restrict header) {
+    return ((long long) header->biWidth * header->biBitCount + 31) / 32 * 4;
+}
+
+// size of the pixel buffer in bytes, the size of a run length encoded pixel buffer can't be derived from the dimensions, so the headers
+// have to spell it out
+static inline long long bmppixelbytes(const BITMAPINFOHEADER* const restrict header) {
+    if (header->biCompression == RLE8 || header->biCompression == RLE4) return header->biSizeImage;
+    return bmpstride(header) * llabs(header->biHeight);
+}
+
+// number of entries in the colour table, 0 for bitmaps that don't use one
+static inline unsigned bmpncolors(const BITMAPINFOHEADER* const restrict header) {
+    if (header->biBitCount > 8) return 0;
+    return header->biClrUsed ? header->biClrUsed : 1U << header->biBitCount;
+}
+
+// offset of the colour table (or of the colour masks, for BITFIELDS bitmaps with a plain BITMAPINFOHEADER) from the start of the file
+// the colour table comes right after the info header, except when a plain BITMAPINFOHEADER is followed by the three colour masks
+static inline unsigned bmpcolorsoffset(const BITMAPINFOHEADER* const restrict header) {
+    return sizeof(BITMAPFILEHEADER) + header->biSize + (header->biSize == 40 && header->biCompression == BITFIELDS ? 12 : 0);
+}
+
+// the red, green and blue masks of 16 and 32 bit pixels, stored in masks in the order blue, green, red
+// BITFIELDS bitmaps carry them right after the 40 bytes of BITMAPINFOHEADER (inside the header for the V4 and V5 variants)
+// the rest use the implied 5-5-5 layout for 16 bit pixels and the plain BGRA layout for 32 bit pixels
+static inline void bmpmasks(
+    const unsigned char* const restrict imstream, const BITMAPINFOHEADER* const restrict header, uint32_t masks[static 3]
+) {
+    if (header->biCompression == BITFIELDS) {
+        masks[2] = *(uint32_t*) (imstream + 54U);
+        masks[1] = *(uint32_t*) (imstream + 58U);
+        masks[0] = *(uint32_t*) (imstream + 62U);
+    } else if (header->biBitCount == 16) {
+        masks[0] = 0x001F;
+        masks[1] = 0x03E0;
+        masks[2] = 0x7C00;
+    } else {
+        masks[0] = 0x000000FF;
+        masks[1] = 0x0000FF00;
+        masks[2] = 0x00FF0000;
+    }
+}
+
+#define BITMAP_MAPBYTES (1L << 20) // FILES OF AT LEAST THIS SIZE ARE MAPPED BY bmpread() EVEN WHEN IT'S GIVEN AN ARENA TO READ THEM INTO
+
+// the most bytes the headers, the colour masks and the colour table (see bmpcolorsoffset()) can take up, a BITMAPV5HEADER
+// followed by 256 colours (the masks are inside V4 and V5 headers, so it's either the 12 bytes of masks or the extra 84 bytes of header)
+#define BITMAP_MAXHEADERS (sizeof(BITMAPFILEHEADER) + 124 + 256 * sizeof(RGBQUAD))
+
+// checks that the pixel format is one the converters know how to unpack and that everything the headers refer to lies inside the file
+// imstream must hold the headers, the colour masks and the colour table i.e the first min(bfOffBits, BITMAP_MAXHEADERS) bytes of the file
+// filesize is the size of the whole file
+// supported formats are 32 bit (RGB and BITFIELDS), 24 bit (RGB), 16 bit (RGB and BITFIELDS), 8 bit colour indexed (RGB and RLE8) and
+// 4 bit colour indexed (RLE4 only)
+static inline bool bmpsupported(
+    const unsigned char* const restrict    imstream,
+    const BITMAPFILEHEADER* const restrict fhead,
+    const BITMAPINFOHEADER* const restrict infhead,
+    const long long                        filesize
+) {
+    const unsigned short bitcount = infhead->biBitCount;
+    const unsigned       kind     = infhead->biCompression;
+
+    if (infhead->biWidth <= 0 || !infhead->biHeight) {
+        fprintf(
+            stderr,
+            "Error in %s @ line %d: bitmap has invalid dimensions (%d x %d)\n",
+            __FUNCTION__,
+            __LINE__,
+            infhead->biWidth,
+            infhead->biHeight
+        );
+        return false;
+    }
+
+    if (!((bitcount == 32 && (kind == RGB || kind == BITFIELDS)) || (bitcount == 24 && kind == RGB) ||
+          (bitcount == 16 && (kind == RGB || kind == BITFIELDS)) || (bitcount == 8 && (kind == RGB || kind == RLE8)) ||
+          (bitcount == 4 && kind == RLE4))) {
+        fprintf(
+            stderr,
+            "Error in %s @ line %d: unsupported pixel format (%u bits per pixel, compression %u)\n",
+            __FUNCTION__,
+            __LINE__,
+            bitcount,
+            kind
+        );
+        return false;
+    }
+
+    // the colour table (or the masks) must fit between the headers and the pixel buffer
+    const unsigned long long tableend =
+        kind == BITFIELDS ? 54ULL + 12 : bmpcolorsoffset(infhead) + (unsigned long long) bmpncolors(infhead) * sizeof(RGBQUAD);
+    if (bmpncolors(infhead) > 256 || tableend > fhead->bfOffBits) {
+        fprintf(stderr, "Error in %s @ line %d: the colour table or the colour masks overlap the pixel buffer\n", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    if (kind == BITFIELDS) { // every mask must be a non empty run of contiguous bits, that fits in the pixel
+        uint32_t masks[3] = { 0 };
+        bmpmasks(imstream, infhead, masks);
+        for (unsigned i = 0; i < 3; ++i) {
+            const uint32_t shifted = masks[i] ? masks[i] >> __builtin_ctz(masks[i]) : 0;
+            if (!shifted || (shifted & (shifted + 1)) || (bitcount == 16 && masks[i] > 0xFFFF)) {
+                fprintf(stderr, "Error in %s @ line %d: invalid colour mask %08X\n", __FUNCTION__, __LINE__, masks[i]);
+                return false;
+            }
+        }
+    }
+
+    if ((kind == RLE8 || kind == RLE4) && infhead->biHeight < 0) {
+        fprintf(stderr, "Error in %s @ line %d: run length encoded bitmaps can't be top down\n", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    const long long nbytes = bmppixelbytes(infhead);
+    if (!nbytes || fhead->bfOffBits + nbytes > filesize) {
+        fprintf(stderr, "Error in %s @ line %d: the pixel buffer is missing or truncated\n", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    return true;
+}
+
+// deserializes a bitmap from the size bytes in buffer, which will be owned by the returned bitmap from here on
+// mapsize is the length of the mapping if buffer was memory mapped, 0 if it's a heap buffer. the buffer is released on failure
+// memory is the arena a heap buffer came from, NULL for plain malloc
+static inline bitmap bmpparse(unsigned char* const buffer, const long size, const long mapsize, arena* const memory) {
     bitmap image = { 0 }; // will be used as an empty placeholder for premature returns until members are properly assigned
 
-    const unsigned char* const buffer = imopen(filepath, &size);
-    if (!buffer) return image; // open will do the error reporting, so just exiting the function is enough
+    if (size < (long) (sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER))) {
+        fprintf(stderr, "Error in %s @ line %d: file is too small to be a bitmap\n", __FUNCTION__, __LINE__);
+        goto RELEASE_AND_RETURN;
+    }
 
     const BITMAPFILEHEADER fhead = fileheader(buffer, size);
-    if (!fhead.bfSize) return image;
-    // again parse_fileheader will report errors and free the buffer, if the predicate isn't satisified, just exit the routine
+    if (!fhead.bfSize) goto RELEASE_AND_RETURN; // parse_fileheader will report errors, just release the buffer
 
     const BITMAPINFOHEADER infhead = infoheader(buffer, size);
-    if (!infhead.biSize) return image; // error reporting and resource cleanup are handled by parse_infoheader
+    if (!infhead.biSize) goto RELEASE_AND_RETURN; // error reporting is handled by parse_infoheader
+
+    if (fhead.bfOffBits > size || !bmpsupported(buffer, &fhead, &infhead, size)) goto RELEASE_AND_RETURN;
 
     image._fileheader = fhead;
     image._infoheader = infhead;
     image._buffer     = buffer;
-    image._pixels     = (RGBQUAD*) (buffer + 54);
+    image._pixels     = buffer + fhead.bfOffBits;
+    image._mapsize    = mapsize;
+    image._arena      = memory;
 
     return image;
+
+RELEASE_AND_RETURN:
+    if (mapsize)
+        munmap(buffer, mapsize);
+    else
+        arenafree(memory, buffer);
+    return image;
+}
+
+// reads in a bmp file from disk and deserializes it into a bitmap_t struct
+// the file is memory mapped (zero copy) when possible, falling back to reading it into a heap buffer otherwise
+// given an arena (see <_arena.h>), files smaller than BITMAP_MAPBYTES are read into a block of the arena instead, a batch of small images
+// then reuses the same memory over and over, where every mapping would fault in its pages afresh. larger files are still mapped, the
+// page faults are a small price next to the copy, and the arena doesn't get to hold on to a file sized block for the rest of the run
+static inline bitmap bmpread(const char* const filepath, arena* const memory) {
+    long size    = 0;
+    long mapsize = 0;
+
+    unsigned char* buffer = immap(filepath, memory ? BITMAP_MAPBYTES : 0, &mapsize);
+    if (buffer)
+        size = mapsize;
+    else if (!(buffer = imopen(filepath, &size, memory)))
+        return (bitmap) { 0 }; // open will do the error reporting, so just exiting the function is enough
+
+    return bmpparse(buffer, size, mapsize, memory);
 }
 
 // use this to cleanup a bitmap_t after its use
 static inline void bmpclose(bitmap* const image) {
-    free(image->_buffer);
+    if (image->_mapsize)
+        munmap(image->_buffer, image->_mapsize);
+    else
+        arenafree(image->_arena, image->_buffer);
     memset(image, 0U, sizeof(bitmap));
 }
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// views, the converters never look at the pixel buffer directly, they walk a view of it, scanline by scanline, in  //
+// image order (top to bottom) regardless of the order the scanlines are stored in                                 //
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// a window into the pixels of a bitmap, it doesn't own anything and copying it is free
+// bottom up bitmaps store the top scanline last, so their views start at the last scanline of the buffer and walk it with a negative stride
+// a crop (see imcrop()) is just a view with a different origin and different dimensions, the stride stays that of the bitmap
+typedef struct {
+        const unsigned char*    _headers;    // the start of the file i.e the headers and the colour table, to compile unpackers from
+        const BITMAPINFOHEADER* _infoheader; // pixel format of the bitmap the view looks into
+        const unsigned char*    _top;        // first pixel of the top scanline of the view
+        long long               _stride;     // bytes from a scanline to the one right below it in the image, negative for bottom up bitmaps
+        long long               _width;      // pixels per scanline
+        long long               _height;     // number of scanlines
+        bool                    _mapped;     // whether the pixels are memory mapped, only then is prefetching (imwillneed()) worth it
+} imview;
+
+// a view of nscanlines scanlines stored (in the storage order of the bitmap described by infhead) at pixels
+static inline imview imscanlines(
+    const unsigned char* const restrict    headers,
+    const BITMAPINFOHEADER* const restrict infhead,
+    const unsigned char* const restrict    pixels,
+    const long long                        nscanlines,
+    const bool                             mapped
+) {
+    const long long stride  = bmpstride(infhead);
+    const bool      topdown = pixelorder(infhead) == TOPDOWN;
+    return (imview) { ._headers    = headers,
+                      ._infoheader = infhead,
+                      ._top        = topdown ? pixels : pixels + (nscanlines - 1) * stride,
+                      ._stride     = topdown ? stride : -stride,
+                      ._width      = infhead->biWidth,
+                      ._height     = nscanlines,
+                      ._mapped     = mapped };
+}
+
+// a view of the whole image
+static inline imview bmpview(const bitmap* const restrict image) {
+    return imscanlines(image->_buffer, &image->_infoheader, image->_pixels, llabs(image->_infoheader.biHeight), image->_mapsize);
+}
+
+// a width x height window of the view, with its top left corner at pixel x of scanline y, clamped to the edges of the view
+// pixels narrower than a byte can't be addressed, but those only come run length encoded and RLE bitmaps can't be viewed anyway
+static inline imview imcrop(const imview* const restrict view, long long x, long long y, const long long width, const long long height) {
+    assert(view->_infoheader->biBitCount >= 8);
+    x             = min(max(x, 0LL), view->_width);
+    y             = min(max(y, 0LL), view->_height);
+
+    imview crop   = *view;
+    crop._top    += y * view->_stride + x * (view->_infoheader->biBitCount / 8);
+    crop._width   = min(max(width, 0LL), view->_width - x);
+    crop._height  = min(max(height, 0LL), view->_height - y);
+    return crop;
+}
+
+// the scanline at row (counting from the top) of the view
+static inline const unsigned char* imscanline(const imview* const restrict view, const long long row) {
+    return view->_top + row * view->_stride;
+}
+
+// the kernel's readahead is tuned for forward sequential access, and the read around for mapped files only kicks in after a page fault,
+// so left to itself every new stretch of a backward traversal (every traversal of a bottom up bitmap) would stall on a synchronous fault
+// converters call this with the rows of the view they are about to need next, so the pages can be read in asynchronously, ahead of the
+// traversal. a no-op for heap backed bitmaps
+static inline void imwillneed(const imview* const restrict view, long long first, long long last) {
+    if (!view->_mapped) return;
+
+    first = max(first, 0LL);
+    last  = min(last, view->_height);
+    if (first >= last) return;
+
+    // the rows span the addresses between the first and the last row, in either order depending on the sign of the stride
+    const uintptr_t pagemask = ~((uintptr_t) getpagesize() - 1);
+    const uintptr_t low      = (uintptr_t) min(imscanline(view, first), imscanline(view, last - 1));
+    const uintptr_t high     = (uintptr_t) max(imscanline(view, first), imscanline(view, last - 1));
+    // madvise wants page alignment, and it's only a hint, failures are inconsequential
+    madvise((void*) (low & pagemask), high + llabs(view->_stride) - (low & pagemask), MADV_WILLNEED);
+}
@@ -0,0 +1,273 @@
+#pragma once
+
+// clang-format off
+#include <_stream.h>
+#include <dirent.h>
+// clang-format on
+
+// a content addressed, on disk cache of conversion results, for services that see the same bitmaps over and over again
+// an entry is keyed by a hash of the bitmap (its headers, colour table and pixel buffer, i.e everything the converters look at) and a hash
+// of everything else the output depends on (see cachekeyof()), so a hit needs a single pass over the file and no decoding or conversion
+// every entry is a file of its own in the cache directory, named after its key, holding the NULL terminated strings of the result back to
+// back. entries are written to a temporary file and renamed into place, rename() is atomic, so processes sharing a directory never see a
+// partly written entry and the last writer of a key simply wins. a hit touches the entry, and once the entries outgrow the size cap the
+// least recently used ones (by modification time) are deleted, by whichever process notices first
+// the cache is purely an optimization, a failure to read or write an entry is treated as a miss and never fails a conversion
+
+#define CACHE_VERSION  1ULL          // BUMP WHENEVER A CHANGE TO THE CONVERTERS CHANGES THEIR OUTPUT, SO STALE ENTRIES ARE NEVER SERVED
+#define CACHE_MAXBYTES (256LL << 20) // DEFAULT SIZE CAP OF THE ENTRIES IN A CACHE DIRECTORY
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// XXH64, a non cryptographic hash that runs at memory bandwidth, four independent lanes over 32 byte stripes    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define XXH_PRIME1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME3 0x165667B19E3779F9ULL
+#define XXH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t xxhrotl(const uint64_t value, const unsigned nbits) { return (value << nbits) | (value >> (64 - nbits)); }
+
+static inline uint64_t xxhround(uint64_t acc, const uint64_t input) { return xxhrotl(acc + input * XXH_PRIME2, 31) * XXH_PRIME1; }
+
+static inline uint64_t xxhmerge(const uint64_t acc, const uint64_t lane) { return (acc ^ xxhround(0, lane)) * XXH_PRIME1 + XXH_PRIME4; }
+
+// the bytes are read with memcpy(), the buffers need not be aligned
+static inline uint64_t xxhread64(const unsigned char* const restrict bytes) {
+    uint64_t value = 0;
+    memcpy(&value, bytes, sizeof(uint64_t));
+    return value;
+}
+
+static inline uint64_t xxh64(const unsigned char* restrict bytes, const long long nbytes, const uint64_t seed) {
+    const unsigned char* const end  = bytes + nbytes;
+    uint64_t                   hash = 0;
+
+    if (nbytes >= 32) {
+        uint64_t lanes[4] = { seed + XXH_PRIME1 + XXH_PRIME2, seed + XXH_PRIME2, seed, seed - XXH_PRIME1 };
+        for (; bytes + 32 <= end; bytes += 32)
+            for (unsigned i = 0; i < 4; ++i) lanes[i] = xxhround(lanes[i], xxhread64(bytes + 8 * i));
+        hash = xxhrotl(lanes[0], 1) + xxhrotl(lanes[1], 7) + xxhrotl(lanes[2], 12) + xxhrotl(lanes[3], 18);
+        for (unsigned i = 0; i < 4; ++i) hash = xxhmerge(hash, lanes[i]);
+    } else
+        hash = seed + XXH_PRIME5;
+
+    hash += nbytes;
+    for (; bytes + 8 <= end; bytes += 8) hash = xxhrotl(hash ^ xxhround(0, xxhread64(bytes)), 27) * XXH_PRIME1 + XXH_PRIME4;
+    if (bytes + 4 <= end) {
+        uint32_t value = 0;
+        memcpy(&value, bytes, sizeof(uint32_t));
+        hash   = xxhrotl(hash ^ (value * XXH_PRIME1), 23) * XXH_PRIME2 + XXH_PRIME3;
+        bytes += 4;
+    }
+    for (; bytes < end; ++bytes) hash = xxhrotl(hash ^ (*bytes * XXH_PRIME5), 11) * XXH_PRIME1;
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+////////////////
+// the cache //
+////////////////
+
+typedef struct {
+        uint64_t _content; // the headers, the colour table and the pixels of the bitmap
+        uint64_t _config;  // the layout of the output and the palette it was mapped with
+} cachekey;
+
+typedef struct {
+        unsigned long long _nhits;
+        unsigned long long _nmisses;
+        unsigned long long _nstores;
+        unsigned long long _nevictions;
+} cachestats;
+
+typedef struct {
+        char               _directory[PATH_MAX];
+        long long          _maxbytes;
+        long long          _nbytes;  // size of the entries as of the last scan, plus whatever this process stored since
+        unsigned long long _ntemps;  // number of temporary files created, names them apart
+        cachestats         _stats;
+} resultcache;
+
+// the key of a bitmap rendered at the default width (ncolumns is 0) or at each of the ncolumns widths in columns (see to_width_strings())
+// with the compiled palette cpal (NULL for the one the converters are compiled with, see cpalpick()), the mapper kind and the characters
+// of its offsets are all a compiled palette contributes to the output
+static inline cachekey cachekeyof(
+    const bitmap* const restrict    image,
+    const cpalette* const restrict  cpal,
+    const long long* const restrict columns,
+    const long long                 ncolumns
+) {
+    cpalette              fallback   = { 0 };
+    const cpalette* const compiled   = cpalpick(cpal, &fallback);
+    const uint64_t        settings[] = { CACHE_VERSION, compiled->_kind, CONSOLE_WIDTH, FIXED_SHIFT, ncolumns };
+    const uint64_t        seed       = xxh64((const unsigned char*) settings, sizeof(settings), 0);
+    const uint64_t        config     = xxh64((const unsigned char*) compiled->_chars, sizeof(compiled->_chars), seed);
+    return (cachekey) { ._content = xxh64(image->_buffer, image->_fileheader.bfOffBits + bmppixelbytes(&image->_infoheader), 0),
+                        ._config  = xxh64((const unsigned char*) columns, sizeof(long long) * ncolumns, config) };
+}
+
+// path of the entry of key, the name is the key in hex, returns false if the path doesn't fit
+static inline bool cachepath(const resultcache* const restrict cache, const cachekey key, char path[static PATH_MAX]) {
+    const unsigned long long content = key._content, config = key._config; // NOLINT(readability-isolate-declaration)
+    return snprintf(path, PATH_MAX, "%s/%016llx%016llx", cache->_directory, content, config) < PATH_MAX;
+}
+
+// the entries are the only files in the directory whose names don't start with a dot, temporary files do
+static inline bool cacheisentry(const struct dirent* const restrict entry) { return entry->d_name[0] != '.'; }
+
+typedef struct {
+        struct timespec _mtime;
+        long long       _size;
+        char            _name[NAME_MAX + 1];
+} cacheentry;
+
+static inline int cacheolder(const void* const _left, const void* const _right) {
+    const cacheentry* const left  = _left;
+    const cacheentry* const right = _right;
+    if (left->_mtime.tv_sec != right->_mtime.tv_sec) return left->_mtime.tv_sec < right->_mtime.tv_sec ? -1 : 1;
+    return (left->_mtime.tv_nsec > right->_mtime.tv_nsec) - (left->_mtime.tv_nsec < right->_mtime.tv_nsec);
+}
+
+// rescans the directory, and deletes the least recently used entries until the rest take up at most limit bytes
+// a limit of LLONG_MAX only counts the entries. the size of the entries is left in _nbytes
+static inline void cacheevict(resultcache* const restrict cache, const long long limit) {
+    DIR* const directory = opendir(cache->_directory);
+    if (!directory) return;
+
+    cacheentry* entries  = NULL;
+    size_t      count    = 0;
+    size_t      capacity = 0;
+    long long   nbytes   = 0;
+    struct stat filestat = {};
+    for (const struct dirent* entry = readdir(directory); entry; entry = readdir(directory)) {
+        if (!cacheisentry(entry) || fstatat(dirfd(directory), entry->d_name, &filestat, 0) || !S_ISREG(filestat.st_mode)) continue;
+        nbytes += filestat.st_size;
+        if (limit == LLONG_MAX) continue; // counting only
+
+        if (count == capacity) {
+            cacheentry* const grown = realloc(entries, sizeof(cacheentry) * (capacity ? capacity * 2 : 64));
+            if (!grown) break; // evicts what it has seen so far
+            entries  = grown;
+            capacity = capacity ? capacity * 2 : 64;
+        }
+        entries[count]._mtime = filestat.st_mtim;
+        entries[count]._size  = filestat.st_size;
+        memcpy(entries[count++]._name, entry->d_name, strlen(entry->d_name) + 1); // d_name always fits in NAME_MAX + 1 bytes
+    }
+
+    if (nbytes > limit) {
+        qsort(entries, count, sizeof(cacheentry), cacheolder);
+        // an entry another process deletes first is just not counted twice
+        for (size_t i = 0; i < count && nbytes > limit; ++i)
+            if (!unlinkat(dirfd(directory), entries[i]._name, 0)) {
+                nbytes -= entries[i]._size;
+                cache->_stats._nevictions++;
+            }
+    }
+
+    free(entries);
+    closedir(directory);
+    cache->_nbytes = nbytes;
+}
+
+// sets up a cache in directory, creating it if need be, with a cap of maxbytes on the size of the entries
+// returns false if the directory can't be used (errors are reported to stderr)
+static inline bool cacheopen(resultcache* const restrict cache, const char* const restrict directory, const long long maxbytes) {
+    *cache = (resultcache) { ._maxbytes = maxbytes, ._nbytes = 0, ._ntemps = 0 };
+    if (snprintf(cache->_directory, PATH_MAX, "%s", directory) >= PATH_MAX) {
+        fprintf(stderr, "Error in %s @ line %d: the path of the cache directory is too long\n", __FUNCTION__, __LINE__);
+        return false;
+    }
+    if (mkdir(directory, 0755) && errno != EEXIST) {
+        fprintf(stderr, "Call to mkdir() failed inside %s at line %d!; errno %d\n", __FUNCTION__, __LINE__, errno);
+        return false;
+    }
+    cacheevict(cache, LLONG_MAX);
+    return true;
+}
+
+// looks up the nstrings strings of the entry of key, on a hit they are stored in strings (pointing into a single block from memory, release
+// it through strings[0]) and the entry is marked as used. an entry that doesn't hold exactly nstrings strings counts as a miss
+static inline bool cachefind(
+    resultcache* const restrict cache, const cachekey key, char** const restrict strings, const long long nstrings, arena* const memory
+) {
+    char path[PATH_MAX] = { 0 };
+    unsigned char* buffer   = NULL;
+    struct stat    filestat = {};
+    const int      fdesc    = cachepath(cache, key, path) ? open(path, O_RDONLY) : -1;
+    if (fdesc != -1 && !fstat(fdesc, &filestat) && filestat.st_size > 0 && (buffer = arenaalloc(memory, filestat.st_size))) {
+        if (!preadall(fdesc, buffer, filestat.st_size, 0)) {
+            arenafree(memory, buffer);
+            buffer = NULL;
+        } else
+            futimens(fdesc, NULL); // the least recently used entries are evicted first
+    }
+    if (fdesc != -1) close(fdesc);
+
+    // the strings must fill the entry exactly, anything else is a foreign or damaged file
+    long long nfound = 0, offset = 0; // NOLINT(readability-isolate-declaration)
+    while (buffer && offset < filestat.st_size && nfound < nstrings) {
+        const unsigned char* const terminator = memchr(buffer + offset, 0, filestat.st_size - offset);
+        if (!terminator) break;
+        strings[nfound++] = (char*) buffer + offset;
+        offset            = terminator - buffer + 1;
+    }
+
+    if (!buffer || nfound != nstrings || offset != filestat.st_size) {
+        arenafree(memory, buffer);
+        cache->_stats._nmisses++;
+        return false;
+    }
+    cache->_stats._nhits++;
+    return true;
+}
+
+// stores the nstrings strings of the result of key, atomically, and evicts the least recently used entries if the cap is exceeded
+static inline void cachestore(
+    resultcache* const restrict cache, const cachekey key, const char* const* const restrict strings, const long long nstrings
+) {
+    char path[PATH_MAX] = { 0 }, temporary[PATH_MAX] = { 0 }; // NOLINT(readability-isolate-declaration)
+    // temporary files are named after the process and a counter, so concurrent writers of the same key never share one
+    const unsigned long long content = key._content;
+    if (!cachepath(cache, key, path) ||
+        snprintf(temporary, PATH_MAX, "%s/.%016llx.%d.%llu", cache->_directory, content, getpid(), cache->_ntemps++) >= PATH_MAX)
+        return;
+
+    const int fdesc = open(temporary, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fdesc == -1) return;
+
+    long long nbytes = 0;
+    bool      done   = true;
+    for (long long i = 0; i < nstrings && done; ++i) {
+        const long long length  = strlen(strings[i]) + 1; // the NULL terminators separate the strings
+        done                    = writeall(fdesc, (const unsigned char*) strings[i], length);
+        nbytes                 += length;
+    }
+
+    if (close(fdesc) || !done || rename(temporary, path)) {
+        unlink(temporary);
+        return;
+    }
+
+    cache->_stats._nstores++;
+    // evicting down to a little below the cap leaves some room, so that the stores that follow don't all have to rescan the directory
+    if ((cache->_nbytes += nbytes) > cache->_maxbytes) cacheevict(cache, cache->_maxbytes * 9 / 10);
+}
+
+static inline void cachereport(const cachestats* const restrict stats, FILE* const restrict stream) {
+    fprintf(
+        stream,
+        "cache :: %llu hits, %llu misses, %llu entries stored, %llu evicted\n",
+        stats->_nhits,
+        stats->_nmisses,
+        stats->_nstores,
+        stats->_nevictions
+    );
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+// clang-format off
+#include <_tostring.h>
+// clang-format on
+
+// colour lookup tables, tunable_mapper() (see <_penalty.h>) with the weights baked in
+// tunable_mapper() takes its weights at runtime, so they can't be folded into the tables of a compiled palette (see <_cpalette.h>) and
+// every pixel pays for four asserts, a float division, a multiplication by the palette length and the branch inside nudge(). a colour
+// lookup table moves all of that out of the loop for any weighting, and maps pixels in one of three ways
+//     exact        the offset from per channel products, (_bproducts[blue] + _gproducts[green]) + _rproducts[red], the same single
+//                  precision values tunable_mapper() computes, and the character from the offset, two float adds and four loads
+//     the cube     32 x 32 x 32 buckets of 8 x 8 x 8 colours, 32 KiB, fits in L1 and is filled in no time. the offset grows with every
+//                  channel, so the colours of a bucket map to the characters between those of its darkest and its brightest corner, and
+//                  when the corners land on the same palette entry the whole bucket does. buckets that straddle two entries hold 0 and
+//                  their pixels fall back to the exact offset
+//     full table   a character for each of the 2 ^ 24 colours, 16 MiB, a single load that never branches, but the table is far bigger
+//                  than the caches and filling it takes 2 ^ 24 offsets, it only pays off for large images (src/bench.c finds the crossover)
+// a bucket spans up to 7 * (bscale + gscale + rscale) offsets, and a palette entry 256 / plength of them, so with weights adding up to
+// 1.0 and any of the bundled palettes most buckets straddle an entry and the cube would be slower than the exact offsets it falls back
+// to. clutcompile() only settles on the cube when at least half of its buckets are uniform, short palettes and light weights
+// all three agree with tunable_mapper() bit for bit
+
+#define CLUT_BUCKETS 32U // BUCKETS PER CHANNEL OF THE CUBE
+
+// how a colourlut maps pixels, picked by clutcompile()
+typedef enum { CLUT_EXACT, CLUT_CUBE, CLUT_FULL } CLUT_KIND;
+
+typedef struct {
+        CLUT_KIND _kind;
+        // per channel products i.e _bproducts[x] = x * bscale, in single precision like tunable_mapper()
+        float     _bproducts[UCHAR_MAX + 1];
+        float     _gproducts[UCHAR_MAX + 1];
+        float     _rproducts[UCHAR_MAX + 1];
+        char      _chars[UCHAR_MAX + 1];                             // offset to character lookup table
+        char      _cube[CLUT_BUCKETS * CLUT_BUCKETS * CLUT_BUCKETS]; // character of every bucket, 0 where it needs the exact offset
+        char*     _full;                                             // character of every red << 16 | green << 8 | blue, or NULL
+        arena*    _arena;                                            // where _full came from, NULL for the heap
+} colourlut;
+
+// the offset tunable_mapper() computes, summed in the same order
+static inline unsigned clutoffset(
+    const colourlut* const restrict lut, const unsigned char blue, const unsigned char green, const unsigned char red
+) {
+    return lut->_bproducts[blue] + lut->_gproducts[green] + lut->_rproducts[red];
+}
+
+static inline char clutexact(
+    const colourlut* const restrict lut, const unsigned char blue, const unsigned char green, const unsigned char red
+) {
+    return lut->_chars[clutoffset(lut, blue, green, red)];
+}
+
+// index of the bucket a colour falls in
+static inline unsigned clutbucket(const unsigned char blue, const unsigned char green, const unsigned char red) {
+    return (red >> 3) << 10 | (green >> 3) << 5 | blue >> 3;
+}
+
+typedef struct {
+        const colourlut* _lut;
+} clutcontext;
+
+// fills the planes [first, last) of the full table, red is the slowest moving channel
+static inline void clutplanes(const void* const restrict _context, const long long first, const long long last) {
+    const colourlut* const lut = ((const clutcontext*) _context)->_lut;
+    for (long long red = first; red < last; ++red)
+        for (unsigned green = 0; green <= UCHAR_MAX; ++green) {
+            char* const restrict out = lut->_full + (red << 16 | green << 8);
+            for (unsigned blue = 0; blue <= UCHAR_MAX; ++blue) out[blue] = clutexact(lut, blue, green, red);
+        }
+}
+
+// bakes a weighting and a palette into a colour lookup table, with a full table when full is true (from memory, NULL for the heap, the
+// planes are filled on the pool). the weights must be non negative and add up to at most 1.0, the same as tunable_mapper() asks for
+// returns false if the full table could not be allocated (errors are reported to stderr), release it with clutfree()
+static inline bool clutcompile(
+    colourlut* const restrict  lut,
+    const float                bscale,
+    const float                gscale,
+    const float                rscale,
+    const char* const restrict palette,
+    const unsigned             plength,
+    const bool                 full,
+    threadpool* const          pool,
+    arena* const               memory
+) {
+    assert(bscale >= 0.000 && gscale >= 0.000 && rscale >= 0.000);
+    assert((bscale + gscale + rscale) <= ONE);
+    lut->_kind  = CLUT_EXACT;
+    lut->_full  = NULL;
+    lut->_arena = memory;
+
+    for (unsigned x = 0; x <= UCHAR_MAX; ++x) {
+        lut->_bproducts[x] = x * bscale;
+        lut->_gproducts[x] = x * gscale;
+        lut->_rproducts[x] = x * rscale;
+        lut->_chars[x]     = palette[x ? nudge(x / (float) (UCHAR_MAX) *plength) - 1 : 0]; // the same expression as tunable_mapper()
+    }
+
+    if (full) {
+        if (!(lut->_full = arenaalloc(memory, 1LLU << 24))) {
+            fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+            return false;
+        }
+        const clutcontext context = { ._lut = lut };
+        tpoolfor(pool, UCHAR_MAX + 1, clutplanes, &context);
+        lut->_kind = CLUT_FULL;
+    }
+
+    // the palette index of an offset, for telling apart repeated characters (palette_extended has two apostrophes)
+    unsigned char indices[UCHAR_MAX + 1] = { 0 };
+    for (unsigned offset = 1; offset <= UCHAR_MAX; ++offset) indices[offset] = nudge(offset / (float) (UCHAR_MAX) *plength) - 1;
+
+    unsigned nuniform = 0;
+    for (unsigned red = 0; red < CLUT_BUCKETS; ++red)
+        for (unsigned green = 0; green < CLUT_BUCKETS; ++green)
+            for (unsigned blue = 0; blue < CLUT_BUCKETS; ++blue) {
+                const unsigned darkest   = indices[clutoffset(lut, blue << 3, green << 3, red << 3)];
+                const unsigned brightest = indices[clutoffset(lut, blue << 3 | 7, green << 3 | 7, red << 3 | 7)];
+                lut->_cube[red << 10 | green << 5 | blue] = darkest == brightest ? palette[darkest] : 0;
+                nuniform                                 += darkest == brightest;
+            }
+    if (!full && nuniform >= CLUT_BUCKETS * CLUT_BUCKETS * CLUT_BUCKETS / 2) lut->_kind = CLUT_CUBE;
+    return true;
+}
+
+static inline void clutfree(colourlut* const lut) {
+    arenafree(lut->_arena, lut->_full);
+    lut->_full = NULL;
+    if (lut->_kind == CLUT_FULL) lut->_kind = CLUT_EXACT;
+}
+
+// drop in replacement for tunable_mapper()
+static inline char clutmap(const colourlut* const restrict lut, const RGBQUAD* const restrict pixel) {
+    if (lut->_kind == CLUT_FULL) return lut->_full[pixel->rgbRed << 16 | pixel->rgbGreen << 8 | pixel->rgbBlue];
+    const char bucket = lut->_kind == CLUT_CUBE ? lut->_cube[clutbucket(pixel->rgbBlue, pixel->rgbGreen, pixel->rgbRed)] : 0;
+    return bucket ? bucket : clutexact(lut, pixel->rgbBlue, pixel->rgbGreen, pixel->rgbRed);
+}
+
+// the kernels map a run of RGBQUADs, each with its own table, regardless of the kind of the lut (the full one needs a _full table)
+
+static inline void clutline_exact(
+    const RGBQUAD* const restrict pixels, const long long npixels, const colourlut* const restrict lut, char* const restrict out
+) {
+    for (long long i = 0; i < npixels; ++i) out[i] = clutexact(lut, pixels[i].rgbBlue, pixels[i].rgbGreen, pixels[i].rgbRed);
+}
+
+static inline void clutline_cube(
+    const RGBQUAD* const restrict pixels, const long long npixels, const colourlut* const restrict lut, char* const restrict out
+) {
+    for (long long i = 0; i < npixels; ++i) {
+        const char bucket = lut->_cube[clutbucket(pixels[i].rgbBlue, pixels[i].rgbGreen, pixels[i].rgbRed)];
+        out[i]            = bucket ? bucket : clutexact(lut, pixels[i].rgbBlue, pixels[i].rgbGreen, pixels[i].rgbRed);
+    }
+}
+
+// the lower 24 bits of a pixel are its index in the full table
+static inline void clutline_full(
+    const RGBQUAD* const restrict pixels, const long long npixels, const colourlut* const restrict lut, char* const restrict out
+) {
+    for (long long i = 0; i < npixels; ++i) {
+        uint32_t quad = 0;
+        memcpy(&quad, pixels + i, sizeof(uint32_t));
+        out[i] = lut->_full[quad & 0xFFFFFFU];
+    }
+}
+
+// mapscanline() with a colour lookup table
+static inline void clutscanline(
+    const unpacker* const restrict      unpack,
+    const unsigned char* const restrict pixels,
+    const long long                     width,
+    const colourlut* const restrict     lut,
+    char* const restrict                out
+) {
+    if (unpack->_layout == BGRA32) {
+        if (lut->_kind == CLUT_FULL)
+            clutline_full((const RGBQUAD*) pixels, width, lut, out);
+        else if (lut->_kind == CLUT_CUBE)
+            clutline_cube((const RGBQUAD*) pixels, width, lut, out);
+        else
+            clutline_exact((const RGBQUAD*) pixels, width, lut, out);
+        return;
+    }
+
+    for (long long i = 0; i < width; ++i) {
+        const RGBQUAD pixel = unpackpixel(unpack, pixels, i);
+        out[i]              = clutmap(lut, &pixel);
+    }
+}
+
+typedef struct {
+        const imview*    _view;
+        const colourlut* _lut;
+        const unpacker*  _unpack;
+        char*            _buffer;
+} tunedcontext;
+
+// maps output rows [first, last), see rawrows()
+static inline void tunedrows(const void* const restrict _context, const long long first, const long long last) {
+    const tunedcontext* const context = _context;
+    const long long           width   = context->_view->_width;
+
+    for (long long row = first; row < last; ++row) {
+        if (!((row - first) % PREFETCH_SCANLINES)) imwillneed(context->_view, row, row + 2 * PREFETCH_SCANLINES);
+        char* const out = context->_buffer + row * (width + 1);
+        clutscanline(context->_unpack, imscanline(context->_view, row), width, context->_lut, out);
+        out[width] = '\n';
+    }
+}
+
+// to_raw_string() with a custom weighting, a character per pixel. returns NULL if anything could not be allocated (errors are reported
+// to stderr), release the string with arenafree()
+static inline char* to_tuned_string(
+    const imview* const restrict view, const colourlut* const restrict lut, threadpool* const pool, arena* const memory
+) {
+    char* const buffer = arenaalloc(memory, view->_height * (view->_width + 1) + 1); // LFs and a NULL terminator
+    if (!buffer) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        return NULL;
+    }
+
+    // the unpacker only needs a palette for the character tables of the indexed layouts, which are never looked at here
+    const cpalette cpal   = cpalcompile(smapper, spalette, sizeof(spalette));
+    unpacker       unpack = { 0 };
+    if (!unpackcompile(&unpack, view->_headers, view->_infoheader, &cpal, memory)) {
+        arenafree(memory, buffer);
+        return NULL;
+    }
+
+    const tunedcontext context = { ._view = view, ._lut = lut, ._unpack = &unpack, ._buffer = buffer };
+    tpoolfor(pool, view->_height, tunedrows, &context);
+    unpackfree(&unpack);
+
+    buffer[view->_height * (view->_width + 1)] = 0;
+    return buffer;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+// clang-format off
+#include <_grid.h>
+// clang-format on
+
+// truecolour output, every character painted with the average colour of its block through an ANSI 24 bit foreground escape
+// i.e ESC[38;2;<red>;<green>;<blue>m, which takes up to 19 bytes for a single byte character. an escape per cell would make the output
+// 10 - 20 times the size of the plain one, so the escapes are coalesced
+//     the colours are quantized to 8 - COLOUR_SHIFT bits per channel first, neighbouring blocks of a smooth region land on the same colour
+//     a cell only gets an escape when its colour differs from the one in effect, a run of cells of the same colour shares one
+//     spaces have no foreground to paint, they take whatever colour is in effect and never start or break a run
+// every row ends with a reset, ESC[0m, so a row doesn't bleed into whatever comes after the image and the rows are independent of each
+// other. that makes the size of each row computable on its own, so the output is sized exactly in a first pass over the cells (in
+// parallel), allocated once and written in a second pass (in parallel too), each row at the offset the first pass worked out for it
+// the colours come from the block averages of a grid (see <_grid.h>), so saved grids can be rendered in colour too
+
+#define COLOUR_SHIFT 2U // LOW ORDER BITS DROPPED FROM EVERY CHANNEL, 0 KEEPS ALL 2 ^ 24 COLOURS APART, LARGER VALUES MEAN LONGER RUNS
+#define COLOUR_RESET "\x1b[0m"
+
+static_assert(COLOUR_SHIFT <= 4U, "the dropped bits are refilled from the kept ones, so at least half of them must be kept");
+
+// quantizes a fixed point channel average (see blockmean()), the dropped bits are filled in by replicating the kept high order bits so
+// the darkest and the brightest levels stay 0 and 255
+static inline unsigned colourchannel(const uint32_t fixed) {
+    const unsigned level = (fixed >> FIXED_SHIFT) >> COLOUR_SHIFT;
+    return COLOUR_SHIFT ? (level << COLOUR_SHIFT | level >> (8 - 2 * COLOUR_SHIFT)) : level;
+}
+
+// the quantized colour of a block, red << 16 | green << 8 | blue
+static inline uint32_t colourof(const blockfixed* const restrict mean) {
+    return colourchannel(mean->_red) << 16 | colourchannel(mean->_green) << 8 | colourchannel(mean->_blue);
+}
+
+// writes a channel value in decimal unless out is NULL, returns the number of digits
+static inline long long colourdigits(const unsigned value, char* const restrict out) {
+    const long long ndigits = value >= 100 ? 3 : value >= 10 ? 2 : 1;
+    if (out)
+        for (long long i = ndigits - 1, v = value; i >= 0; --i, v /= 10) out[i] = '0' + v % 10;
+    return ndigits;
+}
+
+// writes the parameters that select a colour, <selector>;2;<red>;<green>;<blue>, unless out is NULL, returns their length
+// the selector is 38 for the foreground and 48 for the background
+static inline long long colourparams(const unsigned selector, const uint32_t colour, char* const restrict out) {
+    const unsigned channels[4] = { selector, 2, colour >> 16, colour >> 8 & 0xFFU };
+    long long      length      = 0;
+    for (unsigned i = 0; i < 4; ++i) {
+        length += colourdigits(channels[i], out ? out + length : NULL);
+        if (out) out[length] = ';';
+        ++length;
+    }
+    return length + colourdigits(colour & 0xFFU, out ? out + length : NULL);
+}
+
+// writes the foreground escape of a colour unless out is NULL, returns its length
+static inline long long colourescape(const uint32_t colour, char* const restrict out) {
+    if (out) memcpy(out, "\x1b[", 2);
+    const long long length = 2 + colourparams(38, colour, out ? out + 2 : NULL);
+    if (out) out[length] = 'm';
+    return length + 1;
+}
+
+// renders a row of ncolumns cells, characters, escapes, the reset and the LF, into out unless it's NULL, returns the number of bytes
+// the sizing pass and the writing pass both go through here, so they can't disagree
+static inline long long colourrow(
+    const blockfixed* const restrict cells, const long long ncolumns, const cpalette* const restrict cpal, char* const restrict out
+) {
+    long long length  = 0;
+    bool      painted = false; // whether an escape is in effect
+    uint32_t  current = 0;
+    for (long long col = 0; col < ncolumns; ++col) {
+        const char character = blockfixedmap(cells + col, cpal);
+        if (character != ' ') {
+            const uint32_t colour = colourof(cells + col);
+            if (!painted || colour != current) length += colourescape(colour, out ? out + length : NULL);
+            painted = true;
+            current = colour;
+        }
+        if (out) out[length] = character;
+        ++length;
+    }
+
+    if (painted) {
+        if (out) memcpy(out + length, COLOUR_RESET, sizeof(COLOUR_RESET) - 1);
+        length += sizeof(COLOUR_RESET) - 1;
+    }
+    if (out) out[length] = '\n';
+    return length + 1;
+}
+
+typedef struct {
+        const blockgrid* _grid;
+        const cpalette*  _cpal;
+        long long*       _offsets; // _rows + 1 byte offsets of the rows, the first pass stores the length of row r at _offsets[r + 1]
+        char*            _buffer;  // NULL during the first pass
+} colourcontext;
+
+// sizes or writes rows [first, last)
+static inline void colourrows(const void* const restrict _context, const long long first, const long long last) {
+    const colourcontext* const context = _context;
+    const long long            ncols   = context->_grid->_columns;
+    for (long long row = first; row < last; ++row) {
+        const blockfixed* const cells = context->_grid->_cells + row * ncols;
+        if (context->_buffer)
+            colourrow(cells, ncols, context->_cpal, context->_buffer + context->_offsets[row]);
+        else
+            context->_offsets[row + 1] = colourrow(cells, ncols, context->_cpal, NULL);
+    }
+}
+
+// renders the grid with the compiled palette, each character in the colour of its block, see to_grid_string()
+// returns NULL if anything could not be allocated (errors are reported to stderr), release the string with arenafree()
+static inline char* to_colour_string(
+    const blockgrid* const restrict grid, const cpalette* const restrict cpal, threadpool* const pool, arena* const memory
+) {
+    long long* const offsets = arenacalloc(memory, grid->_rows + 1, sizeof(long long));
+    if (!offsets) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        return NULL;
+    }
+
+    colourcontext context = { ._grid = grid, ._cpal = cpal, ._offsets = offsets, ._buffer = NULL };
+    tpoolfor(pool, grid->_rows, colourrows, &context);
+    for (long long row = 0; row < grid->_rows; ++row) offsets[row + 1] += offsets[row]; // lengths to offsets
+
+    char* const buffer = arenaalloc(memory, offsets[grid->_rows] + 1); // + 1 for the NULL terminator
+    if (!buffer) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        arenafree(memory, offsets);
+        return NULL;
+    }
+
+    context._buffer = buffer;
+    tpoolfor(pool, grid->_rows, colourrows, &context);
+    buffer[offsets[grid->_rows]] = 0;
+    arenafree(memory, offsets);
+    return buffer;
+}
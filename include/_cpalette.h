@@ -0,0 +1,116 @@
+#pragma once
+
+// clang-format off
+#include <_utils.h>
+// clang-format on
+
+// the mappers in <_utils.h> do a couple of double precision multiplies, a float division by UCHAR_MAX, a multiplication by the palette
+// length and a branch inside nudge(), all of that for every single pixel!
+// but once the offset is computed, everything else only depends on the offset, which is an integer in the range [0, 255]
+// so the offset to character mapping can be computed once for all 256 possible offsets, ahead of time and stored in a lookup table
+// the same goes for the per channel products in the weighted mappers, rgbBlue * 0.299 can only take 256 distinct values!
+// a compiled palette bundles these lookup tables for a given (mapper, palette) pair, build it once and reuse it for every pixel
+
+// kinds of mappers a palette can be compiled for
+typedef enum { ARITHMETIC, WEIGHTED, MINMAX, LUMINOSITY } MAPPER_KIND;
+
+typedef struct {
+        MAPPER_KIND _kind;
+        char        _chars[UCHAR_MAX + 1]; // offset to character lookup table, _chars[offset] is what the mappers would have returned
+        // weights of the blue, green and red channels, only meaningful for WEIGHTED and LUMINOSITY mappers (zeroes otherwise)
+        double      _bscale, _gscale, _rscale; // NOLINT(readability-isolate-declaration)
+        // precomputed per channel products i.e _bweights[x] = x * _bscale
+        // these are deliberately kept as doubles and summed in the same order as the mappers do, so the offsets match bit for bit
+        double      _bweights[UCHAR_MAX + 1];
+        double      _gweights[UCHAR_MAX + 1];
+        double      _rweights[UCHAR_MAX + 1];
+} cpalette;
+
+// the mapper kinds and the bundled palettes by name, for whatever picks them at runtime i.e -k and -c, and the requests of the conversion
+// server (see <_server.h>), which carry their indices. the mappers are in the order of MAPPER_KIND
+#define CPAL_NMAPPERS  4U
+#define CPAL_NPALETTES 3U
+
+static const char* const cpalmappernames[CPAL_NMAPPERS]   = { "arithmetic", "weighted", "minmax", "luminosity" };
+static const char* const cpalpalettenames[CPAL_NPALETTES] = { "minimal", "base", "extended" };
+static const char* const cpalpalettes[CPAL_NPALETTES]     = { palette_minimal, palette_base, palette_extended };
+static const unsigned    cpalplengths[CPAL_NPALETTES]     = { sizeof(palette_minimal), sizeof(palette_base), sizeof(palette_extended) };
+
+// index of name in the nnames names, -1 if it isn't there
+static inline int cpalnameindex(const char* const restrict name, const char* const* const restrict names, const unsigned nnames) {
+    for (unsigned i = 0; i < nnames; ++i)
+        if (!strcmp(name, names[i])) return (int) i;
+    return -1;
+}
+
+// builds the lookup tables for the given mapper kind and palette
+static inline cpalette cpalcompile(const MAPPER_KIND kind, const char* const restrict palette, const unsigned plength) {
+    cpalette cpal = { ._kind = kind, ._bscale = 0.000, ._gscale = 0.000, ._rscale = 0.000 };
+
+    // the exact same expression the mappers use, evaluated once per offset instead of once per pixel
+    for (unsigned offset = 0; offset <= UCHAR_MAX; ++offset)
+        cpal._chars[offset] = palette[offset ? nudge(offset / (float) (UCHAR_MAX) *plength) - 1 : 0];
+
+    if (kind == WEIGHTED) { // same weights as weighted_mapper and weighted_blockmapper
+        cpal._bscale = 0.299;
+        cpal._gscale = 0.587;
+        cpal._rscale = 0.114;
+    } else if (kind == LUMINOSITY) { // same weights as luminosity_mapper and luminosity_blockmapper
+        cpal._bscale = 0.2126;
+        cpal._gscale = 0.7152;
+        cpal._rscale = 0.0722;
+    }
+
+    for (unsigned x = 0; x <= UCHAR_MAX; ++x) {
+        cpal._bweights[x] = x * cpal._bscale;
+        cpal._gweights[x] = x * cpal._gscale;
+        cpal._rweights[x] = x * cpal._rscale;
+    }
+
+    return cpal;
+}
+
+// offset of a pixel given as loose channel values, for pixel formats that aren't laid out as RGBQUADs (see <_unpack.h>)
+static inline unsigned cpalbgroffset(
+    const cpalette* const restrict cpal, const unsigned char blue, const unsigned char green, const unsigned char red
+) {
+    switch (cpal->_kind) {
+        // the sum of three unsigned chars is exactly representable in a float, so the mapper's floating point division truncates to
+        // the same value as an integer division
+        case ARITHMETIC : return (blue + green + red) / 3U;
+        case MINMAX     : return (min(min(blue, green), red) + max(max(blue, green), red)) / 2U;
+        default /* WEIGHTED and LUMINOSITY */ :
+            return (unsigned) (cpal->_bweights[blue] + cpal->_gweights[green] + cpal->_rweights[red]);
+    }
+}
+
+// offset of an RGB pixel, the result is identical to the offset computed inside the corresponding mapper
+static inline unsigned cpaloffset(const cpalette* const restrict cpal, const RGBQUAD* const restrict pixel) {
+    return cpalbgroffset(cpal, pixel->rgbBlue, pixel->rgbGreen, pixel->rgbRed);
+}
+
+// drop in replacement for the basic mappers
+static inline char cpalmap(const cpalette* const restrict cpal, const RGBQUAD* const restrict pixel) {
+    const unsigned offset = cpaloffset(cpal, pixel);
+    assert(offset <= UCHAR_MAX);
+    return cpal->_chars[offset];
+}
+
+// offset of a block average, the block averages are floats so the offset can't come from a table
+static inline unsigned cpalblockoffset(const cpalette* const restrict cpal, const float rgbBlue, const float rgbGreen, const float rgbRed) {
+    unsigned offset = 0;
+    switch (cpal->_kind) {
+        case ARITHMETIC : offset = (rgbBlue + rgbGreen + rgbRed) / 3.000; break;
+        case MINMAX     : offset = (min(min(rgbBlue, rgbGreen), rgbRed) + fmax(max(rgbBlue, rgbGreen), rgbRed)) / 2.0000; break;
+        default /* WEIGHTED and LUMINOSITY */ :
+            offset = rgbBlue * cpal->_bscale + rgbGreen * cpal->_gscale + rgbRed * cpal->_rscale;
+            break;
+    }
+    assert(offset <= UCHAR_MAX);
+    return offset;
+}
+
+// drop in replacement for the block mappers, the offset to character mapping still comes from the table
+static inline char cpalblockmap(const cpalette* const restrict cpal, const float rgbBlue, const float rgbGreen, const float rgbRed) {
+    return cpal->_chars[cpalblockoffset(cpal, rgbBlue, rgbGreen, rgbRed)];
+}
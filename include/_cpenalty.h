@@ -0,0 +1,392 @@
+#pragma once
+
+// clang-format off
+#include <_tostring.h>
+// clang-format on
+
+// compiled penalties, the fast path of the penalizing mappers in <_penalty.h>
+// a penalizing mapper tests every pixel against three (lower, upper) limit pairs, six comparisons and a branch per pixel, before it even
+// gets to the offset. but whether a channel value falls inside its range depends on nothing but the value, one of 256, so the limits are
+// compiled once into a 256 bit membership mask per channel (bit x of the blue mask is set when a blue value of x is penalized) and a pixel
+// is penalized when any of its channels is a member. a mask doesn't care about the shape of the set, disjoint ranges (see cpeninclude())
+// cost the same as a single one
+// the penalty scales the offset before it is truncated, in double precision, just as the penalizing mappers do, so a penalized pixel maps
+// to the very character they pick. the weighted offsets come untruncated from the per channel tables of the compiled palette (see
+// <_cpalette.h>), the arithmetic and minmax ones are the sums the mappers divide, divided the same way
+// the kernels compute the untruncated offsets of 4 (SSE4.2) or 8 (AVX2) pixels at a time, the memberships with byte shuffles (every mask
+// is split into two 16 entry tables indexed by the low nibble of a value, whose bits stand for the high nibble, so pshufb does 16 lookups
+// at once) and blend the penalty or 1.0 into the scale factor of every pixel, there are no branches. scaling by 1.0 leaves the offset
+// as is, so a pixel that isn't penalized truncates to the plain offset
+// the arithmetic and minmax offsets depend on nothing but a sum of channels, so their penalized offsets are also compiled into tables the
+// AVX2 kernel gathers from, which is cheaper than converting, dividing and scaling 8 doubles
+
+typedef struct {
+        uint64_t      _masks[3][4];       // blue, green and red membership masks, value x is bit x % 64 of _masks[channel][x / 64]
+        // the masks as shuffle tables, bit h of _nibbles[channel][0][l] is value h << 4 | l and bit h of _nibbles[channel][1][l] is value
+        // (h + 8) << 4 | l, for h in [0, 8)
+        unsigned char _nibbles[3][2][16];
+        double        _scale;             // (1.0 - penalty), the factor the penalizing mappers scale the offsets of penalized pixels by
+        // the arithmetic and minmax offsets of penalized pixels, indexed by the sum of the channels and the sum of the extremes
+        uint32_t      _arithmetic[3 * UCHAR_MAX + 1];
+        uint32_t      _minmax[2 * UCHAR_MAX + 1];
+} cpenalty;
+
+// adds the values in [llim, ulim] of a channel (0 for blue, 1 for green and 2 for red) to the values that are penalized
+static inline void cpeninclude(cpenalty* const restrict cpen, const unsigned channel, const unsigned char llim, const unsigned char ulim) {
+    assert(channel < 3);
+    for (unsigned x = llim; x <= ulim; ++x) {
+        cpen->_masks[channel][x / 64]             |= 1LLU << (x % 64);
+        cpen->_nibbles[channel][x >> 7][x & 0x0F] |= 1U << ((x >> 4) & 7);
+    }
+}
+
+// compiles the limits and the penalty the penalizing mappers take, with the same conventions i.e the limits are inclusive, a channel whose
+// limits are identical is never penalized and penalty must be in [0.0, 1.0]
+static inline cpenalty cpencompile(
+    const unsigned char bllim,
+    const unsigned char bulim,
+    const unsigned char gllim,
+    const unsigned char gulim,
+    const unsigned char rllim,
+    const unsigned char rulim,
+    const float         penalty
+) {
+    assert(penalty >= 0.00000 && penalty <= ONE);
+    cpenalty cpen = { ._scale = ONE - penalty };
+    for (unsigned sum = 0; sum <= 3 * UCHAR_MAX; ++sum) cpen._arithmetic[sum] = sum / 3.000 * cpen._scale;
+    for (unsigned sum = 0; sum <= 2 * UCHAR_MAX; ++sum) cpen._minmax[sum] = sum / 2.0000 * cpen._scale;
+    if (bllim != bulim) cpeninclude(&cpen, 0, bllim, bulim);
+    if (gllim != gulim) cpeninclude(&cpen, 1, gllim, gulim);
+    if (rllim != rulim) cpeninclude(&cpen, 2, rllim, rulim);
+    return cpen;
+}
+
+// 1 when the pixel is penalized, 0 otherwise
+static inline unsigned cpenmember(
+    const cpenalty* const restrict cpen, const unsigned char blue, const unsigned char green, const unsigned char red
+) {
+    return ((cpen->_masks[0][blue / 64] >> (blue % 64)) | (cpen->_masks[1][green / 64] >> (green % 64)) |
+            (cpen->_masks[2][red / 64] >> (red % 64))) &
+           1;
+}
+
+// the offset of a pixel before it is truncated, evaluated as the mappers evaluate it
+static inline double cpenrawoffset(
+    const cpalette* const restrict cpal, const unsigned char blue, const unsigned char green, const unsigned char red
+) {
+    switch (cpal->_kind) {
+        case ARITHMETIC : return (blue + green + red) / 3.000;
+        case MINMAX     : return (min(min(blue, green), red) + max(max(blue, green), red)) / 2.0000;
+        default /* WEIGHTED and LUMINOSITY */ : return cpal->_bweights[blue] + cpal->_gweights[green] + cpal->_rweights[red];
+    }
+}
+
+// drop in replacement for the penalizing mappers, see cpalmap()
+static inline char cpenmap(const cpalette* const restrict cpal, const cpenalty* const restrict cpen, const RGBQUAD* const restrict pixel) {
+    if (!cpenmember(cpen, pixel->rgbBlue, pixel->rgbGreen, pixel->rgbRed)) return cpalmap(cpal, pixel);
+    return cpal->_chars[(unsigned) (cpenrawoffset(cpal, pixel->rgbBlue, pixel->rgbGreen, pixel->rgbRed) * cpen->_scale)];
+}
+
+// same as scanline_kernel, with a penalty
+typedef void (*penalty_kernel)(
+    const RGBQUAD* const restrict  pixels,
+    const long long                npixels,
+    const cpalette* const restrict cpal,
+    const cpenalty* const restrict cpen,
+    char* const restrict           out
+);
+
+static inline void penline_scalar(
+    const RGBQUAD* const restrict  pixels,
+    const long long                npixels,
+    const cpalette* const restrict cpal,
+    const cpenalty* const restrict cpen,
+    char* const restrict           out
+) {
+    for (long long i = 0; i < npixels; ++i) out[i] = cpenmap(cpal, cpen, pixels + i);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+    // the penalized offsets must round exactly as the mappers round them, see <_kernels.h>
+    #pragma GCC push_options
+    #pragma GCC optimize("fp-contract=off")
+
+// non zero in the 32 bit lanes of the pixels that are penalized, the three masks are looked up on every byte of the pixels and then kept
+// only where the byte is of their channel
+static __attribute__((target("sse4.2"))) inline __m128i members_sse42(const __m128i quads, const cpenalty* const restrict cpen) {
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i low    = _mm_and_si128(quads, nibble);
+    const __m128i high   = _mm_and_si128(_mm_srli_epi16(quads, 4), nibble);
+    // the bit that stands for the high nibble, in the table of values below 128 and in the table of values from 128 up
+    const __m128i lobit  = _mm_shuffle_epi8(_mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0), high);
+    const __m128i hibit  = _mm_shuffle_epi8(_mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, -128), high);
+
+    __m128i members = _mm_setzero_si128();
+    for (unsigned c = 0; c < 3; ++c) {
+        const __m128i lotable = _mm_loadu_si128((const __m128i*) cpen->_nibbles[c][0]);
+        const __m128i hitable = _mm_loadu_si128((const __m128i*) cpen->_nibbles[c][1]);
+        const __m128i bits    = _mm_or_si128(
+            _mm_and_si128(_mm_shuffle_epi8(lotable, low), lobit), _mm_and_si128(_mm_shuffle_epi8(hitable, low), hibit)
+        );
+        members = _mm_or_si128(members, _mm_and_si128(bits, _mm_set1_epi32(0xFF << (8 * c))));
+    }
+    return members;
+}
+
+// cpenrawoffset() of the pixels in the lower two 32 bit lanes of blue, green and red
+static __attribute__((target("sse4.2"))) inline __m128d rawoffsets_sse42(
+    const __m128i blue, const __m128i green, const __m128i red, const cpalette* const restrict cpal
+) {
+    switch (cpal->_kind) {
+        case ARITHMETIC : return _mm_div_pd(_mm_cvtepi32_pd(_mm_add_epi32(_mm_add_epi32(blue, green), red)), _mm_set1_pd(3.000));
+        case MINMAX     : // halving is exact, so the multiply gives the very double the division gives
+            return _mm_mul_pd(
+                _mm_cvtepi32_pd(
+                    _mm_add_epi32(_mm_min_epi32(_mm_min_epi32(blue, green), red), _mm_max_epi32(_mm_max_epi32(blue, green), red))
+                ),
+                _mm_set1_pd(0.5000)
+            );
+        default /* WEIGHTED and LUMINOSITY */ :
+            return _mm_add_pd(
+                _mm_add_pd(
+                    _mm_mul_pd(_mm_cvtepi32_pd(blue), _mm_set1_pd(cpal->_bscale)),
+                    _mm_mul_pd(_mm_cvtepi32_pd(green), _mm_set1_pd(cpal->_gscale))
+                ),
+                _mm_mul_pd(_mm_cvtepi32_pd(red), _mm_set1_pd(cpal->_rscale))
+            );
+    }
+}
+
+// offsets of 4 pixels, with the penalty applied to the ones that are penalized
+static __attribute__((target("sse4.2"))) inline __m128i penoffsets_sse42(
+    const __m128i quads, const cpalette* const restrict cpal, const cpenalty* const restrict cpen
+) {
+    const __m128i mask   = _mm_set1_epi32(0xFF);
+    const __m128i blue   = _mm_and_si128(quads, mask);
+    const __m128i green  = _mm_and_si128(_mm_srli_epi32(quads, 8), mask);
+    const __m128i red    = _mm_and_si128(_mm_srli_epi32(quads, 16), mask);
+    // all ones in the lanes of the pixels that aren't penalized, widened to 64 bits to pick 1.0 or the penalty as their scale factor
+    const __m128i spared = _mm_cmpeq_epi32(members_sse42(quads, cpen), _mm_setzero_si128());
+    const __m128d one = _mm_set1_pd(ONE), penalty = _mm_set1_pd(cpen->_scale);
+
+    const __m128d lo  = _mm_mul_pd(
+        rawoffsets_sse42(blue, green, red, cpal), _mm_blendv_pd(penalty, one, _mm_castsi128_pd(_mm_cvtepi32_epi64(spared)))
+    );
+    const __m128d hi = _mm_mul_pd(
+        rawoffsets_sse42(_mm_shuffle_epi32(blue, 0xEE), _mm_shuffle_epi32(green, 0xEE), _mm_shuffle_epi32(red, 0xEE), cpal),
+        _mm_blendv_pd(penalty, one, _mm_castsi128_pd(_mm_cvtepi32_epi64(_mm_shuffle_epi32(spared, 0xEE))))
+    );
+    return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+}
+
+static __attribute__((target("sse4.2"))) void penline_sse42(
+    const RGBQUAD* const restrict  pixels,
+    const long long                npixels,
+    const cpalette* const restrict cpal,
+    const cpenalty* const restrict cpen,
+    char* const restrict           out
+) {
+    unsigned char offsets[16] = { 0 };
+    long long     i           = 0;
+
+    for (; i + 16 <= npixels; i += 16) {
+        const __m128i o0 = penoffsets_sse42(_mm_loadu_si128((const __m128i*) (pixels + i)), cpal, cpen);
+        const __m128i o1 = penoffsets_sse42(_mm_loadu_si128((const __m128i*) (pixels + i + 4)), cpal, cpen);
+        const __m128i o2 = penoffsets_sse42(_mm_loadu_si128((const __m128i*) (pixels + i + 8)), cpal, cpen);
+        const __m128i o3 = penoffsets_sse42(_mm_loadu_si128((const __m128i*) (pixels + i + 12)), cpal, cpen);
+        _mm_storeu_si128((__m128i*) offsets, _mm_packus_epi16(_mm_packus_epi32(o0, o1), _mm_packus_epi32(o2, o3)));
+        // lookup16() isn't inlined into these kernels, and a call in the loop costs more than the whole penalty
+        for (unsigned j = 0; j < 16; ++j) out[i + j] = cpal->_chars[offsets[j]];
+    }
+
+    penline_scalar(pixels + i, npixels - i, cpal, cpen, out + i);
+}
+
+// members_sse42() for 8 pixels, the shuffle tables are the same in both 128 bit lanes
+static __attribute__((target("avx2"))) inline __m256i members_avx2(const __m256i quads, const cpenalty* const restrict cpen) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i low    = _mm256_and_si256(quads, nibble);
+    const __m256i high   = _mm256_and_si256(_mm256_srli_epi16(quads, 4), nibble);
+    const __m256i lobit  = _mm256_shuffle_epi8(
+        _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0), high
+    );
+    const __m256i hibit = _mm256_shuffle_epi8(
+        _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, -128), high
+    );
+
+    __m256i members = _mm256_setzero_si256();
+    for (unsigned c = 0; c < 3; ++c) {
+        const __m256i lotable = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) cpen->_nibbles[c][0]));
+        const __m256i hitable = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) cpen->_nibbles[c][1]));
+        const __m256i bits    = _mm256_or_si256(
+            _mm256_and_si256(_mm256_shuffle_epi8(lotable, low), lobit), _mm256_and_si256(_mm256_shuffle_epi8(hitable, low), hibit)
+        );
+        members = _mm256_or_si256(members, _mm256_and_si256(bits, _mm256_set1_epi32(0xFF << (8 * c))));
+    }
+    return members;
+}
+
+// offsets of 8 pixels, with the penalty applied to the ones that are penalized
+static __attribute__((target("avx2"))) inline __m256i penoffsets_avx2(
+    const __m256i quads, const cpalette* const restrict cpal, const cpenalty* const restrict cpen
+) {
+    const __m256i mask   = _mm256_set1_epi32(0xFF);
+    const __m256i blue   = _mm256_and_si256(quads, mask);
+    const __m256i green  = _mm256_and_si256(_mm256_srli_epi32(quads, 8), mask);
+    const __m256i red    = _mm256_and_si256(_mm256_srli_epi32(quads, 16), mask);
+    const __m256i spared = _mm256_cmpeq_epi32(members_avx2(quads, cpen), _mm256_setzero_si256()); // see penoffsets_sse42()
+
+    switch (cpal->_kind) {
+        // the penalized offsets are gathered from the tables of cpencompile() and blended with the plain ones, see offsets_avx2()
+        case ARITHMETIC : {
+            const __m256i sum = _mm256_add_epi32(_mm256_add_epi32(blue, green), red);
+            return _mm256_blendv_epi8(
+                _mm256_i32gather_epi32((const int*) cpen->_arithmetic, sum, 4),
+                _mm256_srli_epi32(_mm256_mullo_epi32(sum, _mm256_set1_epi32(0xAAAB)), 17),
+                spared
+            );
+        }
+        case MINMAX : {
+            const __m256i sum = _mm256_add_epi32(
+                _mm256_min_epi32(_mm256_min_epi32(blue, green), red), _mm256_max_epi32(_mm256_max_epi32(blue, green), red)
+            );
+            return _mm256_blendv_epi8(_mm256_i32gather_epi32((const int*) cpen->_minmax, sum, 4), _mm256_srli_epi32(sum, 1), spared);
+        }
+        default /* WEIGHTED and LUMINOSITY */ : {
+            const __m256d bscale = _mm256_set1_pd(cpal->_bscale), gscale = _mm256_set1_pd(cpal->_gscale),
+                          rscale = _mm256_set1_pd(cpal->_rscale);
+            const __m256d one = _mm256_set1_pd(ONE), penalty = _mm256_set1_pd(cpen->_scale);
+            const __m256d lo  = _mm256_mul_pd(
+                _mm256_add_pd(
+                    _mm256_add_pd(
+                        _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(blue)), bscale),
+                        _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(green)), gscale)
+                    ),
+                    _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(red)), rscale)
+                ),
+                _mm256_blendv_pd(penalty, one, _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(spared))))
+            );
+            const __m256d hi = _mm256_mul_pd(
+                _mm256_add_pd(
+                    _mm256_add_pd(
+                        _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(blue, 1)), bscale),
+                        _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(green, 1)), gscale)
+                    ),
+                    _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(red, 1)), rscale)
+                ),
+                _mm256_blendv_pd(penalty, one, _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_extracti128_si256(spared, 1))))
+            );
+            return _mm256_set_m128i(_mm256_cvttpd_epi32(hi), _mm256_cvttpd_epi32(lo));
+        }
+    }
+}
+
+static __attribute__((target("avx2"))) void penline_avx2(
+    const RGBQUAD* const restrict  pixels,
+    const long long                npixels,
+    const cpalette* const restrict cpal,
+    const cpenalty* const restrict cpen,
+    char* const restrict           out
+) {
+    unsigned char offsets[32] = { 0 };
+    long long     i           = 0;
+
+    for (; i + 32 <= npixels; i += 32) {
+        const __m256i o0     = penoffsets_avx2(_mm256_loadu_si256((const __m256i*) (pixels + i)), cpal, cpen);
+        const __m256i o1     = penoffsets_avx2(_mm256_loadu_si256((const __m256i*) (pixels + i + 8)), cpal, cpen);
+        const __m256i o2     = penoffsets_avx2(_mm256_loadu_si256((const __m256i*) (pixels + i + 16)), cpal, cpen);
+        const __m256i o3     = penoffsets_avx2(_mm256_loadu_si256((const __m256i*) (pixels + i + 24)), cpal, cpen);
+        const __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(o0, o1), _mm256_packus_epi32(o2, o3)); // see scanline_avx2()
+        _mm256_storeu_si256((__m256i*) offsets, _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)));
+        for (unsigned j = 0; j < 32; ++j) out[i + j] = cpal->_chars[offsets[j]]; // see penline_sse42()
+    }
+
+    penline_scalar(pixels + i, npixels - i, cpal, cpen, out + i);
+}
+
+    #pragma GCC pop_options
+
+#endif // defined(__x86_64__) || defined(__i386__)
+
+static penalty_kernel penline = penline_scalar; // resolved at startup by pickpenkernel(), AVX512 hosts use the AVX2 one
+
+static __attribute__((constructor)) void pickpenkernel(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        penline = penline_avx2;
+    else if (__builtin_cpu_supports("sse4.2"))
+        penline = penline_sse42;
+#endif
+}
+
+// mapscanline() with a penalty, 32 bit BGRA scanlines go through the vectorized kernels, the other layouts are mapped a pixel at a time
+static inline void penscanline(
+    const unpacker* const restrict      unpack,
+    const unsigned char* const restrict pixels,
+    const long long                     width,
+    const cpalette* const restrict      cpal,
+    const cpenalty* const restrict      cpen,
+    char* const restrict                out
+) {
+    if (unpack->_layout == BGRA32) {
+        penline((const RGBQUAD*) pixels, width, cpal, cpen, out);
+        return;
+    }
+
+    for (long long i = 0; i < width; ++i) {
+        const RGBQUAD pixel = unpackpixel(unpack, pixels, i);
+        out[i]              = cpenmap(cpal, cpen, &pixel);
+    }
+}
+
+typedef struct {
+        const imview*   _view;
+        const cpalette* _cpal;
+        const cpenalty* _cpen;
+        const unpacker* _unpack;
+        char*           _buffer;
+} penaltycontext;
+
+// maps output rows [first, last), see rawrows()
+static inline void penaltyrows(const void* const restrict _context, const long long first, const long long last) {
+    const penaltycontext* const context = _context;
+    const long long             width   = context->_view->_width;
+
+    for (long long row = first; row < last; ++row) {
+        if (!((row - first) % PREFETCH_SCANLINES)) imwillneed(context->_view, row, row + 2 * PREFETCH_SCANLINES);
+        char* const out = context->_buffer + row * (width + 1);
+        penscanline(context->_unpack, imscanline(context->_view, row), width, context->_cpal, context->_cpen, out);
+        out[width] = '\n';
+    }
+}
+
+// to_raw_string() with a penalty, a character per pixel, with the given compiled palette. returns NULL if anything could not be allocated
+// (errors are reported to stderr), release the string with arenafree()
+static inline char* to_penalized_string(
+    const imview* const restrict   view,
+    const cpalette* const restrict cpal,
+    const cpenalty* const restrict cpen,
+    threadpool* const              pool,
+    arena* const                   memory
+) {
+    char* const buffer = arenaalloc(memory, view->_height * (view->_width + 1) + 1); // LFs and a NULL terminator
+    if (!buffer) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        return NULL;
+    }
+
+    unpacker unpack = { 0 };
+    if (!unpackcompile(&unpack, view->_headers, view->_infoheader, cpal, memory)) {
+        arenafree(memory, buffer);
+        return NULL;
+    }
+
+    const penaltycontext context = { ._view = view, ._cpal = cpal, ._cpen = cpen, ._unpack = &unpack, ._buffer = buffer };
+    tpoolfor(pool, view->_height, penaltyrows, &context);
+    unpackfree(&unpack);
+
+    buffer[view->_height * (view->_width + 1)] = 0;
+    return buffer;
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+// clang-format off
+#include <_tostring.h>
+// clang-format on
+
+// the block averages of an image, at the layout to_string() would render it at, kept around as an artifact of their own
+// reducing the pixels to block averages is where nearly all the time of a conversion goes, mapping the averages to characters is cheap
+// so trying out mappers and palettes against the same image only needs the averages, and a grid saved with gridsave() can be rendered
+// with any compiled palette (see <_cpalette.h>) later on, by a different process, without the bitmap (see gridload() and to_grid_string())
+// the averages are kept as the exact fixed point numbers the converters map (see blockmean()), so rendering a grid with the palette the
+// converters are compiled with gives back exactly what to_string() returns for the bitmap
+// on disk, a grid is a gridheader followed by columns x rows blockfixeds, top to bottom and left to right, in native byte order
+
+#define GRID_MAGIC 0x44524742U // "BGRD", IN LITTLE ENDIAN BYTE ORDER
+
+typedef struct {
+        blockfixed* _cells;   // _rows x _columns averages, top to bottom and left to right
+        long long   _columns; // blocks along the x axis
+        long long   _rows;    // blocks along the y axis
+        arena*      _arena;   // where the cells came from, NULL for the heap
+} blockgrid;
+
+typedef struct {
+        uint32_t _magic;
+        uint32_t _shift; // FIXED_SHIFT of the build that wrote the grid
+        int64_t  _columns;
+        int64_t  _rows;
+} gridheader;
+
+typedef struct {
+        const imview*   _view;
+        const unpacker* _unpack;
+        blockgrid*      _grid;
+        blocksum*       _sums;    // _columns running sums for every block row, so concurrent bands never share sums
+        long long       _block_d; // dimension of an individual square block
+} gridcontext;
+
+// reduces block rows [first, last) to their averages, the same way downscaledrows() does, but stops short of mapping them
+static inline void gridrows(const void* const restrict _context, const long long first, const long long last) {
+    const gridcontext* const context = _context;
+    const long long          width   = context->_view->_width;
+    const long long          block_d = context->_block_d;
+    const long long          ncols   = context->_grid->_columns;
+
+    for (long long brow = first; brow < last; ++brow) {
+        const long long top    = brow * block_d;
+        const long long bottom = min(top + block_d, context->_view->_height);
+        blocksum* const sums   = context->_sums + brow * ncols;
+
+        imwillneed(context->_view, brow == first ? top : bottom, bottom + block_d);
+        long long r = top;
+        for (; r + 1 < bottom; r += 2)
+            foldscanlinepair(context->_unpack, imscanline(context->_view, r), imscanline(context->_view, r + 1), width, block_d, sums);
+        if (r < bottom) foldscanline(context->_unpack, imscanline(context->_view, r), width, block_d, sums);
+
+        // the complete blocks and the incomplete one at the right edge, see flushblockrow()
+        const reciprocal complete   = rcpcompute((bottom - top) * block_d);
+        const reciprocal incomplete = rcpcompute((bottom - top) * (width % block_d ? width % block_d : block_d));
+        blockfixed* const cells     = context->_grid->_cells + brow * ncols;
+        for (long long bcol = 0; bcol < ncols; ++bcol)
+            cells[bcol] = blockmean(sums + bcol, (bcol + 1) * block_d <= width ? complete : incomplete);
+    }
+}
+
+// reduces the view to the averages of ceil(width / ncolumns) pixel square blocks, i.e at most ncolumns blocks along the x axis
+// returns false if anything could not be allocated (errors are reported to stderr), release the grid with gridfree()
+static inline bool gridsample(
+    blockgrid* const restrict    grid,
+    const imview* const restrict view,
+    const long long              ncolumns,
+    threadpool* const            pool,
+    arena* const                 memory
+) {
+    const long long block_d = ceill(view->_width / (double) ncolumns);
+    *grid                   = (blockgrid) { ._columns = (view->_width + block_d - 1) / block_d,
+                                            ._rows    = (view->_height + block_d - 1) / block_d,
+                                            ._arena   = memory };
+
+    grid->_cells         = arenaalloc(memory, sizeof(blockfixed) * grid->_columns * grid->_rows);
+    blocksum* const sums = arenacalloc(memory, grid->_columns * grid->_rows, sizeof(blocksum));
+    if (!grid->_cells || !sums) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        arenafree(memory, grid->_cells);
+        arenafree(memory, sums);
+        grid->_cells = NULL;
+        return false;
+    }
+
+    // the unpacker only needs a palette for the character tables of the indexed layouts, which folding never looks at
+    const cpalette cpal   = cpalcompile(smapper, spalette, sizeof(spalette));
+    unpacker       unpack = { 0 };
+    if (!unpackcompile(&unpack, view->_headers, view->_infoheader, &cpal, memory)) {
+        arenafree(memory, grid->_cells);
+        arenafree(memory, sums);
+        grid->_cells = NULL;
+        return false;
+    }
+
+    const gridcontext context = { ._view = view, ._unpack = &unpack, ._grid = grid, ._sums = sums, ._block_d = block_d };
+    tpoolfor(pool, grid->_rows, gridrows, &context);
+    unpackfree(&unpack);
+    arenafree(memory, sums);
+    return true;
+}
+
+// reduces the view to its block averages, in the layout to_view_string() renders it at i.e 1 x 1 blocks for views up to CONSOLE_WIDTH
+// pixels wide and ceil(width / CONSOLE_WIDTH) pixel square blocks for the wider ones
+static inline bool gridbuild(
+    blockgrid* const restrict grid, const imview* const restrict view, threadpool* const pool, arena* const memory
+) {
+    return gridsample(grid, view, CONSOLE_WIDTH, pool, memory);
+}
+
+static inline void gridfree(blockgrid* const grid) {
+    arenafree(grid->_arena, grid->_cells);
+    memset(grid, 0U, sizeof(blockgrid));
+}
+
+// maps every average of the grid with the given compiled palette, a row of characters and a LF per block row, NULL terminated
+static inline char* to_grid_string(const blockgrid* const restrict grid, const cpalette* const restrict cpal, arena* const memory) {
+    char* const buffer = arenaalloc(memory, grid->_rows * (grid->_columns + 1) + 1);
+    if (!buffer) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        return NULL;
+    }
+
+    for (long long row = 0; row < grid->_rows; ++row) {
+        char* const             out   = buffer + row * (grid->_columns + 1);
+        const blockfixed* const cells = grid->_cells + row * grid->_columns;
+        for (long long col = 0; col < grid->_columns; ++col) out[col] = blockfixedmap(cells + col, cpal);
+        out[grid->_columns] = '\n';
+    }
+
+    buffer[grid->_rows * (grid->_columns + 1)] = 0;
+    return buffer;
+}
+
+// samples a bitmap at ncolumns blocks across (see gridsample()), run length encoded bitmaps can't be viewed and have no grid
+static inline bool bmpsample(
+    blockgrid* const restrict    grid,
+    const bitmap* const restrict image,
+    const long long              ncolumns,
+    threadpool* const            pool,
+    arena* const                 memory
+) {
+    if (!image->_pixels) return false; // bmpread failed and has already reported why
+    if (image->_infoheader.biCompression == RLE8 || image->_infoheader.biCompression == RLE4) {
+        fputs("Error in bmpsample, run length encoded bitmaps have no block grid!\n", stderr);
+        return false;
+    }
+
+    const imview view = bmpview(image);
+    return gridsample(grid, &view, ncolumns, pool, memory);
+}
+
+// builds the grid of a bitmap, in the layout of gridbuild()
+static inline bool bmpgrid(
+    blockgrid* const restrict grid, const bitmap* const restrict image, threadpool* const pool, arena* const memory
+) {
+    return bmpsample(grid, image, CONSOLE_WIDTH, pool, memory);
+}
+
+// writes the grid to fpath, replacing whatever was there, returns false on failure (errors are reported to stderr)
+static inline bool gridsave(const blockgrid* const restrict grid, const char* const restrict fpath) {
+    const int fdesc = open(fpath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fdesc == -1) {
+        fprintf(stderr, "Call to open() failed inside %s at line %d!; errno %d\n", __FUNCTION__, __LINE__, errno);
+        return false;
+    }
+
+    const gridheader header = { ._magic = GRID_MAGIC, ._shift = FIXED_SHIFT, ._columns = grid->_columns, ._rows = grid->_rows };
+    const bool       done   = writeall(fdesc, (const unsigned char*) &header, sizeof(gridheader)) &&
+                            writeall(fdesc, (const unsigned char*) grid->_cells, sizeof(blockfixed) * grid->_columns * grid->_rows);
+    if (!done) fprintf(stderr, "Call to write() failed inside %s at line %d!; errno %d\n", __FUNCTION__, __LINE__, errno);
+
+    if (close(fdesc)) {
+        fprintf(stderr, "Call to close() failed inside %s at line %d!; errno %d\n", __FUNCTION__, __LINE__, errno);
+        return false;
+    }
+    return done;
+}
+
+// reads a grid written by gridsave(), the cells come from memory (NULL for the heap). returns false if the file is not a grid, was
+// written by a build with a different FIXED_SHIFT, or is truncated (errors are reported to stderr), release the grid with gridfree()
+static inline bool gridload(blockgrid* const restrict grid, const char* const restrict fpath, arena* const memory) {
+    memset(grid, 0U, sizeof(blockgrid));
+    long                 size   = 0;
+    unsigned char* const buffer = imopen(fpath, &size, memory);
+    if (!buffer) return false; // imopen will do the error reporting
+
+    gridheader header = { 0 };
+    if (size >= (long) sizeof(gridheader)) memcpy(&header, buffer, sizeof(gridheader));
+    if (header._magic != GRID_MAGIC || header._shift != FIXED_SHIFT || header._columns <= 0 || header._rows <= 0 ||
+        header._columns > (size - (long) sizeof(gridheader)) / (long) sizeof(blockfixed) / header._rows ||
+        size != (long) (sizeof(gridheader) + sizeof(blockfixed) * header._columns * header._rows)) {
+        fprintf(stderr, "Error in %s @ line %d: %s is not a block grid, or is truncated\n", __FUNCTION__, __LINE__, fpath);
+        arenafree(memory, buffer);
+        return false;
+    }
+
+    // the averages are used as offsets into lookup tables further down the line, so they are never trusted
+    const blockfixed* const cells = (const blockfixed*) (buffer + sizeof(gridheader));
+    for (long long i = 0; i < header._columns * header._rows; ++i)
+        if (cells[i]._blue > (255U << FIXED_SHIFT) || cells[i]._green > (255U << FIXED_SHIFT) || cells[i]._red > (255U << FIXED_SHIFT)) {
+            fprintf(stderr, "Error in %s @ line %d: %s holds averages out of range\n", __FUNCTION__, __LINE__, fpath);
+            arenafree(memory, buffer);
+            return false;
+        }
+
+    // the cells are moved over the header, so that the buffer can be released through them by gridfree()
+    memmove(buffer, cells, sizeof(blockfixed) * header._columns * header._rows);
+    *grid = (blockgrid) { ._cells = (blockfixed*) buffer, ._columns = header._columns, ._rows = header._rows, ._arena = memory };
+    return true;
+}
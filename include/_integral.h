@@ -0,0 +1,198 @@
+#pragma once
+
+// clang-format off
+#include <_tostring.h>
+// clang-format on
+
+// a summed-area table (an integral image) of the blue, green and red channels, for rendering the same image at any number of columns
+// to_downscaled_string() is tied to CONSOLE_WIDTH and sums every block from the raw pixels, so every new width is another pass over all
+// the pixels. entry (y, x) of the table holds the sums of all the pixels above and to the left of pixel (y, x), so the sums of any
+// rectangle come from its four corners (see integralsum()), and a render costs a constant amount of work per character, regardless of
+// the size of the image. building the table is a single pass over the pixels, the table itself takes 24 bytes per pixel
+// the table is (height + 1) x (width + 1), the top row and the left column are all zeros, so that rectangles touching the top or the left
+// edge of the image need no special casing
+
+typedef struct {
+        blocksum* _table;
+        long long _width;  // pixels per scanline of the image, the table has one more column
+        long long _height; // scanlines in the image, the table has one more row
+        arena*    _arena;  // where the table came from, NULL for the heap
+} integral;
+
+typedef struct {
+        const integral* _integral;
+        const imview*   _view;
+        const unpacker* _unpack;
+} integralcontext;
+
+// the sums of each row on its own, prefixed left to right, rows [first, last) of the view
+static inline void integralrows(const void* const restrict _context, const long long first, const long long last) {
+    const integralcontext* const context = _context;
+    const long long              width   = context->_integral->_width;
+
+    for (long long row = first; row < last; ++row) {
+        blocksum* const sums = context->_integral->_table + (row + 1) * (width + 1);
+        memset(sums, 0U, sizeof(blocksum) * (width + 1));
+        foldscanline(context->_unpack, imscanline(context->_view, row), width, 1, sums + 1); // 1 x 1 blocks, the pixels themselves
+        for (long long col = 1; col <= width; ++col) {
+            sums[col]._blue  += sums[col - 1]._blue;
+            sums[col]._green += sums[col - 1]._green;
+            sums[col]._red   += sums[col - 1]._red;
+        }
+    }
+}
+
+// the row prefixes summed top to bottom, columns [first, last) of the table
+static inline void integralcolumns(const void* const restrict _context, const long long first, const long long last) {
+    const integral* const table  = ((const integralcontext*) _context)->_integral;
+    const long long       stride = table->_width + 1;
+
+    for (long long row = 2; row <= table->_height; ++row) {
+        blocksum* const restrict       sums  = table->_table + row * stride;
+        const blocksum* const restrict above = sums - stride;
+        for (long long col = first; col < last; ++col) {
+            sums[col]._blue  += above[col]._blue;
+            sums[col]._green += above[col]._green;
+            sums[col]._red   += above[col]._red;
+        }
+    }
+}
+
+// builds the table of a view, in two parallel passes, rows first and then bands of columns (see tpoolfor()), the pixels are unpacked
+// for cpal (NULL for the palette the converters are compiled with, see cpalpick()), the sums don't depend on it
+// returns false if the table could not be allocated (errors are reported to stderr), release it with integralfree()
+static inline bool integralbuild(
+    integral* const restrict     table,
+    const imview* const restrict view,
+    const cpalette* const        cpal,
+    threadpool* const            pool,
+    arena* const restrict        memory
+) {
+    *table = (integral) { ._table  = arenaalloc(memory, sizeof(blocksum) * (view->_width + 1) * (view->_height + 1)),
+                          ._width  = view->_width,
+                          ._height = view->_height,
+                          ._arena  = memory };
+    if (!table->_table) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    cpalette              fallback = { 0 };
+    const cpalette* const compiled = cpalpick(cpal, &fallback);
+    unpacker              unpack   = { 0 };
+    if (!unpackcompile(&unpack, view->_headers, view->_infoheader, compiled, memory)) {
+        arenafree(memory, table->_table);
+        table->_table = NULL;
+        return false;
+    }
+
+    memset(table->_table, 0U, sizeof(blocksum) * (view->_width + 1)); // the top row
+    const integralcontext context = { ._integral = table, ._view = view, ._unpack = &unpack };
+    tpoolfor(pool, view->_height, integralrows, &context);
+    tpoolfor(pool, view->_width + 1, integralcolumns, &context);
+    unpackfree(&unpack);
+    return true;
+}
+
+static inline void integralfree(integral* const table) {
+    arenafree(table->_arena, table->_table);
+    memset(table, 0U, sizeof(integral));
+}
+
+// the sums of the pixels in columns [left, right) of scanlines [top, bottom)
+static inline blocksum integralsum(
+    const integral* const restrict table, const long long left, const long long top, const long long right, const long long bottom
+) {
+    const long long       stride = table->_width + 1;
+    const blocksum* const upper  = table->_table + top * stride;
+    const blocksum* const lower  = table->_table + bottom * stride;
+    return (blocksum) { ._blue  = lower[right]._blue - lower[left]._blue - upper[right]._blue + upper[left]._blue,
+                        ._green = lower[right]._green - lower[left]._green - upper[right]._green + upper[left]._green,
+                        ._red   = lower[right]._red - lower[left]._red - upper[right]._red + upper[left]._red };
+}
+
+typedef struct {
+        const integral* _integral;
+        const cpalette* _cpal;
+        char*           _buffer;
+        long long       _columns;
+} integralrendercontext;
+
+// renders output rows [first, last), character c of row r covers columns [c * width / columns, (c + 1) * width / columns) and scanlines
+// [r * width / columns, (r + 1) * width / columns) of the image, blocks are (nearly) square, just as they are for to_downscaled_string()
+static inline void integralrender(const void* const restrict _context, const long long first, const long long last) {
+    const integralrendercontext* const context = _context;
+    const integral* const              table   = context->_integral;
+    const long long                    width   = table->_width;
+    const long long                    columns = context->_columns;
+    const cpalette* const              cpal    = context->_cpal; // used by blockmap()
+
+    for (long long row = first; row < last; ++row) {
+        const long long top    = row * width / columns;
+        const long long bottom = min((row + 1) * width / columns, table->_height);
+        // blocks are either floor(width / columns) or one pixel wider, so a row needs two reciprocals at most
+        const reciprocal narrow = rcpcompute((bottom - top) * (width / columns));
+        const reciprocal wide   = rcpcompute((bottom - top) * (width / columns + 1));
+        char* const      out    = context->_buffer + row * (columns + 1);
+
+        for (long long col = 0; col < columns; ++col) {
+            const long long left  = col * width / columns;
+            const long long right = (col + 1) * width / columns;
+            const blocksum  sum   = integralsum(table, left, top, right, bottom);
+            out[col]              = blockaverage(&sum, right - left == width / columns ? narrow : wide, cpal);
+        }
+        out[columns] = '\n';
+    }
+}
+
+// renders the image at the given number of characters per row (at most one per pixel), the number of rows follows from the aspect ratio
+// mapped with cpal, NULL for the palette the converters are compiled with (see cpalpick())
+static inline char* to_integral_string(
+    const integral* const restrict table,
+    long long                      columns,
+    const cpalette* const          cpal,
+    threadpool* const              pool,
+    arena* const restrict          memory
+) {
+    columns              = min(max(columns, 1LL), table->_width);
+    // the smallest number of rows whose blocks reach the bottom of the image
+    const long long rows = (table->_height * columns + table->_width - 1) / table->_width;
+
+    char* const buffer   = arenaalloc(memory, rows * (columns + 1) + 1); // LFs and a NULL terminator
+    if (!buffer) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        return NULL;
+    }
+
+    cpalette                    fallback = { 0 };
+    const integralrendercontext context  = {
+         ._integral = table, ._cpal = cpalpick(cpal, &fallback), ._buffer = buffer, ._columns = columns
+    };
+    tpoolfor(pool, rows, integralrender, &context);
+
+    buffer[rows * (columns + 1)] = 0;
+    return buffer;
+}
+
+// renders a bitmap at the given number of columns through a table built for the occasion, for one-off renders
+// a viewer that re-renders at every resize should keep the table around and call to_integral_string() instead
+static inline char* to_width_string(
+    const bitmap* const restrict image,
+    const long long              columns,
+    const cpalette* const        cpal,
+    threadpool* const            pool,
+    arena* const restrict        memory
+) {
+    if (!image->_pixels) return NULL; // bmpread failed and has already reported why
+    if (image->_infoheader.biCompression == RLE8 || image->_infoheader.biCompression == RLE4) {
+        fputs("Error in to_width_string, run length encoded bitmaps can only be rendered at the default width!\n", stderr);
+        return NULL;
+    }
+
+    const imview view  = bmpview(image);
+    integral     table = { 0 };
+    if (!integralbuild(&table, &view, cpal, pool, memory)) return NULL;
+    char* const string = to_integral_string(&table, columns, cpal, pool, memory);
+    integralfree(&table);
+    return string;
+}
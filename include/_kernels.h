@@ -0,0 +1,310 @@
+#pragma once
+
+// clang-format off
+#include <_cpalette.h>
+// clang-format on
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+#endif
+
+// scanline kernels map a contiguous run of RGBQUADs to characters using a compiled palette
+// the scalar kernel maps one pixel at a time, the vectorized kernels compute the offsets of 16 (SSE4.2) or 32 (AVX2 and AVX512) pixels
+// per iteration and only do the final offset to character lookup one pixel at a time
+// all kernels produce output identical to the scalar kernel, hence identical to the mappers
+// the vectorized kernels are compiled with target attributes, so the binary does not require anything beyond the baseline x86-64 ISA
+// the best kernel the host supports is picked once, at startup, using cpuid
+// 24 bit scanlines get kernels of their own (bgrline_*), which shuffle packed BGR triplets into RGBQUAD lanes inside the registers and
+// then share the offset computations with the RGBQUAD kernels, nothing is expanded to 32 bits in memory
+
+typedef void (*scanline_kernel)(
+    const RGBQUAD* const restrict pixels, const long long npixels, const cpalette* const restrict cpal, char* const restrict out
+);
+
+// same as scanline_kernel, but pixels points to npixels packed BGR triplets
+typedef void (*bgr_kernel)(
+    const unsigned char* const restrict pixels, const long long npixels, const cpalette* const restrict cpal, char* const restrict out
+);
+
+static inline void scanline_scalar(
+    const RGBQUAD* const restrict pixels, const long long npixels, const cpalette* const restrict cpal, char* const restrict out
+) {
+    for (long long i = 0; i < npixels; ++i) out[i] = cpalmap(cpal, pixels + i);
+}
+
+static inline void bgrline_scalar(
+    const unsigned char* const restrict pixels, const long long npixels, const cpalette* const restrict cpal, char* const restrict out
+) {
+    for (long long i = 0; i < npixels; ++i) out[i] = cpal->_chars[cpalbgroffset(cpal, pixels[3 * i], pixels[3 * i + 1], pixels[3 * i + 2])];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+    // the weighted offsets are computed as (blue * bscale + green * gscale) + red * rscale in double precision, with separate multiplies and adds
+    // fusing these into FMAs would change the rounding and break the bit for bit equivalence with the mappers, so contraction is disabled here
+    #pragma GCC push_options
+    #pragma GCC optimize("fp-contract=off")
+
+// maps 16 offsets (one byte each) to characters
+static inline void lookup16(const unsigned char* const restrict offsets, const cpalette* const restrict cpal, char* const restrict out) {
+    for (unsigned i = 0; i < 16; ++i) out[i] = cpal->_chars[offsets[i]];
+}
+
+// offsets of 4 pixels, returned as 4 32 bit lanes
+static __attribute__((target("sse4.2"))) inline __m128i offsets_sse42(const __m128i quads, const cpalette* const restrict cpal) {
+    const __m128i mask  = _mm_set1_epi32(0xFF);
+    const __m128i blue  = _mm_and_si128(quads, mask);
+    const __m128i green = _mm_and_si128(_mm_srli_epi32(quads, 8), mask);
+    const __m128i red   = _mm_and_si128(_mm_srli_epi32(quads, 16), mask);
+
+    switch (cpal->_kind) {
+        case ARITHMETIC : // x * 0xAAAB >> 17 is an exact division by 3 for every x in [0, 765]
+            return _mm_srli_epi32(_mm_mullo_epi32(_mm_add_epi32(_mm_add_epi32(blue, green), red), _mm_set1_epi32(0xAAAB)), 17);
+        case MINMAX :
+            return _mm_srli_epi32(
+                _mm_add_epi32(_mm_min_epi32(_mm_min_epi32(blue, green), red), _mm_max_epi32(_mm_max_epi32(blue, green), red)), 1
+            );
+        default /* WEIGHTED and LUMINOSITY */ : {
+            const __m128d bscale = _mm_set1_pd(cpal->_bscale), gscale = _mm_set1_pd(cpal->_gscale), rscale = _mm_set1_pd(cpal->_rscale);
+            // the lower two pixels
+            const __m128d lo     = _mm_add_pd(
+                _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(blue), bscale), _mm_mul_pd(_mm_cvtepi32_pd(green), gscale)),
+                _mm_mul_pd(_mm_cvtepi32_pd(red), rscale)
+            );
+            // the upper two pixels
+            const __m128d hi = _mm_add_pd(
+                _mm_add_pd(
+                    _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(blue, 0xEE)), bscale),
+                    _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(green, 0xEE)), gscale)
+                ),
+                _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(red, 0xEE)), rscale)
+            );
+            return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+        }
+    }
+}
+
+static __attribute__((target("sse4.2"))) void scanline_sse42(
+    const RGBQUAD* const restrict pixels, const long long npixels, const cpalette* const restrict cpal, char* const restrict out
+) {
+    unsigned char offsets[16] = { 0 };
+    long long     i           = 0;
+
+    for (; i + 16 <= npixels; i += 16) {
+        const __m128i o0 = offsets_sse42(_mm_loadu_si128((const __m128i*) (pixels + i)), cpal);
+        const __m128i o1 = offsets_sse42(_mm_loadu_si128((const __m128i*) (pixels + i + 4)), cpal);
+        const __m128i o2 = offsets_sse42(_mm_loadu_si128((const __m128i*) (pixels + i + 8)), cpal);
+        const __m128i o3 = offsets_sse42(_mm_loadu_si128((const __m128i*) (pixels + i + 12)), cpal);
+        // offsets are all in [0, 255], so the saturating packs are just narrowing conversions
+        _mm_storeu_si128((__m128i*) offsets, _mm_packus_epi16(_mm_packus_epi32(o0, o1), _mm_packus_epi32(o2, o3)));
+        lookup16(offsets, cpal, out + i);
+    }
+
+    scanline_scalar(pixels + i, npixels - i, cpal, out + i); // the leftovers
+}
+
+// spreads 4 packed BGR triplets (the lower 12 bytes of a register) into 4 RGBQUAD lanes, the reserved bytes are zeroed
+    #define BGR_EXPAND_SHUFFLE 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1
+
+static __attribute__((target("sse4.2"))) void bgrline_sse42(
+    const unsigned char* const restrict pixels, const long long npixels, const cpalette* const restrict cpal, char* const restrict out
+) {
+    const __m128i expand      = _mm_setr_epi8(BGR_EXPAND_SHUFFLE);
+    unsigned char offsets[16] = { 0 };
+    long long     i           = 0;
+
+    // each load is 16 bytes wide but only 12 bytes of it are used, so the last load of an iteration reads 4 bytes past its 16th pixel,
+    // the 2 pixels of slack keep it inside the scanline
+    for (; i + 18 <= npixels; i += 16) {
+        const unsigned char* const triplets = pixels + 3 * i;
+        const __m128i o0 = offsets_sse42(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) triplets), expand), cpal);
+        const __m128i o1 = offsets_sse42(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (triplets + 12)), expand), cpal);
+        const __m128i o2 = offsets_sse42(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (triplets + 24)), expand), cpal);
+        const __m128i o3 = offsets_sse42(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (triplets + 36)), expand), cpal);
+        _mm_storeu_si128((__m128i*) offsets, _mm_packus_epi16(_mm_packus_epi32(o0, o1), _mm_packus_epi32(o2, o3)));
+        lookup16(offsets, cpal, out + i);
+    }
+
+    bgrline_scalar(pixels + 3 * i, npixels - i, cpal, out + i);
+}
+
+// offsets of 8 pixels, returned as 8 32 bit lanes
+static __attribute__((target("avx2"))) inline __m256i offsets_avx2(const __m256i quads, const cpalette* const restrict cpal) {
+    const __m256i mask  = _mm256_set1_epi32(0xFF);
+    const __m256i blue  = _mm256_and_si256(quads, mask);
+    const __m256i green = _mm256_and_si256(_mm256_srli_epi32(quads, 8), mask);
+    const __m256i red   = _mm256_and_si256(_mm256_srli_epi32(quads, 16), mask);
+
+    switch (cpal->_kind) {
+        case ARITHMETIC :
+            return _mm256_srli_epi32(
+                _mm256_mullo_epi32(_mm256_add_epi32(_mm256_add_epi32(blue, green), red), _mm256_set1_epi32(0xAAAB)), 17
+            );
+        case MINMAX :
+            return _mm256_srli_epi32(
+                _mm256_add_epi32(
+                    _mm256_min_epi32(_mm256_min_epi32(blue, green), red), _mm256_max_epi32(_mm256_max_epi32(blue, green), red)
+                ),
+                1
+            );
+        default /* WEIGHTED and LUMINOSITY */ : {
+            const __m256d bscale = _mm256_set1_pd(cpal->_bscale), gscale = _mm256_set1_pd(cpal->_gscale),
+                          rscale = _mm256_set1_pd(cpal->_rscale);
+            const __m256d lo     = _mm256_add_pd(
+                _mm256_add_pd(
+                    _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(blue)), bscale),
+                    _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(green)), gscale)
+                ),
+                _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(red)), rscale)
+            );
+            const __m256d hi = _mm256_add_pd(
+                _mm256_add_pd(
+                    _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(blue, 1)), bscale),
+                    _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(green, 1)), gscale)
+                ),
+                _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(red, 1)), rscale)
+            );
+            return _mm256_set_m128i(_mm256_cvttpd_epi32(hi), _mm256_cvttpd_epi32(lo));
+        }
+    }
+}
+
+static __attribute__((target("avx2"))) void scanline_avx2(
+    const RGBQUAD* const restrict pixels, const long long npixels, const cpalette* const restrict cpal, char* const restrict out
+) {
+    unsigned char offsets[32] = { 0 };
+    long long     i           = 0;
+
+    for (; i + 32 <= npixels; i += 32) {
+        const __m256i o0 = offsets_avx2(_mm256_loadu_si256((const __m256i*) (pixels + i)), cpal);
+        const __m256i o1 = offsets_avx2(_mm256_loadu_si256((const __m256i*) (pixels + i + 8)), cpal);
+        const __m256i o2 = offsets_avx2(_mm256_loadu_si256((const __m256i*) (pixels + i + 16)), cpal);
+        const __m256i o3 = offsets_avx2(_mm256_loadu_si256((const __m256i*) (pixels + i + 24)), cpal);
+        // AVX2 packs work within 128 bit lanes, so the packed bytes come out as 4 byte groups in the order 0 2 4 6 1 3 5 7
+        // (groups of 4 pixels), a cross lane permute puts them back in pixel order
+        const __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(o0, o1), _mm256_packus_epi32(o2, o3));
+        _mm256_storeu_si256((__m256i*) offsets, _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)));
+        lookup16(offsets, cpal, out + i);
+        lookup16(offsets + 16, cpal, out + i + 16);
+    }
+
+    scanline_scalar(pixels + i, npixels - i, cpal, out + i);
+}
+
+// 8 packed BGR triplets as 8 RGBQUAD lanes, the lower and upper 4 triplets go to separate 128 bit lanes since vpshufb can't cross lanes
+static __attribute__((target("avx2"))) inline __m256i bgrexpand_avx2(const unsigned char* const restrict triplets) {
+    const __m256i expand = _mm256_setr_epi8(BGR_EXPAND_SHUFFLE, BGR_EXPAND_SHUFFLE);
+    return _mm256_shuffle_epi8(
+        _mm256_set_m128i(_mm_loadu_si128((const __m128i*) (triplets + 12)), _mm_loadu_si128((const __m128i*) triplets)), expand
+    );
+}
+
+static __attribute__((target("avx2"))) void bgrline_avx2(
+    const unsigned char* const restrict pixels, const long long npixels, const cpalette* const restrict cpal, char* const restrict out
+) {
+    unsigned char offsets[32] = { 0 };
+    long long     i           = 0;
+
+    for (; i + 34 <= npixels; i += 32) { // 2 pixels of slack for the overreaching last load, like bgrline_sse42
+        const unsigned char* const triplets = pixels + 3 * i;
+        const __m256i              o0       = offsets_avx2(bgrexpand_avx2(triplets), cpal);
+        const __m256i              o1       = offsets_avx2(bgrexpand_avx2(triplets + 24), cpal);
+        const __m256i              o2       = offsets_avx2(bgrexpand_avx2(triplets + 48), cpal);
+        const __m256i              o3       = offsets_avx2(bgrexpand_avx2(triplets + 72), cpal);
+        const __m256i              packed   = _mm256_packus_epi16(_mm256_packus_epi32(o0, o1), _mm256_packus_epi32(o2, o3));
+        _mm256_storeu_si256((__m256i*) offsets, _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)));
+        lookup16(offsets, cpal, out + i);
+        lookup16(offsets + 16, cpal, out + i + 16);
+    }
+
+    bgrline_scalar(pixels + 3 * i, npixels - i, cpal, out + i);
+}
+
+// offsets of 16 pixels, returned as 16 bytes
+static __attribute__((target("avx512f"))) inline __m128i offsets_avx512(const __m512i quads, const cpalette* const restrict cpal) {
+    const __m512i mask  = _mm512_set1_epi32(0xFF);
+    const __m512i blue  = _mm512_and_si512(quads, mask);
+    const __m512i green = _mm512_and_si512(_mm512_srli_epi32(quads, 8), mask);
+    const __m512i red   = _mm512_and_si512(_mm512_srli_epi32(quads, 16), mask);
+    __m512i       offsets;
+
+    switch (cpal->_kind) {
+        case ARITHMETIC :
+            offsets = _mm512_srli_epi32(
+                _mm512_mullo_epi32(_mm512_add_epi32(_mm512_add_epi32(blue, green), red), _mm512_set1_epi32(0xAAAB)), 17
+            );
+            break;
+        case MINMAX :
+            offsets = _mm512_srli_epi32(
+                _mm512_add_epi32(
+                    _mm512_min_epi32(_mm512_min_epi32(blue, green), red), _mm512_max_epi32(_mm512_max_epi32(blue, green), red)
+                ),
+                1
+            );
+            break;
+        default /* WEIGHTED and LUMINOSITY */ : {
+            const __m512d bscale = _mm512_set1_pd(cpal->_bscale), gscale = _mm512_set1_pd(cpal->_gscale),
+                          rscale = _mm512_set1_pd(cpal->_rscale);
+            const __m512d lo     = _mm512_add_pd(
+                _mm512_add_pd(
+                    _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256(blue)), bscale),
+                    _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256(green)), gscale)
+                ),
+                _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256(red)), rscale)
+            );
+            const __m512d hi = _mm512_add_pd(
+                _mm512_add_pd(
+                    _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(blue, 1)), bscale),
+                    _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(green, 1)), gscale)
+                ),
+                _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(red, 1)), rscale)
+            );
+            offsets = _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvttpd_epi32(lo)), _mm512_cvttpd_epi32(hi), 1);
+            break;
+        }
+    }
+
+    return _mm512_cvtepi32_epi8(offsets); // truncating narrowing, offsets are all in [0, 255]
+}
+
+static __attribute__((target("avx512f"))) void scanline_avx512(
+    const RGBQUAD* const restrict pixels, const long long npixels, const cpalette* const restrict cpal, char* const restrict out
+) {
+    unsigned char offsets[32] = { 0 };
+    long long     i           = 0;
+
+    for (; i + 32 <= npixels; i += 32) {
+        _mm_storeu_si128((__m128i*) offsets, offsets_avx512(_mm512_loadu_si512(pixels + i), cpal));
+        _mm_storeu_si128((__m128i*) (offsets + 16), offsets_avx512(_mm512_loadu_si512(pixels + i + 16), cpal));
+        lookup16(offsets, cpal, out + i);
+        lookup16(offsets + 16, cpal, out + i + 16);
+    }
+
+    scanline_scalar(pixels + i, npixels - i, cpal, out + i);
+}
+
+    #pragma GCC pop_options
+
+#endif // defined(__x86_64__) || defined(__i386__)
+
+static scanline_kernel scanline = scanline_scalar; // the kernel the converters use, resolved at startup by pickkernel()
+static bgr_kernel      bgrline  = bgrline_scalar;  // the 24 bit counterpart, AVX512 hosts use the AVX2 one
+
+// probes the host with cpuid and picks the widest kernel it can run
+static __attribute__((constructor)) void pickkernel(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init(); // required before __builtin_cpu_supports when running before main, i.e in a constructor
+    if (__builtin_cpu_supports("avx512f"))
+        scanline = scanline_avx512;
+    else if (__builtin_cpu_supports("avx2"))
+        scanline = scanline_avx2;
+    else if (__builtin_cpu_supports("sse4.2"))
+        scanline = scanline_sse42;
+
+    if (__builtin_cpu_supports("avx2"))
+        bgrline = bgrline_avx2;
+    else if (__builtin_cpu_supports("sse4.2"))
+        bgrline = bgrline_sse42;
+#endif
+    __printf_debug("Scanline kernel :: %s\n", scanline == scanline_scalar ? "scalar" : "vectorized");
+}
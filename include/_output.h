@@ -0,0 +1,108 @@
+#pragma once
+
+// clang-format off
+#include <_utils.h>
+#include <sys/uio.h>
+// clang-format on
+
+// the output layer, the converted images go to stdout as the bytes they already are, with one system call per image
+// an image (all of its widths with -w) is handed to writev() in one go, each string followed by OUTPUT_SEPARATOR, no wide character
+// conversions and no trips through the buffers of stdio
+// writev() copies the bytes into the file (or the pipe) before it returns, so the memory of an image can be reused as soon as
+// outputstrings() does. vmsplice() would save that copy, but a pipe keeps referring to the spliced pages until the reader is done with
+// them, and a reader that splices or tees them onward holds on to them past the point the pipe says it has drained
+// with batching, images are coalesced into a large buffer owned by the output and written out one buffer at a time
+
+#define OUTPUT_SEPARATOR  "\n\n\n\n"   // WHAT _putws(string); _putws(L"\n\n"); USED TO PRINT AFTER AN IMAGE, THE STRINGS END IN A LF
+#define OUTPUT_BATCHBYTES (4LL << 20) // SIZE OF THE BUFFER BATCH MODE COALESCES IMAGES IN
+#define OUTPUT_MAXSTRINGS 64LL        // STRINGS outputstrings() TAKES AT ONCE
+
+typedef struct {
+        int       _fdesc;
+        char*     _batch;    // the buffer images are coalesced in, NULL when every image is written on its own
+        long long _capacity; // of the buffer
+        long long _length;   // bytes in the buffer
+} output;
+
+// opens an output on fdesc, coalescing images in a buffer of batchbytes bytes, 0 writes every image on its own
+// returns false if the buffer could not be allocated (errors are reported to stderr), close the output with outputclose()
+static inline bool outputopen(output* const restrict out, const int fdesc, const long long batchbytes) {
+    *out = (output) { ._fdesc = fdesc, ._capacity = batchbytes };
+    if (!batchbytes) return true;
+
+    if (!(out->_batch = malloc(batchbytes))) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        *out = (output) { ._fdesc = -1 };
+        return false;
+    }
+    return true;
+}
+
+// hands the nvectors iovecs to the file, all the way, the iovecs are advanced past what was written as it goes
+// returns false when the bytes couldn't be written in full
+static inline bool outputvectors(output* const restrict out, struct iovec* restrict vectors, int nvectors) {
+    while (nvectors) {
+        const ssize_t nwritten = writev(out->_fdesc, vectors, nvectors);
+        if (nwritten == -1 && errno == EINTR) continue;
+        if (nwritten <= 0) return false;
+
+        size_t left = nwritten;
+        for (; nvectors && left >= vectors->iov_len; ++vectors, --nvectors) left -= vectors->iov_len; // skips the empty strings as well
+        if (nvectors) {
+            vectors->iov_base  = (char*) vectors->iov_base + left;
+            vectors->iov_len  -= left;
+        }
+    }
+    return true;
+}
+
+// writes out the buffer, which can be filled again right away
+static inline bool outputflush(output* const restrict out) {
+    if (!out->_length) return true;
+    struct iovec vector = { .iov_base = out->_batch, .iov_len = out->_length };
+    out->_length        = 0;
+    return outputvectors(out, &vector, 1);
+}
+
+// writes the nvectors iovecs, nbytes bytes in all, coalesced into the buffer when batching and straight from the caller's memory
+// otherwise (or when they don't fit in the buffer). returns false when the bytes couldn't be written in full
+static inline bool outputcoalesce(
+    output* const restrict out, struct iovec* const restrict vectors, const int nvectors, const long long nbytes
+) {
+    if (!out->_capacity) return outputvectors(out, vectors, nvectors);
+    if (out->_length + nbytes > out->_capacity && !outputflush(out)) return false;
+    if (nbytes > out->_capacity) return outputvectors(out, vectors, nvectors); // too big to coalesce
+
+    for (int i = 0; i < nvectors; ++i) {
+        memcpy(out->_batch + out->_length, vectors[i].iov_base, vectors[i].iov_len);
+        out->_length += vectors[i].iov_len;
+    }
+    return true;
+}
+
+// writes the nstrings strings of an image, each followed by OUTPUT_SEPARATOR, see outputcoalesce()
+static inline bool outputstrings(output* const restrict out, const char* const* const restrict strings, const long long nstrings) {
+    assert(nstrings <= OUTPUT_MAXSTRINGS);
+    struct iovec vectors[2 * OUTPUT_MAXSTRINGS] = { 0 };
+    long long    nbytes                         = 0;
+    for (long long i = 0; i < nstrings; ++i) {
+        vectors[2 * i]     = (struct iovec) { .iov_base = (void*) strings[i], .iov_len = strlen(strings[i]) };
+        vectors[2 * i + 1] = (struct iovec) { .iov_base = OUTPUT_SEPARATOR, .iov_len = sizeof(OUTPUT_SEPARATOR) - 1 };
+        nbytes            += vectors[2 * i].iov_len + vectors[2 * i + 1].iov_len;
+    }
+    return outputcoalesce(out, vectors, 2 * nstrings, nbytes);
+}
+
+// writes nbytes bytes as they are, without a separator, for output that places itself on the screen (see <_sequence.h>)
+static inline bool outputbytes(output* const restrict out, const char* const restrict bytes, const long long nbytes) {
+    struct iovec vector = { .iov_base = (void*) bytes, .iov_len = nbytes };
+    return outputcoalesce(out, &vector, 1, nbytes);
+}
+
+// flushes what's left and releases the buffer. returns false when the last of the bytes couldn't be written
+static inline bool outputclose(output* const restrict out) {
+    const bool done = outputflush(out);
+    free(out->_batch);
+    *out = (output) { ._fdesc = -1 };
+    return done;
+}
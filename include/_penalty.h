@@ -7,12 +7,12 @@
 // this would reduce the influence blue pixels have on the mapped character
 // PREREQUISITES  all the scale factors must be within the range of 0 and 1 and the sum of all three of them should never go above 1.000
 // POTENTIAL HAZARD  access violations may happen when the above requisites are not met!
-static inline wchar_t tunable_mapper(
+static inline char tunable_mapper(
     const RGBQUAD* const restrict pixel,
     const float bscale, // scaling factor for blue
     const float gscale, // scaling factor for green
     const float rscale, // scaling factor for red
-    const wchar_t* const restrict palette,
+    const char* const restrict palette,
     const unsigned plength
 ) {
     assert(bscale >= 0.000);
@@ -25,10 +25,11 @@ static inline wchar_t tunable_mapper(
 }
 
 // CAUTION  THE PENALIZING GROUP OF MAPPERS CAN AFFECT THE PERFORMANCE SUBSTANTIALLY
+// compile the limits into a cpenalty (see <_cpenalty.h>) to map whole scanlines with them, with the very same results a few times faster
 // will penalize the offset by the penalty term when the pixel satisfies the criteria
 // PREREQUISITES  penalty must be a float in between [0.0, 1.0] (an inclusive range)
 // if you don't want a certain colour to be considered for penalization, specify both limits for that colour as UCHAR_MAX (or any identical values)
-static __attribute__((always_inline)) wchar_t penalizing_arithmeticmapper(
+static inline __attribute__((always_inline)) char penalizing_arithmeticmapper(
     const RGBQUAD* const restrict pixel,
     const unsigned char bllim, // lower limit for blue pixels
     const unsigned char bulim, // upper limit for blue pixels
@@ -36,7 +37,7 @@ static __attribute__((always_inline)) wchar_t penalizing_arithmeticmapper(
     const unsigned char gulim,
     const unsigned char rllim,
     const unsigned char rulim,
-    const wchar_t* const restrict palette,
+    const char* const restrict palette,
     const unsigned plength,
     const float    penalty
 ) {
@@ -54,7 +55,7 @@ static __attribute__((always_inline)) wchar_t penalizing_arithmeticmapper(
     return palette[offset ? nudge(offset / (float) (UCHAR_MAX) *plength) - 1 : 0];
 }
 
-static __attribute__((always_inline)) wchar_t penalizing_weightedmapper(
+static inline __attribute__((always_inline)) char penalizing_weightedmapper(
     const RGBQUAD* const restrict pixel,
     const unsigned char bllim,
     const unsigned char bulim,
@@ -62,7 +63,7 @@ static __attribute__((always_inline)) wchar_t penalizing_weightedmapper(
     const unsigned char gulim,
     const unsigned char rllim,
     const unsigned char rulim,
-    const wchar_t* const restrict palette,
+    const char* const restrict palette,
     const unsigned plength,
     const float    penalty
 ) {
@@ -76,7 +77,7 @@ static __attribute__((always_inline)) wchar_t penalizing_weightedmapper(
     return palette[offset ? nudge(offset / (float) (UCHAR_MAX) *plength) - 1 : 0];
 }
 
-static __attribute__((always_inline)) wchar_t penalizing_minmaxmapper(
+static inline __attribute__((always_inline)) char penalizing_minmaxmapper(
     const RGBQUAD* const restrict pixel,
     const unsigned char bllim,
     const unsigned char bulim,
@@ -84,7 +85,7 @@ static __attribute__((always_inline)) wchar_t penalizing_minmaxmapper(
     const unsigned char gulim,
     const unsigned char rllim,
     const unsigned char rulim,
-    const wchar_t* const restrict palette,
+    const char* const restrict palette,
     const unsigned plength,
     const float    penalty
 ) {
@@ -93,13 +94,13 @@ static __attribute__((always_inline)) wchar_t penalizing_minmaxmapper(
                              ((gllim != gulim) && (pixel->rgbGreen >= gllim) && (pixel->rgbGreen <= gulim)) ||
                              ((rllim != rulim) && (pixel->rgbRed >= rllim) && (pixel->rgbRed <= rulim))) != 0;
 
-    const unsigned offset = (((float) (min(min(pixel->rgbBlue = 0, pixel->rgbGreen), pixel->rgbRed))) +
-                             (fmax(fmax(pixel->rgbBlue, pixel->rgbGreen), pixel->rgbRed)) / 2.0000) *
+    const unsigned offset = (((float) (min(min(pixel->rgbBlue, pixel->rgbGreen), pixel->rgbRed))) +
+                             (fmax(fmax(pixel->rgbBlue, pixel->rgbGreen), pixel->rgbRed))) / 2.0000 *
                             (penalize ? (ONE - penalty) : 1);
     return palette[offset ? nudge(offset / (float) (UCHAR_MAX) *plength) - 1 : 0];
 }
 
-static __attribute__((always_inline)) wchar_t penalizing_luminositymapper(
+static inline __attribute__((always_inline)) char penalizing_luminositymapper(
     const RGBQUAD* const restrict pixel,
     const unsigned char bllim,
     const unsigned char bulim,
@@ -107,7 +108,7 @@ static __attribute__((always_inline)) wchar_t penalizing_luminositymapper(
     const unsigned char gulim,
     const unsigned char rllim,
     const unsigned char rulim,
-    const wchar_t* const restrict palette,
+    const char* const restrict palette,
     const unsigned plength,
     const float    penalty
 ) {
@@ -121,27 +122,26 @@ static __attribute__((always_inline)) wchar_t penalizing_luminositymapper(
     return palette[offset ? nudge(offset / (float) (UCHAR_MAX) *plength) - 1 : 0];
 }
 
-static inline wchar_t tunable_blockmapper(
+static inline char tunable_blockmapper(
     const float rgbBlue,
     const float bscale,
     const float rgbGreen,
     const float gscale,
     const float rgbRed,
     const float rscale,
-    const wchar_t* const restrict palette,
+    const char* const restrict palette,
     const unsigned plength
 ) {
     assert(bscale >= 0.000);
     assert(gscale >= 0.000);
     assert(rscale >= 0.000);
-    if ((bscale + gscale + rscale) > ONE) wprintf_s(L"%.10lf\n", bscale + gscale + rscale);
     assert((bscale + gscale + rscale) <= ONE);
 
     const unsigned offset = rgbBlue * bscale + rgbGreen * gscale + rgbRed * rscale;
     return palette[offset ? nudge(offset / (float) (UCHAR_MAX) *plength) - 1 : 0];
 }
 
-static __attribute__((always_inline)) wchar_t penalizing_arithmeticblockmapper(
+static inline __attribute__((always_inline)) char penalizing_arithmeticblockmapper(
     const float rgbBlue,
     const float rgbGreen,
     const float rgbRed,
@@ -151,7 +151,7 @@ static __attribute__((always_inline)) wchar_t penalizing_arithmeticblockmapper(
     const float gulim,
     const float rllim,
     const float rulim,
-    const wchar_t* const restrict palette,
+    const char* const restrict palette,
     const unsigned plength,
     const float    penalty
 ) {
@@ -169,7 +169,7 @@ static __attribute__((always_inline)) wchar_t penalizing_arithmeticblockmapper(
     return palette[offset ? nudge(offset / (float) (UCHAR_MAX) *plength) - 1 : 0];
 }
 
-static __attribute__((always_inline)) wchar_t penalizing_weightedblockmapper(
+static inline __attribute__((always_inline)) char penalizing_weightedblockmapper(
     const float rgbBlue,
     const float rgbGreen,
     const float rgbRed,
@@ -179,7 +179,7 @@ static __attribute__((always_inline)) wchar_t penalizing_weightedblockmapper(
     const float gulim,
     const float rllim,
     const float rulim,
-    const wchar_t* const restrict palette,
+    const char* const restrict palette,
     const unsigned plength,
     const float    penalty
 ) {
@@ -192,7 +192,7 @@ static __attribute__((always_inline)) wchar_t penalizing_weightedblockmapper(
     return palette[offset ? nudge(offset / (float) (UCHAR_MAX) *plength) - 1 : 0];
 }
 
-static __attribute__((always_inline)) wchar_t penalizing_minmaxblockmapper(
+static inline __attribute__((always_inline)) char penalizing_minmaxblockmapper(
     const float rgbBlue,
     const float rgbGreen,
     const float rgbRed,
@@ -202,7 +202,7 @@ static __attribute__((always_inline)) wchar_t penalizing_minmaxblockmapper(
     const float gulim,
     const float rllim,
     const float rulim,
-    const wchar_t* const restrict palette,
+    const char* const restrict palette,
     const unsigned plength,
     const float    penalty
 ) {
@@ -212,11 +212,11 @@ static __attribute__((always_inline)) wchar_t penalizing_minmaxblockmapper(
                            ((rllim != rulim) && (rgbRed >= rllim) && (rgbRed <= rulim))) != 0;
 
     const unsigned offset =
-        ((min(min(rgbBlue = 0, rgbGreen), rgbRed) + max(max(rgbBlue, rgbGreen), rgbRed)) / 2.0000) * (penalize ? (ONE - penalty) : 1);
+        ((min(min(rgbBlue, rgbGreen), rgbRed) + max(max(rgbBlue, rgbGreen), rgbRed)) / 2.0000) * (penalize ? (ONE - penalty) : 1);
     return palette[offset ? nudge(offset / (float) (UCHAR_MAX) *plength) - 1 : 0];
 }
 
-static __attribute__((always_inline)) wchar_t penalizing_luminosityblockmapper(
+static inline __attribute__((always_inline)) char penalizing_luminosityblockmapper(
     const float rgbBlue,
     const float rgbGreen,
     const float rgbRed,
@@ -226,7 +226,7 @@ static __attribute__((always_inline)) wchar_t penalizing_luminosityblockmapper(
     const float gulim,
     const float rllim,
     const float rulim,
-    const wchar_t* const restrict palette,
+    const char* const restrict palette,
     const unsigned plength,
     const float    penalty
 ) {
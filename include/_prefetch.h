@@ -0,0 +1,108 @@
+#pragma once
+
+// clang-format off
+#include <_utils.h>
+#include <pthread.h>
+#include <string.h>
+// clang-format on
+
+// read-ahead of whole input files, for runs over many images
+// left alone, every image stalls in open(), fstat() and then in page faults (or read()s) until its pixels arrive, while the CPU idles, and
+// the disk idles while the image converts. on cold caches and network file systems those stalls dominate the whole run
+// a prefetcher is a single background thread that walks the paths ahead of the consumer, opening each file and reading it into the page
+// cache, so that by the time bmpread() or to_streamed_string() gets to it, the metadata is cached and its pages are resident
+// it stays at most depth files ahead of the consumer (see prefetchadvance()), so it never evicts the files that are about to be used
+// with ones that are needed much later. the prefetcher is purely an optimization and never reports errors, the consumer does that when it
+// gets to the file. blocking reads on a thread of its own take the place of an io_uring submission queue, which would need liburing
+
+#define PREFETCH_CHUNK    (1LL << 20)  // BYTES PER pread() CALL
+#define PREFETCH_MAXBYTES (256LL << 20) // FILES LARGER THAN THIS ARE ONLY PARTLY READ AHEAD, THE KERNEL IS ASKED FOR THE REST
+
+typedef struct {
+        pthread_t          _thread;
+        pthread_mutex_t    _lock;
+        pthread_cond_t     _wakeup;    // signalled when the consumer moves on or when the prefetcher is stopped
+        const char* const* _paths;
+        long long          _npaths;
+        long long          _nconsumed; // number of paths the consumer has started on, the next _depth are prefetched
+        unsigned           _depth;
+        bool               _shutdown;
+} prefetcher;
+
+// brings the file at path into the page cache, the first PREFETCH_MAXBYTES bytes are read (into scratch, a PREFETCH_CHUNK byte buffer)
+// and the kernel is asked to read the rest asynchronously, so even a file system that ignores the hint gets the start of the file read
+static inline void prefetchfile(const char* const restrict path, unsigned char* const restrict scratch) {
+    struct stat filestat = {};
+    const int   fdesc    = open(path, O_RDONLY);
+    if (fdesc == -1) return;
+
+    if (!fstat(fdesc, &filestat) && S_ISREG(filestat.st_mode)) {
+        posix_fadvise(fdesc, 0, 0, POSIX_FADV_WILLNEED);
+        const long long nbytes = scratch ? min((long long) filestat.st_size, PREFETCH_MAXBYTES) : 0;
+        for (long long offset = 0; offset < nbytes;) {
+            const ssize_t nread = pread(fdesc, scratch, min(PREFETCH_CHUNK, nbytes - offset), offset);
+            if (nread == -1 && errno == EINTR) continue;
+            if (nread <= 0) break;
+            offset += nread;
+        }
+    }
+    close(fdesc);
+}
+
+static inline void* prefetchworker(void* const _prefetch) {
+    prefetcher* const    prefetch = _prefetch;
+    unsigned char* const scratch  = malloc(PREFETCH_CHUNK); // without it, only the asynchronous hints are issued
+
+    for (long long next = 0; next < prefetch->_npaths; ++next) {
+        pthread_mutex_lock(&prefetch->_lock);
+        while (!prefetch->_shutdown && next >= prefetch->_nconsumed + prefetch->_depth)
+            pthread_cond_wait(&prefetch->_wakeup, &prefetch->_lock);
+        const bool shutdown = prefetch->_shutdown;
+        next                = max(next, prefetch->_nconsumed); // the consumer got there first, no point in reading those
+        pthread_mutex_unlock(&prefetch->_lock);
+
+        if (shutdown) break;
+        if (next < prefetch->_npaths) prefetchfile(prefetch->_paths[next], scratch);
+    }
+
+    free(scratch);
+    return NULL;
+}
+
+// starts prefetching the first depth of the npaths paths, the paths must stay valid until prefetchstop()
+// returns false if the thread could not be started (errors are reported to stderr), the consumer can carry on without it
+static inline bool prefetchstart(prefetcher* const prefetch, const char* const* const paths, const long long npaths, const unsigned depth) {
+    *prefetch = (prefetcher) { ._paths = paths, ._npaths = npaths, ._nconsumed = 0, ._depth = depth, ._shutdown = false };
+    pthread_mutex_init(&prefetch->_lock, NULL);
+    pthread_cond_init(&prefetch->_wakeup, NULL);
+
+    if (pthread_create(&prefetch->_thread, NULL, prefetchworker, prefetch)) {
+        fprintf(stderr, "Error in %s @ line %d: pthread_create failed, continuing without read-ahead\n", __FUNCTION__, __LINE__);
+        pthread_mutex_destroy(&prefetch->_lock);
+        pthread_cond_destroy(&prefetch->_wakeup);
+        return false;
+    }
+    return true;
+}
+
+// lets the prefetcher know the consumer has started on the first nconsumed paths, a NULL prefetcher is ignored
+static inline void prefetchadvance(prefetcher* const prefetch, const long long nconsumed) {
+    if (!prefetch) return;
+    pthread_mutex_lock(&prefetch->_lock);
+    prefetch->_nconsumed = max(prefetch->_nconsumed, nconsumed);
+    pthread_cond_signal(&prefetch->_wakeup);
+    pthread_mutex_unlock(&prefetch->_lock);
+}
+
+// stops the prefetcher, once the file it is reading (if any) is done, and joins it
+static inline void prefetchstop(prefetcher* const prefetch) {
+    pthread_mutex_lock(&prefetch->_lock);
+    prefetch->_shutdown = true;
+    pthread_cond_signal(&prefetch->_wakeup);
+    pthread_mutex_unlock(&prefetch->_lock);
+
+    pthread_join(prefetch->_thread, NULL);
+    pthread_mutex_destroy(&prefetch->_lock);
+    pthread_cond_destroy(&prefetch->_wakeup);
+    memset(prefetch, 0U, sizeof(prefetcher));
+}
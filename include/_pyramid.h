@@ -0,0 +1,225 @@
+#pragma once
+
+// clang-format off
+#include <_tostring.h>
+// clang-format on
+
+// renders one image at several widths in a single pass over its pixels, for publishing the same image at e.g 80, 140, 240 and 400 columns
+// without reading and scanning it once per width. every width is a level of the pyramid, and its blocks are laid out exactly the way
+// to_integral_string() lays them out (see <_integral.h>), so each level is identical to a render at that width on its own
+// power of two mip levels won't do here, the block edges of arbitrary widths don't line up with them. instead, every scanline is unpacked
+// once into its row prefixes (the sums of the pixels left of every column), after which the share of a scanline in any block is a single
+// subtraction, so a level costs a constant amount of work per block per scanline on top of the one pass over the pixels
+// unlike a summed-area table, only a scanline of prefixes and a block row of sums per level are ever alive
+// the scanlines are split into one band per worker, a band owns the block rows of every level that start inside it and reads on past its
+// end to finish them, so the scanlines straddling two bands (at most a block row of the tallest level) are the only ones unpacked twice
+
+#define PYRAMID_MAXLEVELS 16LL // MOST WIDTHS A SINGLE PASS CAN RENDER
+
+typedef struct {
+        long long  _columns;
+        long long  _rows;
+        long long* _edges;  // the first column of the image in every block column, and the width of the image, _columns + 1 of them
+        char*      _buffer; // _rows x (_columns + 1) characters (LFs included) followed by a NULL terminator
+} pyramidlevel;
+
+typedef struct {
+        const imview*       _view;
+        const cpalette*     _cpal;
+        const unpacker*     _unpack;
+        const pyramidlevel* _levels;
+        long long           _nlevels;
+        long long           _nbands;
+        long long           _ncolumns; // the columns of all the levels, added up
+        blocksum*           _prefixes; // a scanline of row prefixes (width + 1 of them, the first is always 0) per band
+        blocksum*           _sums;     // the sums of the block row being reduced, for every level, per band
+} pyramidcontext;
+
+// the first scanline of block row brow of a level, the same as in integralrender()
+static inline long long pyramidtop(const imview* const restrict view, const pyramidlevel* const restrict level, const long long brow) {
+    return min(brow * view->_width / level->_columns, view->_height);
+}
+
+// maps a complete block row of a level and resets its sums for the next one
+static inline void pyramidflush(
+    const pyramidlevel* const restrict level,
+    const long long                    brow,
+    const long long                    nscanlines,
+    const long long                    width,
+    const cpalette* const restrict     cpal,
+    blocksum* const restrict           sums
+) {
+    // blocks are either floor(width / columns) or one pixel wider, so a row needs two reciprocals at most
+    const reciprocal narrow = rcpcompute(nscanlines * (width / level->_columns));
+    const reciprocal wide   = rcpcompute(nscanlines * (width / level->_columns + 1));
+    char* const      out    = level->_buffer + brow * (level->_columns + 1);
+
+    for (long long col = 0; col < level->_columns; ++col) {
+        out[col]  = blockaverage(sums + col, level->_edges[col + 1] - level->_edges[col] == width / level->_columns ? narrow : wide, cpal);
+        sums[col] = (blocksum) { 0, 0, 0 };
+    }
+    out[level->_columns] = '\n';
+}
+
+// reduces bands [first, last) of scanlines, for every level at once
+static inline void pyramidbands(const void* const restrict _context, const long long first, const long long last) {
+    const pyramidcontext* const context = _context;
+    const imview* const         view    = context->_view;
+    const long long             width   = view->_width;
+
+    for (long long band = first; band < last; ++band) {
+        const long long start   = band * view->_height / context->_nbands;
+        const long long end     = (band + 1) * view->_height / context->_nbands;
+        blocksum* const prefix  = context->_prefixes + band * (width + 1);
+        blocksum* const sums    = context->_sums + band * context->_ncolumns;
+
+        long long brows[PYRAMID_MAXLEVELS] = { 0 }; // the block row of each level being reduced
+        long long bends[PYRAMID_MAXLEVELS] = { 0 }; // the first block row of each level that starts past the band
+        long long stop                     = end;   // the bottom of the lowest block row the band owns
+        for (long long l = 0; l < context->_nlevels; ++l) {
+            const pyramidlevel* const level = context->_levels + l;
+            // the smallest block row whose first scanline, floor(brow * width / columns), is not above the given scanline
+            brows[l]                        = (start * level->_columns + width - 1) / width;
+            bends[l]                        = (end * level->_columns + width - 1) / width;
+            if (bends[l] > brows[l]) stop = max(stop, pyramidtop(view, level, bends[l]));
+        }
+
+        for (long long row = start; row < stop; ++row) {
+            if (!((row - start) % PREFETCH_SCANLINES)) imwillneed(view, row, row + 2 * PREFETCH_SCANLINES);
+
+            prefix[0] = (blocksum) { 0, 0, 0 };
+            memset(prefix + 1, 0U, sizeof(blocksum) * width);
+            foldscanline(context->_unpack, imscanline(view, row), width, 1, prefix + 1); // 1 x 1 blocks, the pixels themselves
+            for (long long col = 1; col <= width; ++col) {
+                prefix[col]._blue  += prefix[col - 1]._blue;
+                prefix[col]._green += prefix[col - 1]._green;
+                prefix[col]._red   += prefix[col - 1]._red;
+            }
+
+            blocksum* lsums = sums;
+            for (long long l = 0; l < context->_nlevels; lsums += context->_levels[l]._columns, ++l) {
+                const pyramidlevel* const level = context->_levels + l;
+                // scanlines above the first block row the band owns belong to the band above
+                if (brows[l] >= bends[l] || row < pyramidtop(view, level, brows[l])) continue;
+
+                const long long* const edges = level->_edges;
+                for (long long col = 0; col < level->_columns; ++col) {
+                    lsums[col]._blue  += prefix[edges[col + 1]]._blue - prefix[edges[col]]._blue;
+                    lsums[col]._green += prefix[edges[col + 1]]._green - prefix[edges[col]]._green;
+                    lsums[col]._red   += prefix[edges[col + 1]]._red - prefix[edges[col]]._red;
+                }
+
+                const long long top    = pyramidtop(view, level, brows[l]);
+                const long long bottom = pyramidtop(view, level, brows[l] + 1);
+                if (row + 1 == bottom) pyramidflush(level, brows[l]++, bottom - top, width, context->_cpal, lsums);
+            }
+        }
+    }
+}
+
+// renders the view at each of the nlevels widths in columns (clamped to [1, the width of the view], like to_integral_string() does),
+// strings[i] receives the render at columns[i]. returns false if anything could not be allocated (errors are reported to stderr), in
+// which case no strings are returned. release the strings with arenafree()
+static inline bool to_pyramid_strings(
+    const imview* const restrict    view,
+    const long long* const restrict columns,
+    const long long                 nlevels,
+    const cpalette* const           cpal,
+    char** const restrict           strings,
+    threadpool* const               pool,
+    arena* const                    memory
+) {
+    assert(nlevels > 0 && nlevels <= PYRAMID_MAXLEVELS);
+    const long long width  = view->_width;
+    const long long nbands = pool ? min((long long) pool->_nworkers, view->_height) : 1;
+
+    pyramidlevel levels[PYRAMID_MAXLEVELS] = { 0 };
+    long long    ncolumns                  = 0;
+    for (long long l = 0; l < nlevels; ++l) {
+        levels[l]._columns  = min(max(columns[l], 1LL), width);
+        // the smallest number of rows whose blocks reach the bottom of the image
+        levels[l]._rows     = (view->_height * levels[l]._columns + width - 1) / width;
+        ncolumns           += levels[l]._columns;
+    }
+
+    long long* const edges    = arenaalloc(memory, sizeof(long long) * (ncolumns + nlevels));
+    blocksum* const  prefixes = arenaalloc(memory, sizeof(blocksum) * nbands * (width + 1));
+    blocksum* const  sums     = arenacalloc(memory, nbands * ncolumns, sizeof(blocksum));
+    bool             ok       = edges && prefixes && sums;
+    for (long long l = 0; l < nlevels; ++l) {
+        levels[l]._buffer = arenaalloc(memory, levels[l]._rows * (levels[l]._columns + 1) + 1); // LFs and a NULL terminator
+        ok                = ok && levels[l]._buffer;
+    }
+
+    cpalette              fallback = { 0 };
+    const cpalette* const compiled = cpalpick(cpal, &fallback);
+    unpacker              unpack   = { 0 };
+    if (!ok) fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+    if (ok && unpackcompile(&unpack, view->_headers, view->_infoheader, compiled, memory)) {
+        long long* ledges = edges;
+        for (long long l = 0; l < nlevels; ledges += levels[l]._columns + 1, ++l) {
+            levels[l]._edges = ledges;
+            for (long long col = 0; col <= levels[l]._columns; ++col) ledges[col] = col * width / levels[l]._columns;
+        }
+
+        const pyramidcontext context = { ._view     = view,
+                                         ._cpal     = compiled,
+                                         ._unpack   = &unpack,
+                                         ._levels   = levels,
+                                         ._nlevels  = nlevels,
+                                         ._nbands   = nbands,
+                                         ._ncolumns = ncolumns,
+                                         ._prefixes = prefixes,
+                                         ._sums     = sums };
+        tpoolfor(pool, nbands, pyramidbands, &context);
+        unpackfree(&unpack);
+
+        for (long long l = 0; l < nlevels; ++l) {
+            levels[l]._buffer[levels[l]._rows * (levels[l]._columns + 1)] = 0;
+            strings[l]                                                    = levels[l]._buffer;
+        }
+    } else {
+        ok = false;
+        for (long long l = 0; l < nlevels; ++l) arenafree(memory, levels[l]._buffer);
+    }
+
+    arenafree(memory, edges);
+    arenafree(memory, prefixes);
+    arenafree(memory, sums);
+    return ok;
+}
+
+// renders a bitmap at each of the nlevels widths in columns, in a single pass over its pixels, see to_pyramid_strings()
+static inline bool to_width_strings(
+    const bitmap* const restrict    image,
+    const long long* const restrict columns,
+    const long long                 nlevels,
+    const cpalette* const           cpal,
+    char** const restrict           strings,
+    threadpool* const               pool,
+    arena* const                    memory
+) {
+    if (!image->_pixels) return false; // bmpread failed and has already reported why
+    if (image->_infoheader.biCompression == RLE8 || image->_infoheader.biCompression == RLE4) {
+        fputs("Error in to_width_strings, run length encoded bitmaps can only be rendered at the default width!\n", stderr);
+        return false;
+    }
+
+    const imview view = bmpview(image);
+    return to_pyramid_strings(&view, columns, nlevels, cpal, strings, pool, memory);
+}
+
+// renders a bitmap at the default width when ncolumns is 0 (strings[0] receives the render, see to_string()), or at each of the ncolumns
+// widths in columns otherwise, see to_width_strings()
+static inline bool to_strings(
+    const bitmap* const restrict    image,
+    const long long* const restrict columns,
+    const long long                 ncolumns,
+    const cpalette* const           cpal,
+    char** const restrict           strings,
+    threadpool* const               pool,
+    arena* const                    memory
+) {
+    if (ncolumns) return to_width_strings(image, columns, ncolumns, cpal, strings, pool, memory);
+    return (strings[0] = to_string(image, cpal, pool, memory)) != NULL;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+// clang-format off
+#include <_bitmap.h>
+// clang-format on
+
+// RLE8 and RLE4 bitmaps store their pixels as a stream of codes, two bytes each, walking the image bottom up, left to right
+//     count > 0, value     a run of count pixels, all of colour index value (RLE8), or alternating between the high and the low nibble
+//                          of value, starting with the high one (RLE4)
+//     0, 0                 end of the scanline, the rest of it is skipped
+//     0, 1                 end of the bitmap, everything after the current position is skipped
+//     0, 2, dx, dy         delta, the current position moves dx pixels to the right and dy scanlines up, skipping everything in between
+//     0, n (n > 2)         absolute mode, n literal colour indices follow (bytes for RLE8, nibbles for RLE4), padded to an even length
+// the decoder never materializes pixels, it reports every run as a span of pixels that all share the same pair of colour indices, and the
+// consumer (see rlesink) adds the whole span in one go, so decoding costs time proportional to the size of the compressed stream and not to
+// the number of pixels it expands to. skipped pixels are reported as spans of colour index 0, the background colour of the bitmap
+
+// RLE bitmaps are always bottom up, and the decoder can only ever move up or to the right, so scanlines are visited in order, exactly once
+
+#define RLE_MAXCODE 258LL // THE LONGEST CODE, AN ABSOLUTE RUN OF 255 RLE8 PIXELS (2 + 255 BYTES + 1 BYTE OF PADDING)
+
+// position of the next pixel to be decoded, scanlines are numbered bottom up i.e scanline 0 is the bottom scanline of the image
+typedef struct {
+        long long _x, _y; // NOLINT(readability-isolate-declaration)
+        bool      _done;  // the end of the bitmap was reached, further codes (if any) are ignored
+} rlecursor;
+
+// receives nrows x count pixels, scanlines [y, y + nrows) and columns [x, x + count) of the image, where pixels at an even distance from x
+// are of colour index even and pixels at an odd distance are of colour index odd (even == odd, except for RLE4 runs)
+// spans covering more than one scanline only ever come from skipped pixels and always cover whole scanlines
+// spans arrive in increasing order of y, and in increasing order of x within a scanline
+typedef void (*rlesink)(
+    void* const restrict context,
+    const long long      y,
+    const long long      nrows,
+    const long long      x,
+    const long long      count,
+    const unsigned char  even,
+    const unsigned char  odd
+);
+
+// moves the cursor to (x, y), reporting everything in between as skipped, coordinates past the edges of the image are clamped
+static inline void rlemove(
+    rlecursor* const restrict              cursor,
+    long long                              x,
+    long long                              y,
+    const BITMAPINFOHEADER* const restrict infhead,
+    const rlesink                          sink,
+    void* const restrict                   context
+) {
+    const long long width  = infhead->biWidth;
+    const long long height = infhead->biHeight;
+    if (y >= height) { // past the top scanline, the rest of the image is skipped
+        y = height;
+        x = 0;
+    }
+    x = min(x, width);
+    if (cursor->_y >= height) return;
+
+    if (y == cursor->_y) {
+        if (x > cursor->_x) sink(context, y, 1, cursor->_x, x - cursor->_x, 0, 0);
+    } else {
+        if (cursor->_x < width) sink(context, cursor->_y, 1, cursor->_x, width - cursor->_x, 0, 0); // the rest of the current scanline
+        if (y - cursor->_y > 1) sink(context, cursor->_y + 1, y - cursor->_y - 1, 0, width, 0, 0);  // the scanlines in between
+        if (y < height && x) sink(context, y, 1, 0, x, 0, 0);                                       // the start of the destination scanline
+    }
+
+    if (y > cursor->_y || x > cursor->_x) { // a delta can't move the cursor down or back
+        cursor->_x = x;
+        cursor->_y = y;
+    }
+    cursor->_done = cursor->_y >= height;
+}
+
+// reports a run of count pixels at the cursor, the part of the run that spills past the right edge of the image is dropped
+static inline void rlerun(
+    rlecursor* const restrict cursor,
+    const long long           count,
+    const unsigned char       even,
+    const unsigned char       odd,
+    const long long           width,
+    const rlesink             sink,
+    void* const restrict      context
+) {
+    const long long visible = min(count, width - cursor->_x);
+    if (visible > 0) sink(context, cursor->_y, 1, cursor->_x, visible, even, odd);
+    cursor->_x += count;
+}
+
+// decodes the whole codes in data[0, size) and returns the number of bytes consumed
+// unless final is true, decoding stops once fewer than RLE_MAXCODE bytes are left, so a code is never split across two calls and the caller
+// can carry the leftovers over to the next call, along with the next chunk of the stream. when final is true, a truncated code at the end
+// of the stream ends the bitmap. call rlemove(cursor, 0, height, ...) after the last call, to report whatever wasn't covered by the stream
+static inline long long rledecode(
+    rlecursor* const restrict              cursor,
+    const unsigned char* const restrict    data,
+    const long long                        size,
+    const bool                             final,
+    const BITMAPINFOHEADER* const restrict infhead,
+    const rlesink                          sink,
+    void* const restrict                   context
+) {
+    const bool      rle4  = infhead->biCompression == RLE4;
+    const long long width = infhead->biWidth;
+    long long       pos   = 0;
+
+    while (!cursor->_done && (final ? pos + 2 <= size : size - pos >= RLE_MAXCODE)) {
+        const unsigned char count = data[pos], code = data[pos + 1]; // NOLINT(readability-isolate-declaration)
+        pos += 2;
+
+        if (count) { // an encoded run
+            rlerun(cursor, count, rle4 ? code >> 4 : code, rle4 ? code & 0x0F : code, width, sink, context);
+            continue;
+        }
+
+        switch (code) {
+            case 0 : rlemove(cursor, 0, cursor->_y + 1, infhead, sink, context); break; // end of the scanline
+            case 1 : cursor->_done = true; break;                                     // end of the bitmap
+            case 2 :                                                                  // delta
+                if (pos + 2 > size) {
+                    cursor->_done = true;
+                    break;
+                }
+                rlemove(cursor, cursor->_x + data[pos], cursor->_y + data[pos + 1], infhead, sink, context);
+                pos += 2;
+                break;
+            default : { // absolute mode, the literals are reported two at a time
+                const long long nbytes = rle4 ? (code + 1) / 2 : code;
+                if (pos + nbytes > size) {
+                    cursor->_done = true;
+                    break;
+                }
+                for (long long i = 0; i < code; i += 2) {
+                    const unsigned char first  = rle4 ? data[pos + i / 2] >> 4 : data[pos + i];
+                    const unsigned char second = rle4 ? data[pos + i / 2] & 0x0F : (i + 1 < code ? data[pos + i + 1] : 0);
+                    rlerun(cursor, min(2LL, code - i), first, second, width, sink, context);
+                }
+                pos += (nbytes + 1) & ~1LL; // runs are padded to 16 bit boundaries
+                break;
+            }
+        }
+    }
+
+    return final ? size : pos;
+}
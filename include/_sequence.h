@@ -0,0 +1,330 @@
+#pragma once
+
+// clang-format off
+#include <_cache.h>
+#include <_output.h>
+#include <_prefetch.h>
+// clang-format on
+
+// sequence mode, for animations i.e numbered frames out of a capture pipeline, played back in place on a terminal
+// a frame is converted like any other image, but rather than printing it, it's compared against the character grid of the frame before
+// and only the cells that changed are written, each run of them after an escape that moves the cursor to its start, ESC[<row>;<col>H
+// so the bytes written scale with how much of the picture moved rather than with its size, a static background costs nothing
+//     a run absorbs the unchanged cells up to the next change when rewriting them takes fewer bytes than another cursor move would
+//     with row hashes, every row of the grid keeps an XXH64 of its characters (see <_cache.h>) and rows whose hash didn't change are
+//     skipped without looking at their cells. a row that changed and collides with the hash of its previous contents (a 1 in 2 ^ 64
+//     chance) is left stale until it changes again
+// the first frame, and any frame with a grid of a different shape, clears the screen and is written in full, but for its spaces
+// frames go through a pipeline, a prefetcher reads the files ahead (see <_prefetch.h>), each frame is converted on the pool, and the
+// updates are written by a thread of their own, so that the conversion of a frame overlaps the write of the frame before. a terminal
+// takes its time drawing, and its writes block until it catches up
+
+#define SEQUENCE_BEGIN   "\x1b[?25l\x1b[H\x1b[2J" // HIDES THE CURSOR, MOVES IT HOME AND CLEARS THE SCREEN
+#define SEQUENCE_END     "\x1b[?25h"              // SHOWS THE CURSOR AGAIN
+#define SEQUENCE_MAXMOVE (sizeof("\x1b[;H") - 1 + 2 * 19LLU) // LONGEST CURSOR MOVE, BY THE DIGITS OF TWO POSITIVE LONG LONGS
+
+typedef struct {
+        unsigned long long _nframes;
+        unsigned long long _ncells;    // cells of all the frames
+        unsigned long long _nwritten;  // cells written, the unchanged ones absorbed by runs included
+        unsigned long long _nskipped;  // rows skipped by their hashes
+        unsigned long long _nbytes;    // bytes of all the updates
+        unsigned long long _nfullsize; // bytes of all the frames, as they would have been printed in full
+} sequencestats;
+
+typedef struct {
+        char*         _previous; // _rows x _columns characters of the frame on the screen, without the LFs, NULL before the first frame
+        uint64_t*     _hashes;   // hash of every row of _previous, NULL without row hashes
+        long long     _columns;
+        long long     _rows;
+        bool          _hashrows;
+        sequencestats _stats;
+} sequence;
+
+static inline void sequenceopen(sequence* const restrict seq, const bool hashrows) {
+    *seq = (sequence) { ._hashrows = hashrows };
+}
+
+static inline void sequenceclose(sequence* const restrict seq) {
+    free(seq->_previous);
+    free(seq->_hashes);
+    *seq = (sequence) { 0 };
+}
+
+// writes a value in decimal unless out is NULL, returns the number of digits
+static inline long long sequencedigits(const unsigned long long value, char* const restrict out) {
+    long long ndigits = 1;
+    for (unsigned long long v = value; v >= 10; v /= 10) ++ndigits;
+    if (out)
+        for (long long i = ndigits - 1, v = value; i >= 0; --i, v /= 10) out[i] = '0' + v % 10; // NOLINT
+    return ndigits;
+}
+
+// writes the escape that moves the cursor to the zero based row and col unless out is NULL, returns its length
+static inline long long sequencemove(const long long row, const long long col, char* const restrict out) {
+    if (out) memcpy(out, "\x1b[", 2);
+    long long length = 2 + sequencedigits(row + 1, out ? out + 2 : NULL);
+    if (out) out[length] = ';';
+    length += 1 + sequencedigits(col + 1, out ? out + length + 1 : NULL);
+    if (out) out[length] = 'H';
+    return length + 1;
+}
+
+// takes over the next frame, a string of rows of equal length each followed by a LF (what the converters return), and returns the
+// update that turns the frame on the screen into it, NULL terminated, from memory (NULL for the heap), release it with arenafree()
+// every run of a row costs a cursor move, and the cells between two runs are only left out when they take at least as many bytes as the
+// move to the second run, so the update of a row is never longer than its cells and a single move. returns NULL if anything could not be
+// allocated (errors are reported to stderr), the frame on the screen is left as it was
+static inline char* sequenceframe(sequence* const restrict seq, const char* const restrict frame, arena* const memory) {
+    const char* const lf      = strchr(frame, '\n');
+    const long long   length  = strlen(frame);
+    const long long   columns = lf ? lf - frame : length;
+    const long long   rows    = lf ? length / (columns + 1) : 0;
+    const bool        fresh   = !seq->_previous || columns != seq->_columns || rows != seq->_rows;
+
+    char* const buffer = arenaalloc(memory, sizeof(SEQUENCE_BEGIN) + rows * (columns + SEQUENCE_MAXMOVE)); // + 1 for the NULL terminator
+    if (!buffer) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        return NULL;
+    }
+
+    if (fresh) { // the screen is about to be cleared, blank cells stay as they are
+        char* const     previous = malloc(max(rows * columns, 1LL));
+        uint64_t* const hashes   = seq->_hashrows ? calloc(max(rows, 1LL), sizeof(uint64_t)) : NULL;
+        if (!previous || (seq->_hashrows && !hashes)) {
+            fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+            free(previous);
+            free(hashes);
+            arenafree(memory, buffer);
+            return NULL;
+        }
+        memset(previous, ' ', rows * columns);
+        free(seq->_previous);
+        free(seq->_hashes);
+        seq->_previous = previous;
+        seq->_hashes   = hashes;
+        seq->_columns  = columns;
+        seq->_rows     = rows;
+        memcpy(buffer, SEQUENCE_BEGIN, sizeof(SEQUENCE_BEGIN) - 1);
+    }
+
+    long long nbytes = fresh ? sizeof(SEQUENCE_BEGIN) - 1 : 0;
+
+    for (long long row = 0; row < rows; ++row) {
+        const char* const now    = frame + row * (columns + 1);
+        char* const       before = seq->_previous + row * columns;
+        if (seq->_hashes) {
+            const uint64_t hash = xxh64((const unsigned char*) now, columns, 0);
+            if (!fresh && hash == seq->_hashes[row]) {
+                ++seq->_stats._nskipped;
+                continue;
+            }
+            seq->_hashes[row] = hash;
+        }
+
+        long long col = 0;
+        while (true) {
+            while (col < columns && now[col] == before[col]) ++col;
+            if (col == columns) break;
+
+            // the run, up to the first change after it that's further away than a cursor move to it
+            const long long start = col;
+            long long       end   = col;
+            while (true) {
+                while (end < columns && now[end] != before[end]) ++end;
+                long long next = end;
+                while (next < columns && now[next] == before[next]) ++next;
+                if (next == columns || next - end >= sequencemove(row, next, NULL)) break;
+                end = next;
+            }
+
+            nbytes += sequencemove(row, start, buffer + nbytes);
+            memcpy(buffer + nbytes, now + start, end - start);
+            memcpy(before + start, now + start, end - start);
+            nbytes                += end - start;
+            seq->_stats._nwritten += end - start;
+            col                    = end;
+        }
+    }
+
+    buffer[nbytes]          = 0;
+    seq->_stats._nframes   += 1;
+    seq->_stats._ncells    += rows * columns;
+    seq->_stats._nbytes    += nbytes;
+    seq->_stats._nfullsize += length;
+    return buffer;
+}
+
+// the bytes that leave the terminal as it was, the cursor below the frame on the screen and visible again, into out, returns their length
+static inline long long sequencefinish(const sequence* const restrict seq, char out[static SEQUENCE_MAXMOVE + sizeof(SEQUENCE_END) + 1]) {
+    if (!seq->_previous) return 0; // not a single frame made it to the screen
+    const long long length = sequencemove(seq->_rows ? seq->_rows - 1 : 0, 0, out);
+    out[length]            = '\n';
+    memcpy(out + length + 1, SEQUENCE_END, sizeof(SEQUENCE_END) - 1);
+    return length + sizeof(SEQUENCE_END);
+}
+
+static inline void sequencereport(const sequencestats* const restrict stats, FILE* const restrict stream) {
+    fprintf(
+        stream,
+        "sequence :: %llu frames, %llu of %llu cells written, %llu rows skipped by their hashes, %llu bytes written in place of %llu\n",
+        stats->_nframes,
+        stats->_nwritten,
+        stats->_ncells,
+        stats->_nskipped,
+        stats->_nbytes,
+        stats->_nfullsize
+    );
+}
+
+// the writer at the end of the pipeline, the updates are handed to it one at a time
+typedef struct {
+        pthread_t       _thread;
+        pthread_mutex_t _lock;
+        pthread_cond_t  _wakeup;   // signalled when an update is handed over, when the writer is done with it and at shutdown
+        output*         _out;
+        const char*     _pending;  // the update being written, NULL while the writer is idle
+        long long       _npending;
+        bool            _shutdown;
+        bool            _written;  // false once an update couldn't be written in full
+} sequencewriter;
+
+static inline void* sequencewrite(void* const _writer) {
+    sequencewriter* const writer = _writer;
+    pthread_mutex_lock(&writer->_lock);
+    while (true) {
+        while (!writer->_pending && !writer->_shutdown) pthread_cond_wait(&writer->_wakeup, &writer->_lock);
+        if (!writer->_pending) break; // shut down, with nothing left to write
+
+        pthread_mutex_unlock(&writer->_lock);
+        const bool written = outputbytes(writer->_out, writer->_pending, writer->_npending);
+        pthread_mutex_lock(&writer->_lock);
+        writer->_written &= written;
+        writer->_pending  = NULL;
+        pthread_cond_broadcast(&writer->_wakeup);
+    }
+    pthread_mutex_unlock(&writer->_lock);
+    return NULL;
+}
+
+// waits until the writer is done with the update it was handed last, after which its memory can be reused
+static inline void sequenceidle(sequencewriter* const writer) {
+    pthread_mutex_lock(&writer->_lock);
+    while (writer->_pending) pthread_cond_wait(&writer->_wakeup, &writer->_lock);
+    pthread_mutex_unlock(&writer->_lock);
+}
+
+// hands nbytes bytes of update to the writer, once it's done with the one before
+static inline void sequencehand(sequencewriter* const writer, const char* const update, const long long nbytes) {
+    if (!nbytes) return;
+    pthread_mutex_lock(&writer->_lock);
+    while (writer->_pending) pthread_cond_wait(&writer->_wakeup, &writer->_lock);
+    writer->_pending  = update;
+    writer->_npending = nbytes;
+    pthread_cond_broadcast(&writer->_wakeup);
+    pthread_mutex_unlock(&writer->_lock);
+}
+
+// converts a frame the way a single image would be, with aspect_w : aspect_h blocks when aspect_w isn't 0 (see to_aspect_string())
+static inline char* sequenceconvert(
+    const char* const restrict path,
+    const bool                 stream,
+    const long long            aspect_w,
+    const long long            aspect_h,
+    threadpool* const          pool,
+    arena* const               memory
+) {
+    if (stream) return to_streamed_string(path, memory);
+
+    bitmap         image       = bmpread(path, memory);
+    const unsigned compression = image._infoheader.biCompression;
+    char*          frame       = NULL;
+    if (aspect_w && image._pixels && compression != RLE8 && compression != RLE4) { // run length encoded bitmaps only come square
+        const imview view = bmpview(&image);
+        frame             = to_aspect_string(&view, aspect_w, aspect_h, NULL, pool, memory);
+    } else
+        frame = to_string(&image, NULL, pool, memory);
+    bmpclose(&image);
+    return frame;
+}
+
+// plays the npaths frames at paths back in place, on out, or the frames whose paths come from list one per line, as they come, when
+// paths is NULL. with row hashes when hashrows is true, see sequenceframe(). frames that fail to convert are reported and skipped
+// prefetch (NULL for none) should be prefetching the paths, the counters of the sequence and of the arenas are added to stats and
+// memorystats, unless they are NULL. returns false if the pipeline couldn't be set up, or the updates couldn't be written in full
+static inline bool sequencerun(
+    const char* const* const paths,
+    const long long          npaths,
+    FILE* const              list,
+    const bool               hashrows,
+    const bool               stream,
+    const long long          aspect_w,
+    const long long          aspect_h,
+    threadpool* const        pool,
+    prefetcher* const        prefetch,
+    output* const            out,
+    sequencestats* const     stats,
+    arenastats* const        memorystats
+) {
+    sequencewriter writer = { ._out = out, ._written = true };
+    pthread_mutex_init(&writer._lock, NULL);
+    pthread_cond_init(&writer._wakeup, NULL);
+    if (pthread_create(&writer._thread, NULL, sequencewrite, &writer)) {
+        fprintf(stderr, "Call to pthread_create() failed inside %s at line %d!\n", __FUNCTION__, __LINE__);
+        pthread_mutex_destroy(&writer._lock);
+        pthread_cond_destroy(&writer._wakeup);
+        return false;
+    }
+
+    // frames alternate between two arenas, the update of the frame before is still being written while the next frame converts
+    // handing an update over waits for the one before it, so by the time a frame gets an arena, the update that came out of it two frames
+    // earlier has been written, unless the frame in between failed and the arena still holds the last update handed over
+    sequence  seq       = { 0 };
+    arena     arenas[2] = { 0 };
+    int       handed    = -1; // the arena of the last update handed over
+    char*     line      = NULL;
+    size_t    capacity  = 0;
+    sequenceopen(&seq, hashrows);
+    for (long long i = 0;; ++i) {
+        ssize_t nread = 0;
+        if (paths && i >= npaths) break;
+        if (!paths && (nread = getline(&line, &capacity, list)) == -1) break;
+        if (!paths && nread && line[nread - 1] == '\n') line[nread - 1] = 0;
+        const char* const path = paths ? paths[i] : line;
+
+        arena* const memory = arenas + i % 2;
+        if (handed == i % 2) sequenceidle(&writer);
+        arenareset(memory);
+        prefetchadvance(prefetch, i + 1); // the frames after this one are up next
+
+        const char* const frame  = sequenceconvert(path, stream, aspect_w, aspect_h, pool, memory);
+        const char* const update = frame ? sequenceframe(&seq, frame, memory) : NULL;
+        if (!update) {
+            fprintf(stderr, "Error :: failed processing frame %s!\n", path);
+            continue;
+        }
+        sequencehand(&writer, update, strlen(update));
+        handed = i % 2;
+    }
+
+    char      finish[SEQUENCE_MAXMOVE + sizeof(SEQUENCE_END) + 1] = { 0 };
+    const long long nfinish                                       = sequencefinish(&seq, finish);
+    sequencehand(&writer, finish, nfinish);
+
+    pthread_mutex_lock(&writer._lock);
+    writer._shutdown = true;
+    pthread_cond_broadcast(&writer._wakeup);
+    pthread_mutex_unlock(&writer._lock);
+    pthread_join(writer._thread, NULL);
+    pthread_mutex_destroy(&writer._lock);
+    pthread_cond_destroy(&writer._wakeup);
+
+    if (stats) *stats = seq._stats;
+    for (unsigned i = 0; i < 2; ++i) {
+        if (memorystats) arenatally(memorystats, arenas + i);
+        arenadestroy(arenas + i);
+    }
+    sequenceclose(&seq);
+    free(line);
+    return writer._written;
+}
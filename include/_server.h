@@ -0,0 +1,265 @@
+#pragma once
+
+// clang-format off
+#include <_pyramid.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+// clang-format on
+
+// a long running conversion server on a unix domain socket, for services that convert images all day long and shouldn't pay for a
+// process launch, cold page faults and cold caches on every single one of them
+// a client sends a serverrequest, followed by either the path of a bitmap or the bytes of one, and gets back a serverresponse, followed by
+// the NULL terminated strings of the result back to back (one per width, the same layout as the entries of <_cache.h>)
+// besides the widths, a request picks the mapper and the palette of the render. every pair of them is compiled once per process, the
+// first time a connection is served, and shared by all the connections from then on, requests never compile a palette (see cpalpick())
+// a connection carries any number of requests, one after the other. every connection is served start to end by a worker of the pool, with
+// an arena of its own that is reused request after request (see <_arena.h>), so a warm connection stops allocating altogether. the server
+// serves as many clients at once as the pool has workers, the rest wait in the queue of the pool until a connection closes
+// the conversions themselves run single threaded on the worker (tpoolfor() must not be called from a job on the same pool), the clients
+// are what runs in parallel
+// a malformed request gets a SERVER_BADREQUEST response and the connection is closed, the rest of the stream can't be made sense of
+// requests and responses are in native byte order, the socket is local
+
+#define SERVER_MAGIC    0x43534142U // "BASC", IN LITTLE ENDIAN BYTE ORDER
+#define SERVER_MAXBYTES (1LL << 30) // LARGEST BITMAP A REQUEST MAY CARRY, AND LARGEST RESULT A CLIENT ACCEPTS
+
+typedef enum { SERVER_PATH, SERVER_BITMAP } SERVER_REQUEST;
+
+typedef enum {
+    SERVER_OK,
+    SERVER_FAILED,       // the bitmap could not be read or converted, the connection stays usable
+    SERVER_BADREQUEST,   // the server closes the connection after responding
+    SERVER_DISCONNECTED, // never sent, what clientconvert() returns when the connection broke or the response made no sense
+} SERVER_STATUS;
+
+typedef struct {
+        uint32_t _magic;
+        uint32_t _kind;                        // SERVER_PATH or SERVER_BITMAP
+        uint32_t _mapper;                      // a MAPPER_KIND
+        uint32_t _palette;                     // the index of a palette in cpalpalettes
+        int64_t  _ncolumns;                    // 0 for the default width, up to PYRAMID_MAXLEVELS widths otherwise, see to_strings()
+        int64_t  _columns[PYRAMID_MAXLEVELS];
+        int64_t  _length;                      // bytes of the path (without a NULL terminator) or of the bitmap that follow
+} serverrequest;
+
+typedef struct {
+        uint32_t _magic;
+        uint32_t _status;   // a SERVER_STATUS
+        int64_t  _nstrings; // 0 unless _status is SERVER_OK
+        int64_t  _length;   // bytes of the strings that follow, NULL terminators included
+} serverresponse;
+
+static volatile sig_atomic_t serverstopping = 0; // set by SIGINT and SIGTERM
+
+static cpalette       servercpals[CPAL_NMAPPERS][CPAL_NPALETTES] = { 0 }; // every mapper with every palette, read only once compiled
+static pthread_once_t servercompiled                             = PTHREAD_ONCE_INIT;
+
+static inline void servercompile(void) {
+    for (unsigned m = 0; m < CPAL_NMAPPERS; ++m)
+        for (unsigned p = 0; p < CPAL_NPALETTES; ++p) servercpals[m][p] = cpalcompile(m, cpalpalettes[p], cpalplengths[p]);
+}
+
+static inline void serverstop(const int signal) {
+    (void) signal;
+    serverstopping = 1;
+}
+
+// writeall() for sockets, a peer that hung up fails the send() instead of raising SIGPIPE and taking the whole process down
+static inline bool sendall(const int fdesc, const unsigned char* restrict buffer, long long nbytes) {
+    while (nbytes > 0) {
+        const ssize_t nsent = send(fdesc, buffer, nbytes, MSG_NOSIGNAL);
+        if (nsent == -1 && errno == EINTR) continue;
+        if (nsent <= 0) return false;
+        buffer += nsent;
+        nbytes -= nsent;
+    }
+    return true;
+}
+
+// sends a response, returns false if the client is gone
+static inline bool serverrespond(
+    const int fdesc, const SERVER_STATUS status, const char* const* const restrict strings, const long long nstrings
+) {
+    serverresponse response                   = { ._magic = SERVER_MAGIC, ._status = status, ._nstrings = nstrings, ._length = 0 };
+    long long      lengths[PYRAMID_MAXLEVELS] = { 0 };
+    for (long long i = 0; i < nstrings; ++i) response._length += lengths[i] = strlen(strings[i]) + 1;
+
+    if (!sendall(fdesc, (const unsigned char*) &response, sizeof(serverresponse))) return false;
+    for (long long i = 0; i < nstrings; ++i)
+        if (!sendall(fdesc, (const unsigned char*) strings[i], lengths[i])) return false;
+    return true;
+}
+
+// serves a request whose header has been read, returns false when the connection should be closed
+static inline bool serverhandle(const int fdesc, const serverrequest* const restrict request, arena* const memory) {
+    const bool valid = request->_magic == SERVER_MAGIC && request->_mapper < CPAL_NMAPPERS && request->_palette < CPAL_NPALETTES &&
+                       request->_ncolumns >= 0 && request->_ncolumns <= PYRAMID_MAXLEVELS &&
+                       ((request->_kind == SERVER_PATH && request->_length > 0 && request->_length < PATH_MAX) ||
+                        (request->_kind == SERVER_BITMAP && request->_length > 0 && request->_length <= SERVER_MAXBYTES));
+    if (!valid) {
+        serverrespond(fdesc, SERVER_BADREQUEST, NULL, 0);
+        return false;
+    }
+
+    unsigned char* const payload = arenaalloc(memory, request->_length + 1); // the paths need a NULL terminator
+    if (!payload) { // the payload can't be skipped without reading it somewhere
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        serverrespond(fdesc, SERVER_FAILED, NULL, 0);
+        return false;
+    }
+    if (!readall(fdesc, payload, request->_length)) return false; // the client went away mid request
+    payload[request->_length] = 0;
+
+    bitmap image = request->_kind == SERVER_PATH ? bmpread((const char*) payload, memory) // mapped only when large, see bmpread()
+                                                 : bmpparse(payload, request->_length, 0, memory);
+    long long columns[PYRAMID_MAXLEVELS] = { 0 };
+    for (long long i = 0; i < request->_ncolumns; ++i) columns[i] = request->_columns[i];
+
+    char*           strings[PYRAMID_MAXLEVELS] = { 0 };
+    const long long nstrings                   = request->_ncolumns ? request->_ncolumns : 1;
+    const cpalette* cpal                       = &servercpals[request->_mapper][request->_palette];
+    const bool      done                       = to_strings(&image, columns, request->_ncolumns, cpal, strings, NULL, memory);
+    bmpclose(&image);
+
+    return done ? serverrespond(fdesc, SERVER_OK, (const char* const*) strings, nstrings) : serverrespond(fdesc, SERVER_FAILED, NULL, 0);
+}
+
+// a job of the pool, serves the requests of a connection until the client hangs up, then closes it
+static inline void serveconnection(void* const _fdesc) {
+    const int     fdesc   = (int) (intptr_t) _fdesc;
+    arena         memory  = { 0 };
+    serverrequest request = { 0 };
+    pthread_once(&servercompiled, servercompile);
+    while (readall(fdesc, (unsigned char*) &request, sizeof(serverrequest))) {
+        arenareset(&memory); // the blocks of the last request go back, the arena grows to fit it if it spilled
+        if (!serverhandle(fdesc, &request, &memory)) break;
+    }
+
+    arenadestroy(&memory);
+    if (close(fdesc)) fprintf(stderr, "Call to close() failed inside %s at line %d!; errno %d\n", __FUNCTION__, __LINE__, errno);
+}
+
+// listens on a unix domain socket at path until SIGINT or SIGTERM, handing every connection to a worker of the pool, a NULL pool serves
+// one connection at a time on the calling thread. a socket left behind at path by a server that didn't get to clean up is replaced
+// returns false if the socket could not be set up or accept() failed (errors are reported to stderr). the connections already handed to
+// the pool are still being served on return, tpooldestroy() waits for their clients to hang up
+static inline bool serverrun(const char* const restrict path, threadpool* const pool) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error in %s @ line %d: %s is too long to be a socket path\n", __FUNCTION__, __LINE__, path);
+        return false;
+    }
+    strcpy(address.sun_path, path);
+
+    struct stat filestat = { 0 };
+    if (!stat(path, &filestat) && S_ISSOCK(filestat.st_mode)) unlink(path); // anything but a socket is left alone, bind() will fail
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener == -1) {
+        fprintf(stderr, "Call to socket() failed inside %s at line %d!; errno %d\n", __FUNCTION__, __LINE__, errno);
+        return false;
+    }
+    if (bind(listener, (const struct sockaddr*) &address, sizeof(address)) || listen(listener, SOMAXCONN)) {
+        fprintf(stderr, "Call to bind() or listen() failed inside %s at line %d!; errno %d\n", __FUNCTION__, __LINE__, errno);
+        close(listener);
+        return false;
+    }
+
+    // no SA_RESTART, the signal has to interrupt accept() for the loop to see serverstopping
+    struct sigaction action = { .sa_handler = serverstop };
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    bool done = true;
+    while (!serverstopping) {
+        const int client = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        if (client == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            fprintf(stderr, "Call to accept() failed inside %s at line %d!; errno %d\n", __FUNCTION__, __LINE__, errno);
+            done = false;
+            break;
+        }
+        if (!pool || !tpoolsubmit(pool, serveconnection, (void*) (intptr_t) client)) serveconnection((void*) (intptr_t) client);
+    }
+
+    close(listener);
+    unlink(path);
+    return done;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// the client side, see src/client.c                                                                                //
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// connects to the server listening at path, returns the connected socket or -1 (errors are reported to stderr)
+static inline int clientconnect(const char* const restrict path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error in %s @ line %d: %s is too long to be a socket path\n", __FUNCTION__, __LINE__, path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    const int fdesc = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fdesc == -1 || connect(fdesc, (const struct sockaddr*) &address, sizeof(address))) {
+        fprintf(stderr, "Call to socket() or connect() failed inside %s at line %d!; errno %d\n", __FUNCTION__, __LINE__, errno);
+        if (fdesc != -1) close(fdesc);
+        return -1;
+    }
+    return fdesc;
+}
+
+// sends a request down a connection and waits for its response, the render is at the ncolumns widths in columns (the default width when
+// ncolumns is 0) with the mapper and the palette at index palette in cpalpalettes. the strings of the result come from memory (NULL for
+// the heap), back to back in a single block, release them with arenafree(memory, strings[0]). returns the status of the response,
+// SERVER_DISCONNECTED if the connection broke or the response made no sense, the connection is of no further use then (nor after a
+// SERVER_BADREQUEST)
+static inline SERVER_STATUS clientconvert(
+    const int                            fdesc,
+    const SERVER_REQUEST                 kind,
+    const unsigned char* const restrict  payload,
+    const long long                      length,
+    const long long* const restrict      columns,
+    const long long                      ncolumns,
+    const MAPPER_KIND                    mapper,
+    const unsigned                       palette,
+    char** const restrict                strings,
+    arena* const                         memory
+) {
+    assert(ncolumns >= 0 && ncolumns <= PYRAMID_MAXLEVELS);
+    serverrequest request = {
+        ._magic = SERVER_MAGIC, ._kind = kind, ._mapper = mapper, ._palette = palette, ._ncolumns = ncolumns, ._length = length
+    };
+    for (long long i = 0; i < ncolumns; ++i) request._columns[i] = columns[i];
+
+    serverresponse response = { 0 };
+    if (!sendall(fdesc, (const unsigned char*) &request, sizeof(serverrequest)) || !sendall(fdesc, payload, length) ||
+        !readall(fdesc, (unsigned char*) &response, sizeof(serverresponse)) || response._magic != SERVER_MAGIC)
+        return SERVER_DISCONNECTED;
+    if (response._status != SERVER_OK) return response._status > SERVER_BADREQUEST ? SERVER_DISCONNECTED : response._status;
+
+    const long long nstrings = ncolumns ? ncolumns : 1;
+    if (response._nstrings != nstrings || response._length < nstrings || response._length > SERVER_MAXBYTES) return SERVER_DISCONNECTED;
+
+    char* const buffer = arenaalloc(memory, response._length);
+    if (!buffer) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        return SERVER_DISCONNECTED; // the strings are still on their way, the connection is out of step now
+    }
+    if (!readall(fdesc, (unsigned char*) buffer, response._length) || buffer[response._length - 1]) {
+        arenafree(memory, buffer);
+        return SERVER_DISCONNECTED;
+    }
+
+    // the strings are split at their NULL terminators, there has to be exactly one per string
+    long long nfound = 0;
+    for (char* string = buffer; string < buffer + response._length && nfound < nstrings; string += strlen(string) + 1)
+        strings[nfound++] = string;
+    if (nfound != nstrings || strings[nstrings - 1] + strlen(strings[nstrings - 1]) + 1 != buffer + response._length) {
+        arenafree(memory, buffer);
+        return SERVER_DISCONNECTED;
+    }
+    return SERVER_OK;
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+// clang-format off
+#include <_tostring.h>
+// clang-format on
+
+// a bounded memory alternative to bmpread + to_string, for bitmaps that are too large to hold in memory
+// only the headers and a small, fixed number of scanlines are ever resident, regardless of the size of the image
+// scanlines are read with pread() in chunks of STREAM_SCANLINES, in image order i.e top to bottom, so top down bitmaps are read front to
+// back and bottom up bitmaps (which store the top scanline last) are read from the end of the file, backwards towards the start of the pixel
+// buffer. each chunk is wrapped in a view (see imscanlines()), each scanline is folded into the per block column sums
+// (see foldscanline()) and a row of output is emitted as soon as its block row is complete
+// peak memory is the output buffer + STREAM_SCANLINES scanlines + one blocksum per block column (+ the tables of the unpacker)
+// all of which come from the arena passed in (see <_arena.h>), NULL for the heap
+
+#define STREAM_SCANLINES 16LL    // NUMBER OF SCANLINES READ PER pread() CALL
+#define STREAM_RLEWINDOW 65536LL // NUMBER OF BYTES OF A RUN LENGTH ENCODED PIXEL BUFFER READ PER pread() CALL
+
+// a pread() that retries on short reads and interrupts, returns false when the requested bytes couldn't be read in full
+static inline bool preadall(const int fdesc, unsigned char* restrict buffer, long long nbytes, long long offset) {
+    while (nbytes > 0) {
+        const ssize_t nread = pread(fdesc, buffer, nbytes, offset);
+        if (nread == -1 && errno == EINTR) continue;
+        if (nread <= 0) return false; // an error or a premature end of file
+        buffer += nread;
+        offset += nread;
+        nbytes -= nread;
+    }
+    return true;
+}
+
+// run length encoded bitmaps can only be decoded front to back, the compressed stream is read STREAM_RLEWINDOW bytes at a time and decoded
+// straight into the block sums (see to_rle_string()), the codes straddling two windows are carried over to the next window
+static inline char* streamrle(
+    const int                              fdesc,
+    const unsigned char* const restrict    header,
+    const BITMAPFILEHEADER* const restrict fhead,
+    const BITMAPINFOHEADER* const restrict infhead,
+    arena* const restrict                  memory
+) {
+    unsigned char* const window = arenaalloc(memory, STREAM_RLEWINDOW);
+    if (!window) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        return NULL;
+    }
+
+    const cpalette cpal    = cpalcompile(smapper, spalette, sizeof(spalette));
+    unpacker       unpack  = { 0 };
+    rlecontext     context = { 0 };
+    rlecursor      cursor  = { 0 };
+    if (!rlebegin(&context, &unpack, header, infhead, &cpal, memory)) {
+        arenafree(memory, window);
+        return NULL;
+    }
+
+    posix_fadvise(fdesc, fhead->bfOffBits, infhead->biSizeImage, POSIX_FADV_SEQUENTIAL);
+
+    long long offset = fhead->bfOffBits, remaining = infhead->biSizeImage, nbuffered = 0; // NOLINT(readability-isolate-declaration)
+    while (!cursor._done && remaining) {
+        const long long nread = min(remaining, STREAM_RLEWINDOW - nbuffered);
+        if (!preadall(fdesc, window + nbuffered, nread, offset)) {
+            fprintf(stderr, "Error in %s @ line %d: could not read the pixel buffer, is the file truncated?\n", __FUNCTION__, __LINE__);
+            arenafree(memory, window);
+            arenafree(memory, rleend(&context, &unpack, &cursor));
+            return NULL;
+        }
+        posix_fadvise(fdesc, offset, nread, POSIX_FADV_DONTNEED);
+        offset    += nread;
+        remaining -= nread;
+        nbuffered += nread;
+
+        const long long nconsumed = rledecode(&cursor, window, nbuffered, !remaining, infhead, rlespan, &context);
+        memmove(window, window + nconsumed, nbuffered - nconsumed);
+        nbuffered -= nconsumed;
+    }
+
+    arenafree(memory, window);
+    return rleend(&context, &unpack, &cursor);
+}
+
+static inline char* to_streamed_string(const char* const restrict filepath, arena* const memory) {
+    unsigned char header[BITMAP_MAXHEADERS] = { 0 }; // the headers, the colour masks and the colour table, if any
+
+    char*          buffer    = NULL;
+    unsigned char* scanlines = NULL;
+    blocksum*      sums      = NULL;
+    unpacker       unpack    = { 0 };
+    struct stat    filestat  = {};
+
+    const int fdesc     = open(filepath, O_RDONLY);
+    if (fdesc == -1) {
+        fprintf(stderr, "Call to open() failed inside %s at line %d!; errno %d\n", __FUNCTION__, __LINE__, errno);
+        return NULL;
+    }
+
+    if (fstat(fdesc, &filestat) || !preadall(fdesc, header, sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER), 0)) {
+        fprintf(stderr, "Error in %s @ line %d: could not read the bitmap headers!\n", __FUNCTION__, __LINE__);
+        goto CLOSE_AND_RETURN;
+    }
+
+    const BITMAPFILEHEADER fhead = fileheader(header, sizeof(header));
+    if (!fhead.bfSize) goto CLOSE_AND_RETURN; // fileheader does the error reporting
+    const BITMAPINFOHEADER infhead = infoheader(header, sizeof(header));
+    if (!infhead.biSize) goto CLOSE_AND_RETURN;
+
+    // the colour masks and the colour table sit between the info header and the pixel buffer
+    if (fhead.bfOffBits > filestat.st_size || !preadall(fdesc, header, min((long long) fhead.bfOffBits, (long long) sizeof(header)), 0)) {
+        fprintf(stderr, "Error in %s @ line %d: could not read the colour table!\n", __FUNCTION__, __LINE__);
+        goto CLOSE_AND_RETURN;
+    }
+    if (!bmpsupported(header, &fhead, &infhead, filestat.st_size)) goto CLOSE_AND_RETURN;
+
+    if (infhead.biCompression == RLE8 || infhead.biCompression == RLE4) {
+        buffer = streamrle(fdesc, header, &fhead, &infhead, memory);
+        goto CLOSE_AND_RETURN;
+    }
+
+    const long long width     = infhead.biWidth;
+    const long long height    = llabs(infhead.biHeight);
+    const bool      topdown   = pixelorder(&infhead) == TOPDOWN;
+    // narrow images are mapped pixel by pixel, just like to_string would do, which is the same as downscaling with 1 x 1 blocks
+    const long long block_d   = width <= CONSOLE_WIDTH ? 1 : ceill(width / CONSOLE_WIDTHR);
+    const long long nblocks_w = (width + block_d - 1) / block_d;
+    const long long nblocks_h = (height + block_d - 1) / block_d;
+    const long long nchars    = nblocks_h * (nblocks_w + 1) + 1; // a LF at the end of each row, and a NULL terminator
+
+    const long long stride    = bmpstride(&infhead); // bytes per scanline, padding included
+
+    buffer                    = arenaalloc(memory, nchars);
+    scanlines                 = arenaalloc(memory, stride * STREAM_SCANLINES);
+    sums                      = arenacalloc(memory, nblocks_w, sizeof(blocksum));
+    if (!buffer || !scanlines || !sums) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        arenafree(memory, buffer);
+        buffer = NULL;
+        goto CLOSE_AND_RETURN;
+    }
+
+    const cpalette cpal = cpalcompile(smapper, spalette, sizeof(spalette));
+    if (!unpackcompile(&unpack, header, &infhead, &cpal, memory)) {
+        arenafree(memory, buffer);
+        buffer = NULL;
+        goto CLOSE_AND_RETURN;
+    }
+
+    // backwards reads defeat the kernel's readahead, so for bottom up bitmaps every chunk asks for the one after it in advance
+    // and since every byte is read exactly once, the pages already consumed are dropped from the page cache, so that streaming a huge
+    // bitmap does not evict everything else
+    posix_fadvise(fdesc, fhead.bfOffBits, height * stride, topdown ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_RANDOM);
+
+    long long brow = 0, nfolded = 0; // NOLINT(readability-isolate-declaration) the block row being reduced and scanlines folded into it
+    for (long long top = 0; top < height; top += STREAM_SCANLINES) { // image rows [top, top + nrows) make up a chunk
+        const long long nrows = min(STREAM_SCANLINES, height - top);
+        // the scanline the chunk starts at in the file, for bottom up bitmaps that's the bottom row of the chunk
+        const long long first = topdown ? top : height - top - nrows;
+        if (!topdown && first) // the next chunk
+            posix_fadvise(
+                fdesc, fhead.bfOffBits + max(first - STREAM_SCANLINES, 0LL) * stride, STREAM_SCANLINES * stride, POSIX_FADV_WILLNEED
+            );
+
+        if (!preadall(fdesc, scanlines, nrows * stride, fhead.bfOffBits + first * stride)) {
+            fprintf(stderr, "Error in %s @ line %d: could not read the pixel buffer, is the file truncated?\n", __FUNCTION__, __LINE__);
+            arenafree(memory, buffer);
+            buffer = NULL;
+            goto CLOSE_AND_RETURN;
+        }
+        posix_fadvise(fdesc, fhead.bfOffBits + first * stride, nrows * stride, POSIX_FADV_DONTNEED);
+
+        const imview chunk = imscanlines(header, &infhead, scanlines, nrows, false);
+        for (long long r = 0; r < nrows; ++r) { // top to bottom, in image order
+            foldscanline(&unpack, imscanline(&chunk, r), width, block_d, sums);
+            // a block row is complete after block_d scanlines, or when the bottom scanline of the image has been folded
+            if (++nfolded == block_d || top + r == height - 1) {
+                flushblockrow(sums, width, block_d, nfolded, &cpal, buffer + brow * (nblocks_w + 1));
+                brow++;
+                nfolded = 0;
+            }
+        }
+    }
+
+    assert(brow == nblocks_h);
+    buffer[nchars - 1] = 0;
+
+CLOSE_AND_RETURN:
+    unpackfree(&unpack);
+    arenafree(memory, scanlines);
+    arenafree(memory, sums);
+    if (close(fdesc)) fprintf(stderr, "Call to close() failed inside %s at line %d!; errno %d\n", __FUNCTION__, __LINE__, errno);
+    return buffer;
+}
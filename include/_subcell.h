@@ -0,0 +1,209 @@
+#pragma once
+
+// clang-format off
+#include <_colour.h>
+// clang-format on
+
+// sub cell renderers, more than one sample per character cell, for the detail the square blocks of to_downscaled_string() lose
+// a character cell is about twice as tall as it is wide, so a square block per character stretches the image vertically and throws
+// half of the vertical resolution away. both renderers here split a cell into square samples instead
+//     half blocks  two samples per cell, one above the other, the upper one as the foreground of U+2580 UPPER HALF BLOCK and the lower
+//                  one as the background, in 24 bit colour (see <_colour.h>)
+//     braille      2 x 4 samples per cell, each a dot of a braille pattern (U+2800 - U+28FF) that is raised when the sample is brighter
+//                  than the average of the image, monochrome
+// the samples are the block averages of a grid (see <_grid.h>), reducing the pixels to them streams every scanline through once
+// regardless of how many samples a cell takes, which is where nearly all the time goes. the kernels here then fold the 2 or 4 sample rows
+// of a cell row into a complete output row in a single pass, each sample row read once, so 2 - 8 times the samples cost next to nothing
+// over the plain render of the same grid. the rows are independent of each other and rendered in parallel, like every other converter
+// grids saved with -e take two samples per cell as half blocks and eight as braille, i.e half and a quarter of the characters across
+
+#define SUBCELL_UPPER   "\xe2\x96\x80" // U+2580 UPPER HALF BLOCK, IN UTF-8
+#define SUBCELL_LOWER   "\xe2\x96\x84" // U+2584 LOWER HALF BLOCK, IN UTF-8
+#define SUBCELL_DEFAULT UINT32_MAX     // THE DEFAULT COLOUR OF THE TERMINAL, NEVER A COLOUR colourof() RETURNS
+
+// the bits of the dots of a braille pattern, by the row and the column of the dot, the dots of the last row came in late and got the
+// two high order bits
+static const unsigned char brailledots[4][2] = {
+    { 0x01, 0x08 },
+    { 0x02, 0x10 },
+    { 0x04, 0x20 },
+    { 0x40, 0x80 }
+};
+
+// writes the parameters of a foreground (selector 38) or a background (selector 48) colour, the default one included, unless out is
+// NULL, returns their length
+static inline long long subcellparams(const unsigned selector, const uint32_t colour, char* const restrict out) {
+    if (colour != SUBCELL_DEFAULT) return colourparams(selector, colour, out);
+    return colourdigits(selector + 1, out); // 39 and 49 select the default colours
+}
+
+// renders a row of half blocks from the top and the bottom samples of ncolumns cells, into out unless it's NULL, returns the number of
+// bytes. the bottom row of a grid with an odd number of rows has no samples below it, bottom is NULL and the lower halves are left to the
+// background of the terminal. the escapes are coalesced the way colourrow() does it, the foreground and the background are tracked
+// separately and a cell only sets the ones that differ from what's in effect, in a single escape
+//     a cell of a single colour is a space on a background of that colour, whatever the foreground
+//     a cell whose colours are the ones in effect the other way around is a U+2584 LOWER HALF BLOCK rather than an upper one
+static inline long long halfblockrow(
+    const blockfixed* const restrict top, const blockfixed* const restrict bottom, const long long ncolumns, char* const restrict out
+) {
+    long long length     = 0;
+    uint32_t  foreground = SUBCELL_DEFAULT, background = SUBCELL_DEFAULT; // NOLINT(readability-isolate-declaration)
+    for (long long col = 0; col < ncolumns; ++col) {
+        const uint32_t upper = colourof(top + col), lower = bottom ? colourof(bottom + col) : SUBCELL_DEFAULT; // NOLINT
+        const char*    glyph = SUBCELL_UPPER;
+        uint32_t       fore = upper, back = lower; // NOLINT(readability-isolate-declaration)
+        if (upper == lower) {
+            glyph = " ";
+            fore  = foreground;
+        } else if (lower != SUBCELL_DEFAULT &&
+                   (foreground != lower) + (background != upper) < (foreground != upper) + (background != lower)) {
+            glyph = SUBCELL_LOWER;
+            fore  = lower;
+            back  = upper;
+        }
+
+        if (fore != foreground || back != background) {
+            if (out) memcpy(out + length, "\x1b[", 2);
+            length += 2;
+            if (fore != foreground) length += subcellparams(38, fore, out ? out + length : NULL);
+            if (fore != foreground && back != background) {
+                if (out) out[length] = ';';
+                ++length;
+            }
+            if (back != background) length += subcellparams(48, back, out ? out + length : NULL);
+            if (out) out[length] = 'm';
+            ++length;
+            foreground = fore;
+            background = back;
+        }
+
+        const long long nbytes = strlen(glyph);
+        if (out) memcpy(out + length, glyph, nbytes);
+        length += nbytes;
+    }
+
+    // the background has to go before the LF, a terminal scrolling up paints the new line with the background in effect
+    if (foreground != SUBCELL_DEFAULT || background != SUBCELL_DEFAULT) {
+        if (out) memcpy(out + length, COLOUR_RESET, sizeof(COLOUR_RESET) - 1);
+        length += sizeof(COLOUR_RESET) - 1;
+    }
+    if (out) out[length] = '\n';
+    return length + 1;
+}
+
+typedef struct {
+        const blockgrid* _grid;
+        long long*       _offsets; // byte offsets of the rows, the first pass stores the length of row r at _offsets[r + 1]
+        char*            _buffer;  // NULL during the first pass
+} halfblockcontext;
+
+// sizes or writes the half block rows [first, last), each from grid rows 2 x row and 2 x row + 1
+static inline void halfblockrows(const void* const restrict _context, const long long first, const long long last) {
+    const halfblockcontext* const context = _context;
+    const blockgrid* const        grid    = context->_grid;
+    for (long long row = first; row < last; ++row) {
+        const blockfixed* const top    = grid->_cells + 2 * row * grid->_columns;
+        const blockfixed* const bottom = 2 * row + 1 < grid->_rows ? top + grid->_columns : NULL;
+        if (context->_buffer)
+            halfblockrow(top, bottom, grid->_columns, context->_buffer + context->_offsets[row]);
+        else
+            context->_offsets[row + 1] = halfblockrow(top, bottom, grid->_columns, NULL);
+    }
+}
+
+// renders the grid in half blocks, two grid rows per row of characters, sized exactly and written in parallel like to_colour_string()
+// returns NULL if anything could not be allocated (errors are reported to stderr), release the string with arenafree()
+static inline char* to_halfblock_string(const blockgrid* const restrict grid, threadpool* const pool, arena* const memory) {
+    const long long  nrows   = (grid->_rows + 1) / 2;
+    long long* const offsets = arenacalloc(memory, nrows + 1, sizeof(long long));
+    if (!offsets) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        return NULL;
+    }
+
+    halfblockcontext context = { ._grid = grid, ._offsets = offsets, ._buffer = NULL };
+    tpoolfor(pool, nrows, halfblockrows, &context);
+    for (long long row = 0; row < nrows; ++row) offsets[row + 1] += offsets[row]; // lengths to offsets
+
+    char* const buffer = arenaalloc(memory, offsets[nrows] + 1); // + 1 for the NULL terminator
+    if (!buffer) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        arenafree(memory, offsets);
+        return NULL;
+    }
+
+    context._buffer = buffer;
+    tpoolfor(pool, nrows, halfblockrows, &context);
+    buffer[offsets[nrows]] = 0;
+    arenafree(memory, offsets);
+    return buffer;
+}
+
+typedef struct {
+        const blockgrid*     _grid;
+        const unsigned char* _levels;    // the offset of every sample (see cpalblockoffset()), in the layout of the grid
+        unsigned             _threshold; // samples at higher offsets raise their dots
+        char*                _buffer;
+} braillecontext;
+
+// writes the braille rows [first, last), each from grid rows 4 x row to 4 x row + 3
+// every cell starts out as the blank pattern U+2800, E2 A0 80 in UTF-8, the eight dots of U+2800 + dots are the low 6 bits of the last
+// byte and the low 2 bits of the middle one, so the dots are ORed straight into the output as the sample rows stream past
+static inline void braillerows(const void* const restrict _context, const long long first, const long long last) {
+    const braillecontext* const context = _context;
+    const blockgrid* const      grid    = context->_grid;
+    const long long             ncells  = (grid->_columns + 1) / 2;
+
+    for (long long row = first; row < last; ++row) {
+        unsigned char* const out = (unsigned char*) context->_buffer + row * (3 * ncells + 1);
+        for (long long cell = 0; cell < ncells; ++cell) memcpy(out + 3 * cell, "\xe2\xa0\x80", 3);
+        out[3 * ncells] = '\n';
+
+        for (long long dy = 0; dy < 4 && 4 * row + dy < grid->_rows; ++dy) { // the last row may have fewer than 4 sample rows
+            const unsigned char* const levels = context->_levels + (4 * row + dy) * grid->_columns;
+            for (long long col = 0; col < grid->_columns; ++col) {
+                const unsigned dot          = levels[col] > context->_threshold ? brailledots[dy][col & 1] : 0;
+                out[3 * (col >> 1) + 1]    |= dot >> 6;
+                out[3 * (col >> 1) + 2]    |= dot & 0x3FU;
+            }
+        }
+    }
+}
+
+// renders the grid in braille patterns, 2 x 4 grid cells per character, with the offsets of the compiled palette as the brightness of
+// the samples. every character is 3 bytes long, so the output is sized up front. returns NULL if anything could not be allocated (errors
+// are reported to stderr), release the string with arenafree()
+static inline char* to_braille_string(
+    const blockgrid* const restrict grid, const cpalette* const restrict cpal, threadpool* const pool, arena* const memory
+) {
+    const long long      nsamples = grid->_columns * grid->_rows;
+    const long long      nrows    = (grid->_rows + 3) / 4;
+    const long long      nbytes   = nrows * (3 * ((grid->_columns + 1) / 2) + 1); // LFs included
+    unsigned char* const levels   = arenaalloc(memory, nsamples);
+    char* const          buffer   = arenaalloc(memory, nbytes + 1);                 // + 1 for the NULL terminator
+    if (!levels || !buffer) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        arenafree(memory, levels);
+        arenafree(memory, buffer);
+        return NULL;
+    }
+
+    // the threshold is the average offset of the samples, so the dots follow the image rather than a fixed level
+    uint64_t total = 0;
+    for (long long i = 0; i < nsamples; ++i) {
+        const blockfixed* const mean = grid->_cells + i;
+        levels[i]                    = cpalblockoffset(
+            cpal,
+            mean->_blue / (float) (1LLU << FIXED_SHIFT),
+            mean->_green / (float) (1LLU << FIXED_SHIFT),
+            mean->_red / (float) (1LLU << FIXED_SHIFT)
+        ); // these divisions are exact, by a power of two
+        total += levels[i];
+    }
+
+    const braillecontext context = { ._grid = grid, ._levels = levels, ._threshold = nsamples ? total / nsamples : 0, ._buffer = buffer };
+    tpoolfor(pool, nrows, braillerows, &context);
+    arenafree(memory, levels);
+    buffer[nbytes] = 0;
+    return buffer;
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// a minimal fixed size pool of worker threads, draining a FIFO queue of jobs
+// jobs are plain function pointers with an opaque argument, the pool does not own the arguments
+
+typedef void (*tpooltask)(void* const arg);
+
+typedef struct {
+        tpooltask _task;
+        void*     _arg;
+} tpooljob;
+
+typedef struct {
+        pthread_mutex_t _lock;
+        pthread_cond_t  _wakeup;      // signalled when a job is queued or when the pool is shutting down
+        pthread_cond_t  _idle;        // broadcast when the last outstanding job completes
+        pthread_t*      _workers;
+        unsigned        _nworkers;
+        tpooljob*       _jobs;        // a ring buffer of queued jobs, grows on demand
+        unsigned long   _capacity;    // number of slots in the ring buffer
+        unsigned long   _head;        // index of the oldest queued job
+        unsigned long   _count;       // number of queued jobs
+        unsigned long   _outstanding; // number of queued + running jobs
+        bool            _shutdown;
+} threadpool;
+
+// number of online processors, the default size of a pool
+static inline unsigned ncores(void) {
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned) n : 1;
+}
+
+static inline void* tpoolworker(void* const _pool) {
+    threadpool* const pool = _pool;
+
+    pthread_mutex_lock(&pool->_lock);
+    for (;;) {
+        while (!pool->_count && !pool->_shutdown) pthread_cond_wait(&pool->_wakeup, &pool->_lock);
+        if (!pool->_count) break; // shutting down and nothing left to do
+
+        const tpooljob job = pool->_jobs[pool->_head];
+        pool->_head        = (pool->_head + 1) % pool->_capacity;
+        pool->_count--;
+
+        pthread_mutex_unlock(&pool->_lock);
+        job._task(job._arg);
+        pthread_mutex_lock(&pool->_lock);
+
+        if (!--pool->_outstanding) pthread_cond_broadcast(&pool->_idle);
+    }
+    pthread_mutex_unlock(&pool->_lock);
+    return NULL;
+}
+
+static inline void tpooldestroy(threadpool* const pool);
+
+// spawns nworkers threads, returns false if the pool could not be set up (errors are reported to stderr)
+static inline bool tpoolcreate(threadpool* const pool, const unsigned nworkers) {
+    assert(nworkers);
+    *pool = (threadpool) { ._nworkers = 0, ._capacity = 64, ._head = 0, ._count = 0, ._outstanding = 0, ._shutdown = false };
+
+    pool->_workers = malloc(sizeof(pthread_t) * nworkers);
+    pool->_jobs    = malloc(sizeof(tpooljob) * pool->_capacity);
+    if (!pool->_workers || !pool->_jobs) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        free(pool->_workers);
+        free(pool->_jobs);
+        return false;
+    }
+
+    pthread_mutex_init(&pool->_lock, NULL);
+    pthread_cond_init(&pool->_wakeup, NULL);
+    pthread_cond_init(&pool->_idle, NULL);
+
+    for (unsigned i = 0; i < nworkers; ++i) {
+        if (pthread_create(pool->_workers + i, NULL, tpoolworker, pool)) {
+            fprintf(stderr, "Error in %s @ line %d: pthread_create failed, continuing with %u workers\n", __FUNCTION__, __LINE__, i);
+            break;
+        }
+        pool->_nworkers++;
+    }
+
+    if (!pool->_nworkers) { // not a single worker, nothing to keep around
+        tpooldestroy(pool);
+        return false;
+    }
+    return true;
+}
+
+// queues a job, returns false only when the queue could not grow
+static inline bool tpoolsubmit(threadpool* const pool, const tpooltask task, void* const arg) {
+    pthread_mutex_lock(&pool->_lock);
+
+    if (pool->_count == pool->_capacity) { // grow the ring buffer, unrolling the wrapped around jobs to the front of the new buffer
+        tpooljob* const jobs = malloc(sizeof(tpooljob) * pool->_capacity * 2);
+        if (!jobs) {
+            pthread_mutex_unlock(&pool->_lock);
+            fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+            return false;
+        }
+        for (unsigned long i = 0; i < pool->_count; ++i) jobs[i] = pool->_jobs[(pool->_head + i) % pool->_capacity];
+        free(pool->_jobs);
+        pool->_jobs      = jobs;
+        pool->_head      = 0;
+        pool->_capacity *= 2;
+    }
+
+    pool->_jobs[(pool->_head + pool->_count) % pool->_capacity] = (tpooljob) { ._task = task, ._arg = arg };
+    pool->_count++;
+    pool->_outstanding++;
+
+    pthread_cond_signal(&pool->_wakeup);
+    pthread_mutex_unlock(&pool->_lock);
+    return true;
+}
+
+// blocks until every job submitted so far has finished
+static inline void tpoolwait(threadpool* const pool) {
+    pthread_mutex_lock(&pool->_lock);
+    while (pool->_outstanding) pthread_cond_wait(&pool->_idle, &pool->_lock);
+    pthread_mutex_unlock(&pool->_lock);
+}
+
+// lets the workers drain the queue, joins them and releases the resources held by the pool
+static inline void tpooldestroy(threadpool* const pool) {
+    pthread_mutex_lock(&pool->_lock);
+    pool->_shutdown = true;
+    pthread_cond_broadcast(&pool->_wakeup);
+    pthread_mutex_unlock(&pool->_lock);
+
+    for (unsigned i = 0; i < pool->_nworkers; ++i) pthread_join(pool->_workers[i], NULL);
+
+    pthread_mutex_destroy(&pool->_lock);
+    pthread_cond_destroy(&pool->_wakeup);
+    pthread_cond_destroy(&pool->_idle);
+    free(pool->_workers);
+    free(pool->_jobs);
+    memset(pool, 0U, sizeof(threadpool));
+}
+
+//////////////////////////////////////////////////////////////////////////////////////
+// banded parallel loops, splits [0, nitems) into contiguous bands and runs them on //
+// the pool, returning only when all the bands are done                             //
+//////////////////////////////////////////////////////////////////////////////////////
+
+typedef void (*tpoolbody)(const void* const restrict context, const long long first, const long long last);
+
+typedef struct {
+        pthread_mutex_t _lock;
+        pthread_cond_t  _done;
+        unsigned long   _remaining; // number of bands yet to complete
+} tpoollatch;
+
+typedef struct {
+        tpoolbody   _body;
+        const void* _context;
+        long long   _first, _last; // NOLINT(readability-isolate-declaration)
+        tpoollatch* _latch;
+} tpoolband;
+
+static inline void tpoolrunband(void* const _band) {
+    const tpoolband* const band = _band;
+    band->_body(band->_context, band->_first, band->_last);
+
+    pthread_mutex_lock(&band->_latch->_lock);
+    if (!--band->_latch->_remaining) pthread_cond_signal(&band->_latch->_done);
+    pthread_mutex_unlock(&band->_latch->_lock);
+}
+
+// a NULL pool, or a range too small to be worth splitting, runs the body on the calling thread
+// the bands are oversubscribed (a few per worker) so that uneven bands don't leave workers idling at the end
+// waits on its own latch rather than on the whole pool, so concurrent callers sharing a pool don't wait on each other's bands
+// CAUTION  must not be called from inside a job running on the same pool, that can deadlock once all the workers are waiting
+static inline void tpoolfor(threadpool* const pool, const long long nitems, const tpoolbody body, const void* const restrict context) {
+    if (nitems <= 0) return;
+    if (!pool || pool->_nworkers < 2 || nitems < 2) {
+        body(context, 0, nitems);
+        return;
+    }
+
+    const long long  nbands = nitems < pool->_nworkers * 4LL ? nitems : pool->_nworkers * 4LL;
+    tpoolband* const bands  = malloc(sizeof(tpoolband) * nbands);
+    if (!bands) { // no room for the bookkeeping, just do it here
+        body(context, 0, nitems);
+        return;
+    }
+
+    tpoollatch latch = { ._remaining = nbands };
+    pthread_mutex_init(&latch._lock, NULL);
+    pthread_cond_init(&latch._done, NULL);
+
+    long long submitted = 0;
+    for (long long i = 0; i < nbands; ++i) {
+        // band boundaries are spread evenly, so band sizes differ by at most 1
+        bands[i] = (tpoolband) { ._body    = body,
+                                 ._context = context,
+                                 ._first   = nitems * i / nbands,
+                                 ._last    = nitems * (i + 1) / nbands,
+                                 ._latch   = &latch };
+        if (!tpoolsubmit(pool, tpoolrunband, bands + i)) break;
+        submitted++;
+    }
+
+    // bands that could not be queued are run here, the latch only counts the ones that made it to the queue
+    if (submitted < nbands) {
+        pthread_mutex_lock(&latch._lock);
+        latch._remaining -= nbands - submitted;
+        pthread_mutex_unlock(&latch._lock);
+        for (long long i = submitted; i < nbands; ++i) body(context, bands[i]._first, bands[i]._last);
+    }
+
+    pthread_mutex_lock(&latch._lock);
+    while (latch._remaining) pthread_cond_wait(&latch._done, &latch._lock);
+    pthread_mutex_unlock(&latch._lock);
+
+    pthread_mutex_destroy(&latch._lock);
+    pthread_cond_destroy(&latch._done);
+    free(bands);
+}
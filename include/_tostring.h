@@ -1,38 +1,93 @@
 #pragma once
 #include <_bitmap.h>
+#include <_cpalette.h>
+#include <_kernels.h>
+#include <_rle.h>
+#include <_threadpool.h>
+#include <_unpack.h>
 
 #define CONSOLE_WIDTH              140LL
 #define CONSOLE_WIDTHR             140.0
+#define PREFETCH_SCANLINES         64LL // NUMBER OF SCANLINES to_raw_string ASKS THE KERNEL TO PREFETCH AT A TIME, FOR MEMORY MAPPED BITMAPS
 
 ////////////////////////////////////
 //    PLACE FOR CUSTOMIZATIONS    //
 ////////////////////////////////////
-#define spalette                   palette                                                    // PICK ONE OF THE THREE AVALIABLE PALETTES
-#define map(_pixel)                weighted_mapper(_pixel, spalette, __crt_countof(spalette)) // CHOOSE A BASIC MAPPER OF YOUR LIKING
+#define spalette                   palette_base // PICK ONE OF THE THREE AVALIABLE PALETTES
+#define smapper                    WEIGHTED     // CHOOSE A MAPPER KIND OF YOUR LIKING (ARITHMETIC, WEIGHTED, MINMAX OR LUMINOSITY)
 
-// CHOOSE A BLOCK MAPPER OF YOUR LIKING
-#define blockmap(blue, green, red) weighted_blockmapper(blue, green, red, spalette, __crt_countof(spalette))
+// THE MAPPERS ARE COMPILED INTO A LOOKUP TABLE (SEE <_cpalette.h>) ONCE PER CONVERSION, blockmap() EXPECTS A POINTER TO IT NAMED cpal
+// to_raw_string MAPS WHOLE SCANLINES WITH THE VECTORIZED KERNELS IN <_kernels.h>, USING THE SAME COMPILED PALETTE
+// PIXELS ARE READ IN THEIR ON DISK FORMAT BY THE UNPACKERS IN <_unpack.h>, COMPILED ONCE PER CONVERSION TOO
+#define blockmap(blue, green, red) cpalblockmap(cpal, blue, green, red)
 
-// IT IS NOT OBLIGATORY FOR BOTH THE BASIC MAPPER AND THE BLOCK MAPPER TO USE THE SAME PALETTE
-// IF NEED BE, THE PALETTE EXPANDED FROM spalette COULD BE REPLACED BY A REAL PALETTE NAME
+// IT IS NOT OBLIGATORY FOR BOTH THE RAW CONVERSION AND THE BLOCK MAPPER TO USE THE SAME PALETTE
+// IF NEED BE, COMPILE A SEPARATE cpalette FOR THE BLOCK MAPPER WITH A DIFFERENT PALETTE OR MAPPER KIND
 
-static inline char* to_raw_string(const bitmap* const restrict image) {
-    if (image->_infoheader.biHeight < 0) {
-        fputs("Error in to_raw_string, this tool does not support bitmaps with top-down pixel ordering!\n", stderr);
-        return NULL;
+// BOTH CONVERTERS TAKE AN OPTIONAL THREAD POOL (SEE <_threadpool.h>), EVERY ROW OF THE OUTPUT IS INDEPENDENT OF THE OTHERS AND LANDS AT AN
+// OFFSET THAT IS KNOWN UP FRONT, SO THE OUTPUT IS SPLIT INTO HORIZONTAL BANDS OF ROWS AND EACH BAND IS WRITTEN STRAIGHT INTO THE BUFFER
+// BY WHICHEVER WORKER PICKS IT UP, THERE'S NO MERGE STEP. PASSING A NULL POOL DOES THE WHOLE CONVERSION ON THE CALLING THREAD
+
+// BOTH CONVERTERS WORK ON VIEWS (SEE imview IN <_bitmap.h>), SO TOP DOWN AND BOTTOM UP BITMAPS GO THROUGH THE SAME CODE, AND A CROP OF AN
+// IMAGE (SEE imcrop()) CAN BE CONVERTED WITHOUT COPYING IT. to_string() CONVERTS A VIEW OF THE WHOLE BITMAP
+
+// ALL CONVERTERS TAKE AN OPTIONAL ARENA (SEE <_arena.h>) TOO, THE RETURNED STRING, THE ACCUMULATORS AND THE TABLES OF THE UNPACKER ALL COME
+// FROM IT. RELEASE THE STRING WITH arenafree(), WHICH ONLY DOES ANYTHING FOR A NULL ARENA I.E THE HEAP
+
+// AND AN OPTIONAL COMPILED PALETTE, A NULL ONE COMPILES THE PALETTE OF smapper AND spalette FOR THE CONVERSION. A LONG RUNNING PROCESS
+// THAT RENDERS WITH SEVERAL PALETTES (SEE <_server.h>) COMPILES EACH OF THEM ONCE AND PASSES IT IN
+
+// the compiled palette a conversion maps with, cpal unless it's NULL, in which case the palette of smapper and spalette is compiled into
+// fallback
+static inline const cpalette* cpalpick(const cpalette* const cpal, cpalette* const fallback) {
+    if (cpal) return cpal;
+    *fallback = cpalcompile(smapper, spalette, sizeof(spalette));
+    return fallback;
+}
+
+typedef struct {
+        const imview*   _view;
+        const cpalette* _cpal;
+        const unpacker* _unpack;
+        char*           _buffer;
+} rawcontext;
+
+// maps output rows [first, last), output rows are numbered top to bottom
+static inline void rawrows(const void* const restrict _context, const long long first, const long long last) {
+    const rawcontext* const context = _context;
+    const long long         width   = context->_view->_width;
+
+    for (long long row = first; row < last; ++row) {
+        // every so often, let the kernel know which scanlines come next
+        if (!((row - first) % PREFETCH_SCANLINES)) imwillneed(context->_view, row, row + 2 * PREFETCH_SCANLINES);
+        char* const out = context->_buffer + row * (width + 1); // + 1 for the newline at the end of each row
+        // map the whole scanline, left to right, with the unpacker for the pixel format of the image
+        mapscanline(context->_unpack, imscanline(context->_view, row), width, context->_cpal, out);
+        // at the end of each scanline, append a LF!
+        out[width] = '\n';
     }
+}
 
-    const long long npixels = (long long) image->_infoheader.biHeight * image->_infoheader.biWidth; // total pixels in the image
-    const long long nwchars /* 1 wchar_t for each pixel + 2 additional wchar_ts for CRLF at the end of each scanline */ =
-        npixels + 2LLU * image->_infoheader.biHeight;
-    // space for two extra wchar_ts (L'\r', L'\n') to be appended to the end of each line
+static inline char* to_raw_string(
+    const imview* const restrict view, const cpalette* const cpal, threadpool* const pool, arena* const memory
+) {
+    const long long npixels = view->_height * view->_width; // total pixels in the view
+    const long long nchars /* 1 char for each pixel + 1 additional char for the LF at the end of each scanline */ = npixels + view->_height;
 
-    char* const restrict buffer = malloc(nwchars + 1); // and the +1 is for the NULL terminator
+    char* const restrict buffer = arenaalloc(memory, nchars + 1); // and the +1 is for the NULL terminator
     if (!buffer) {
         fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
         return NULL;
     }
 
+    cpalette              fallback = { 0 };
+    const cpalette* const compiled = cpalpick(cpal, &fallback);
+    unpacker              unpack   = { 0 };
+    if (!unpackcompile(&unpack, view->_headers, view->_infoheader, compiled, memory)) {
+        arenafree(memory, buffer);
+        return NULL;
+    }
+
     // pixels are organized in rows from bottom to top and, within each row, from left to right, each row is called a "scan line".
     // if the image height is given as a negative number, then the rows are ordered from top to bottom (in most contemporary .BMP images, the pixel ordering seems to be bottom up)
     // (pixel at the top left corner of the image)
@@ -40,202 +95,374 @@ static inline char* to_raw_string(const bitmap* const restrict image) {
     //                                            .............................
     // this is the first pixel in the buffer -->  00 01 02 03 04 05 06 07 08 09
     // (pixel at the top left corner of the image)
+    // the view takes care of this, its rows are always numbered top to bottom
 
-    long long caret = 0;
-    // presuming pixels are ordered bottom up, start the traversal from the last pixel and move up.
-    // traverse up along the height, for each row, starting with the last row,
-    for (long long nrows = image->_infoheader.biHeight - 1LL; nrows >= 0; --nrows) {
-        // traverse left to right inside "scan lines"
-        for (long long ncols = 0; ncols < image->_infoheader.biWidth; ++ncols) // for each pixel in the row,
-            buffer[caret++] = map(&image->_pixels[nrows * image->_infoheader.biWidth + ncols]);
-        // at the end of each scanline, append a CRLF!
-        buffer[caret++] = L'\n';
-        // buffer[caret++] = L'\r';
-    }
-
-    buffer[caret] = 0; // null termination of the string
+    const rawcontext context = { ._view = view, ._cpal = compiled, ._unpack = &unpack, ._buffer = buffer };
+    tpoolfor(pool, view->_height, rawrows, &context);
+    unpackfree(&unpack);
 
-    assert(caret == nwchars);
+    buffer[nchars] = 0; // null termination of the string
     return buffer;
 }
 
-// generate the wchar_t buffer after downscaling the image such that the ascii representation will fit the terminal width (~142 chars),
-// downscaling is completely predicated only on the image width, and the proportionate scaling factor will be used to scale down the image vertically too.
-// downscaling needs to be done in square pixel blocks which will be represented by a single wchar_t
-static inline char* to_downscaled_string(const bitmap* const restrict image) {
-    if (image->_infoheader.biHeight < 0) {
-        fputs("Error in to_downscaled_string, this tool does not support bitmaps with top-down pixel ordering!\n", stderr);
-        return NULL;
-    }
+// block sums are accumulated in integers, float accumulators silently start dropping low order bits once a block holds more than ~65k
+// pixels (255 x 65793 > 2 ^ 24, the largest float with a unit resolution) and their results depend on the order of the additions
+// the averages are fixed point numbers with FIXED_SHIFT fractional bits, computed exactly as floor((sum << FIXED_SHIFT) / blocksize)
+// 255 << 16 is below 2 ^ 24, so every fixed point average converts to a float without any loss
+#define FIXED_SHIFT 16
+
+// exact unsigned division by a runtime constant, through a precomputed 64 bit reciprocal
+// with reciprocal = floor(2 ^ 64 / divisor), (dividend * reciprocal) >> 64 is either the exact quotient or one short of it, for any 64 bit
+// dividend, so a single compare fixes it up. a multiply is considerably cheaper than a 64 bit division on every x86 core out there
+typedef struct {
+        uint64_t _divisor;
+        uint64_t _reciprocal;
+} reciprocal;
+
+static inline reciprocal rcpcompute(const uint64_t divisor) {
+    assert(divisor);
+    // 2 ^ 64 / 1 doesn't fit in 64 bits, 2 ^ 64 - 1 still satisfies the "at most one short" guarantee
+    return (reciprocal) { ._divisor    = divisor,
+                          ._reciprocal = divisor == 1 ? UINT64_MAX : (uint64_t) (((unsigned __int128) 1 << 64) / divisor) };
+}
 
-    const long long block_d /* dimension of an individual square block */ = ceill(image->_infoheader.biWidth / CONSOLE_WIDTHR);
+static inline uint64_t rcpdivide(const uint64_t dividend, const reciprocal rcp) {
+    uint64_t quotient  = (uint64_t) (((unsigned __int128) dividend * rcp._reciprocal) >> 64);
+    quotient          += (dividend - quotient * rcp._divisor) >= rcp._divisor;
+    return quotient;
+}
 
-    const float blocksize /* number of pixels in a block */               = block_d * block_d; // since our blocks are square
+// the average colour of a block, as fixed point numbers with FIXED_SHIFT fractional bits, 255 << FIXED_SHIFT fits in 32 bits
+typedef struct {
+        uint32_t _blue, _green, _red; // NOLINT(readability-isolate-declaration)
+} blockfixed;
+
+// the average colour of a block, given the sums of its pixels and the reciprocal of its size in pixels
+static inline blockfixed blockmean(const blocksum* const restrict sum, const reciprocal blocksize) {
+    const uint64_t blue  = rcpdivide(sum->_blue << FIXED_SHIFT, blocksize);
+    const uint64_t green = rcpdivide(sum->_green << FIXED_SHIFT, blocksize);
+    const uint64_t red   = rcpdivide(sum->_red << FIXED_SHIFT, blocksize);
+    assert(blue <= (255LLU << FIXED_SHIFT) && green <= (255LLU << FIXED_SHIFT) && red <= (255LLU << FIXED_SHIFT));
+    return (blockfixed) { ._blue = blue, ._green = green, ._red = red };
+}
 
-    long long pblocksize_right = // number of pixels in each block in the rightmost column of incomplete blocks.
-        // width of the image - (number of complete blocks * block dimension) will give the residual pixels along the horizontal axis
-        // multiply that by block domension again, and we'll get the number of pixels in the incomplete block
-        (image->_infoheader.biWidth -
-         (image->_infoheader.biWidth / block_d) /* deliberate integer division to get only the count of complete blocks */ * block_d) *
-        block_d;
-    assert(pblocksize_right < blocksize);
+// maps the average colour of a block to a character
+static inline char blockfixedmap(const blockfixed* const restrict mean, const cpalette* const restrict cpal) {
+    return blockmap(
+        mean->_blue / (float) (1LLU << FIXED_SHIFT),
+        mean->_green / (float) (1LLU << FIXED_SHIFT),
+        mean->_red / (float) (1LLU << FIXED_SHIFT)
+    ); // these divisions are exact, by a power of two
+}
 
-    // the block size to represent the number of pixels held by the last row blocks
-    long long pblocksize_bottom = (image->_infoheader.biHeight - (image->_infoheader.biHeight / block_d) * block_d) * block_d;
-    assert(pblocksize_bottom < blocksize);
+// maps the average colour of a block to a character, given the sums of its pixels and the reciprocal of its size in pixels
+static inline char blockaverage(const blocksum* const restrict sum, const reciprocal blocksize, const cpalette* const restrict cpal) {
+    const blockfixed mean = blockmean(sum, blocksize);
+    return blockfixedmap(&mean, cpal);
+}
 
-    const long long nblocks_w   = ceill(image->_infoheader.biWidth / (float) block_d);
-    const long long nblocks_h   = ceill(image->_infoheader.biHeight / (float) block_d);
+// maps a block row of nscanlines folded scanlines to nblocks_w characters followed by a newline, and resets the sums for the next block row
+static inline void flushblockrow(
+    blocksum* const restrict       sums,
+    const long long                width,
+    const long long                block_d,
+    const long long                nscanlines,
+    const cpalette* const restrict cpal, // used by blockmap()
+    char* const restrict           out
+) {
+    // a block row has at most two distinct block sizes, the complete blocks and the incomplete one at the right edge
+    const reciprocal complete   = rcpcompute(nscanlines * block_d);
+    const reciprocal incomplete = rcpcompute(nscanlines * (width % block_d ? width % block_d : block_d));
+
+    long long bcol              = 0;
+    for (long long col = 0; col < width; col += block_d, ++bcol) {
+        out[bcol]  = blockaverage(sums + bcol, col + block_d <= width ? complete : incomplete, cpal);
+        sums[bcol] = (blocksum) { 0, 0, 0 };
+    }
+    out[bcol] = '\n';
+}
+
+typedef struct {
+        const imview*   _view;
+        const cpalette* _cpal;
+        const unpacker* _unpack;
+        char*           _buffer;
+        blocksum*       _sums;      // nblocks_w running sums for every block row, so concurrent bands never share sums
+        long long       _block_w;   // width of an individual block
+        long long       _block_h;   // height of an individual block, the same as _block_w for square blocks
+        long long       _nblocks_w; // number of blocks along the x axis, including the incomplete block at the right edge, if any
+} downscaledcontext;
+
+// maps block rows [first, last) of the output, block rows are numbered top to bottom
+// rather than reducing one block_d x block_d block at a time, which jumps a whole scanline stride for every row of every block,
+// each scanline of the block row is streamed through exactly once, left to right, adding its pixels into the sums of the block columns
+// they fall in. when the block row is complete, the sums are averaged and mapped in one go (see foldscanline() and flushblockrow())
+// blocks at the right and bottom edges may be incomplete, they are averaged over the pixels they actually cover
+// the scanlines are folded two at a time (see foldscanlinepair()), block rows with an odd number of them fold the last one on its own
+static inline void downscaledrows(const void* const restrict _context, const long long first, const long long last) {
+    const downscaledcontext* const context = _context;
+    const long long                width   = context->_view->_width;
+    const long long                block_w = context->_block_w;
+    const long long                block_h = context->_block_h;
+
+    for (long long brow = first; brow < last; ++brow) {
+        const long long top    = brow * block_h;                            // the first scanline of the block row
+        const long long bottom = min(top + block_h, context->_view->_height); // the last block row may have fewer than block_h scanlines
+        blocksum* const sums   = context->_sums + brow * context->_nblocks_w;
+
+        // ask for the scanlines of the next block row while this one is being reduced, and for this one too if it's the first of the band
+        imwillneed(context->_view, brow == first ? top : bottom, bottom + block_h);
+
+        long long r = top;
+        for (; r + 1 < bottom; r += 2)
+            foldscanlinepair(context->_unpack, imscanline(context->_view, r), imscanline(context->_view, r + 1), width, block_w, sums);
+        if (r < bottom) foldscanline(context->_unpack, imscanline(context->_view, r), width, block_w, sums);
+        flushblockrow(sums, width, block_w, bottom - top, context->_cpal, context->_buffer + brow * (context->_nblocks_w + 1));
+    }
+}
+
+// reduces the view in block_w x block_h blocks, a character per block and a LF per block row, see to_downscaled_string()
+static inline char* downscale(
+    const imview* const restrict view,
+    const long long              block_w,
+    const long long              block_h,
+    const cpalette* const        cpal,
+    threadpool* const            pool,
+    arena* const                 memory
+) {
+    // incomplete blocks at the right and bottom edges count as whole blocks
+    const long long nblocks_w = (view->_width + block_w - 1) / block_w;
+    const long long nblocks_h = (view->_height + block_h - 1) / block_h;
 
     // we have to compute the average R, G & B values for all pixels inside each pixel blocks and use the average to represent
-    // that block as a wchar_t. one wchar_t in our buffer will have to represent (block_w x block_h) number of RGBQUADs
-    const long long nwchars     = nblocks_h * (nblocks_w + 2) + 1; // saving two wide chars for CRLF!, the +1 is for the NULL terminator
+    // that block as a char. one char in our buffer will have to represent (block_w x block_h) number of RGBQUADs
+    const long long nchars    = nblocks_h * (nblocks_w + 1) + 1; // saving one char for the LF!, the +1 is for the NULL terminator
 
-    char* const restrict buffer = malloc(nwchars);
+    char* const restrict buffer = arenaalloc(memory, nchars);
     if (!buffer) {
         fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
         return NULL;
     }
 
-    // NOLINTBEGIN(readability-isolate-declaration)
-    float blockavg_blue = 0.0F, blockavg_green = 0.0F, blockavg_red = 0.0F; // per block averages of the rgbBlue, rgbGreen and rgbRed values
-    long long  caret = 0, offset = 0, col = 0, row = 0;
-    const bool block_rows_end_with_incomplete_blocks =
-        image->_infoheader.biWidth % CONSOLE_WIDTH; // true if the image width is not divisible by 140 without remainders
-    const bool block_columns_end_with_incomplete_blocks =
-        image->_infoheader.biHeight % block_d; // true if the image height is not divisible by block_d without remainders
-    // NOLINTEND(readability-isolate-declaration)
-
-    __printf_debug("Width :: %6ld, Height :: %6ld\n", image->_infoheader.biWidth, image->_infoheader.biHeight);
-    __printf_debug("Size of the square block :: %6lld\n", block_d);
+    blocksum* const sums = arenacalloc(memory, nblocks_w * nblocks_h, sizeof(blocksum));
+    if (!sums) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        arenafree(memory, buffer);
+        return NULL;
+    }
+
+    cpalette              fallback = { 0 };
+    const cpalette* const compiled = cpalpick(cpal, &fallback);
+    unpacker              unpack   = { 0 };
+    if (!unpackcompile(&unpack, view->_headers, view->_infoheader, compiled, memory)) {
+        arenafree(memory, sums);
+        arenafree(memory, buffer);
+        return NULL;
+    }
+
+    __printf_debug("Width :: %6lld, Height :: %6lld\n", view->_width, view->_height);
+    __printf_debug("Size of the block (w, h) :: (%3lld, %3lld)\n", block_w, block_h);
     __printf_debug("Number of blocks along the x axis :: %6lld\n", nblocks_w);
-    __printf_debug(
-        "Dimension of the incomplete block along the x axis (w, h) :: (%3lld, %3lld)\n",
-        image->_infoheader.biWidth - (image->_infoheader.biWidth / block_d) * block_d,
-        nblocks_w
-    );
     __printf_debug("Number of blocks along the y axis :: %6lld\n", nblocks_h);
     __printf_debug(
-        "Dimension of the incomplete block along the y axis (w, h) :: (%3lld, %3lld)\n",
-        nblocks_w,
-        image->_infoheader.biHeight - (image->_infoheader.biHeight / block_d) * block_d
+        "Dimension of the incomplete block at the bottom right corner (w, h) :: (%3lld, %3lld)\n",
+        view->_width - (nblocks_w - 1) * block_w,
+        view->_height - (nblocks_h - 1) * block_h
     );
 
-    unsigned long long full = 0, incomplete = 0, count = 0; // NOLINT(readability-isolate-declaration)
-
-    // row = image->_infoheader.biHeight will get us to the last pixel of the first (last in the buffer) scanline with (r * image->_infoheader.biWidth)
-    // hence, row = image->_infoheader.biHeight - 1 so we can traverse pixels in the first scanline with (r * image->_infoheader.biWidth) + c
-    for (row = image->_infoheader.biHeight - 1; row >= (block_d - 1); row -= block_d) { // start the traversal at the bottom most scan line
-                                                                                        // wprintf_s(L"row = %lld\n", row);
-        for (col = 0; col <= image->_infoheader.biWidth - block_d; col += block_d) {    // traverse left to right in scan lines
-            // wprintf_s(L"row = %lld, col = %lld\n", row, col);
-
-            for (long long r = row; r > row - block_d; --r) { // deal with blocks
-                for (long long c = col; c < col + block_d; ++c) {
-                    offset          = (r * image->_infoheader.biWidth) + c;
-                    blockavg_blue  += image->_pixels[offset].rgbBlue;
-                    blockavg_green += image->_pixels[offset].rgbGreen;
-                    blockavg_red   += image->_pixels[offset].rgbRed;
-
-                    DEBUG_EXEC(count++);
-                }
-            }
+    const downscaledcontext context = { ._view      = view,
+                                        ._cpal      = compiled,
+                                        ._unpack    = &unpack,
+                                        ._buffer    = buffer,
+                                        ._sums      = sums,
+                                        ._block_w   = block_w,
+                                        ._block_h   = block_h,
+                                        ._nblocks_w = nblocks_w };
+    tpoolfor(pool, nblocks_h, downscaledrows, &context);
+    unpackfree(&unpack);
+    arenafree(memory, sums);
+
+    buffer[nchars - 1] = 0; // using the last byte as null terminator
+    return buffer;
+}
 
-            DEBUG_EXEC(full++);
-            assert(count == block_d * block_d);
-            DEBUG_EXEC(count = 0);
+// generate the char buffer after downscaling the image such that the ascii representation will fit the terminal width (~142 chars),
+// downscaling is completely predicated only on the image width, and the proportionate scaling factor will be used to scale down the image vertically too.
+// downscaling needs to be done in square pixel blocks which will be represented by a single char
+static inline char* to_downscaled_string(
+    const imview* const restrict view, const cpalette* const cpal, threadpool* const pool, arena* const memory
+) {
+    const long long block_d /* dimension of an individual square block */ = ceill(view->_width / CONSOLE_WIDTHR);
+    return downscale(view, block_d, block_d, cpal, pool, memory);
+}
 
-            blockavg_blue  /= blocksize;
-            blockavg_green /= blocksize;
-            blockavg_red   /= blocksize;
+// to_downscaled_string() in blocks shaped like the character cells of the terminal, aspect_w wide and aspect_h tall, so the image keeps
+// its proportions. cells are about twice as tall as they are wide, a 1 : 2 block takes the square block of to_downscaled_string() and
+// stacks another one under it, which halves the number of rows (and of characters) and undoes the vertical stretch
+// the blocks are as wide as the square ones, so narrow views aren't left to to_raw_string() here, they are reduced in 1 pixel wide blocks
+static inline char* to_aspect_string(
+    const imview* const restrict view,
+    const long long              aspect_w,
+    const long long              aspect_h,
+    const cpalette* const        cpal,
+    threadpool* const            pool,
+    arena* const                 memory
+) {
+    assert(aspect_w > 0 && aspect_h > 0);
+    const long long block_w = ceill(view->_width / CONSOLE_WIDTHR);
+    const long long block_h = max(llroundl(block_w * (long double) aspect_h / aspect_w), 1LL);
+    return downscale(view, block_w, block_h, cpal, pool, memory);
+}
 
-            assert(blockavg_blue <= 255.00 && blockavg_green <= 255.00 && blockavg_red <= 255.00);
+// the state of a conversion of a run length encoded bitmap, the spans reported by the decoder go straight into the block sums
+// narrow images are mapped pixel by pixel i.e reduced with 1 x 1 blocks, just like to_streamed_string does
+typedef struct {
+        const unpacker* _unpack; // the colour table, the RLE decoder reports colour indices
+        const cpalette* _cpal;
+        char*           _buffer;
+        blocksum*       _sums;      // the sums of a single block row, the decoder visits scanlines in order, so one is all it takes
+        long long       _width;
+        long long       _height;
+        long long       _block_d;
+        long long       _nblocks_w;
+        long long       _brow; // the block row being reduced, block rows are numbered top to bottom
+        arena*          _arena;
+} rlecontext;
+
+static inline void rleflush(rlecontext* const restrict context) {
+    flushblockrow(
+        context->_sums,
+        context->_width,
+        context->_block_d,
+        min(context->_block_d, context->_height - context->_brow * context->_block_d), // the bottom block row may be incomplete
+        context->_cpal,
+        context->_buffer + context->_brow * (context->_nblocks_w + 1)
+    );
+}
 
-            buffer[caret++] = blockmap(blockavg_blue, blockavg_green, blockavg_red);
-            blockavg_blue = blockavg_green = blockavg_red = 0.000;
+// an rlesink, adds a span to the sums of the block columns it covers, the whole span at once i.e count x colour per block column
+// the block row is flushed as soon as the decoder moves past it
+static inline void rlespan(
+    void* const restrict _context,
+    long long            y,
+    long long            nrows,
+    const long long      x,
+    const long long      count,
+    const unsigned char  even,
+    const unsigned char  odd
+) {
+    rlecontext* const context = _context;
+    const long long   block_d = context->_block_d;
+    const RGBQUAD     ecolour = context->_unpack->_colors[even]; // colour of the pixels at an even distance from x
+    const RGBQUAD     ocolour = context->_unpack->_colors[odd];
+
+    while (nrows > 0) {
+        const long long brow = (context->_height - 1 - y) / block_d;
+        if (brow != context->_brow) { // the decoder has moved on to the next block row up
+            rleflush(context);
+            context->_brow = brow;
         }
 
-        if (block_rows_end_with_incomplete_blocks) { // if there are partially filled blocks at the end of this row of blocks,
-
-            for (long long r = row; r > row - block_d; --r) {
-                // shift the column delimiter backward by one block, to the end of the last complete block
-                for (long long c = col; c < image->_infoheader.biWidth; ++c) { // start from the end of the last complete block
-                    offset          = (r * image->_infoheader.biWidth) + c;
-                    blockavg_blue  += image->_pixels[offset].rgbBlue;
-                    blockavg_green += image->_pixels[offset].rgbGreen;
-                    blockavg_red   += image->_pixels[offset].rgbRed;
-
-                    DEBUG_EXEC(count++);
-                }
-            }
-
-            DEBUG_EXEC(incomplete++);
-            assert(count == pblocksize_right); // fails
-            DEBUG_EXEC(count = 0);
-
-            blockavg_blue  /= pblocksize_right;
-            blockavg_green /= pblocksize_right;
-            blockavg_red   /= pblocksize_right;
-
-            assert(blockavg_blue <= 255.00 && blockavg_green <= 255.00 && blockavg_red <= 255.00);
-
-            buffer[caret++] = blockmap(blockavg_blue, blockavg_green, blockavg_red);
-            blockavg_blue = blockavg_green = blockavg_red = 0.000; // reset the block averages
+        const long long rows = min(nrows, context->_height - brow * block_d - y); // scanlines of the span inside this block row
+        for (long long bcol = x / block_d; bcol * block_d < x + count; ++bcol) {
+            // the part of the span inside this block column, [first, last) relative to x, so parity tells the colour apart
+            const long long first = max(bcol * block_d, x) - x;
+            const long long last  = min((bcol + 1) * block_d, x + count) - x;
+            const uint64_t  neven = rows * ((last + 1) / 2 - (first + 1) / 2);
+            const uint64_t  nodd  = rows * (last - first) - neven;
+            context->_sums[bcol]._blue  += neven * ecolour.rgbBlue + nodd * ocolour.rgbBlue;
+            context->_sums[bcol]._green += neven * ecolour.rgbGreen + nodd * ocolour.rgbGreen;
+            context->_sums[bcol]._red   += neven * ecolour.rgbRed + nodd * ocolour.rgbRed;
         }
 
-        buffer[caret++] = L'\n';
-        // buffer[caret++] = L'\r';
+        y     += rows;
+        nrows -= rows;
     }
+}
 
-    __printf_debug("%5llu complete blocks have been processed!\n", full);
-    __printf_debug("%5llu incomplete blocks at the right edge have been processed\n", incomplete);
-    assert(row < block_d);
-    DEBUG_EXEC(incomplete = 0);
-
-    if (block_columns_end_with_incomplete_blocks) { // process the last incomplete row of pixel blocks here,
-
-        for (col = 0; col < image->_infoheader.biWidth; col += block_d) { // col must be 0 at the start of this loop
-
-            for (long long r = row; r >= 0; --r) {                // r delimits the start row of the block being defined
-                for (long long c = col; c < col + block_d; ++c) { // c delimits the start column of the block being defined
-                    offset          = (r * image->_infoheader.biWidth) + c;
-                    blockavg_blue  += image->_pixels[offset].rgbBlue;
-                    blockavg_green += image->_pixels[offset].rgbGreen;
-                    blockavg_red   += image->_pixels[offset].rgbRed;
-                }
-            }
-
-            blockavg_blue  /= pblocksize_bottom;
-            blockavg_green /= pblocksize_bottom;
-            blockavg_red   /= pblocksize_bottom;
-
-            DEBUG_EXEC(incomplete++);
-
-            // if (!(blockavg_blue <= 255.00 && blockavg_green <= 255.00 && blockavg_red <= 255.00))
-            //     wprintf_s(L"Average (BGR) = (%.4f, %.4f, %.4f)\n", blockavg_blue, blockavg_green, blockavg_red);
-
-            assert(blockavg_blue <= 255.00 && blockavg_green <= 255.00 && blockavg_red <= 255.00);
-            buffer[caret++] = blockmap(blockavg_blue, blockavg_green, blockavg_red);
-            blockavg_blue = blockavg_green = blockavg_red = 0.000; // reset the block averages
-        }
+// allocates the output buffer, the sums and the colour table of an RLE conversion, returns false on failure (errors are reported to stderr)
+// imstream must hold the headers and the colour table of the bitmap, see bmpsupported(). cpal must outlive the conversion
+static inline bool rlebegin(
+    rlecontext* const restrict             context,
+    unpacker* const restrict               unpack,
+    const unsigned char* const restrict    imstream,
+    const BITMAPINFOHEADER* const restrict infhead,
+    const cpalette* const restrict         cpal,
+    arena* const restrict                  memory
+) {
+    const long long width     = infhead->biWidth;
+    const long long height    = infhead->biHeight;
+    const long long block_d   = width <= CONSOLE_WIDTH ? 1 : ceill(width / CONSOLE_WIDTHR);
+    const long long nblocks_w = (width + block_d - 1) / block_d;
+    const long long nblocks_h = (height + block_d - 1) / block_d;
+
+    *context                  = (rlecontext) { ._unpack    = unpack,
+                                               ._cpal      = cpal,
+                                               ._buffer    = arenaalloc(memory, nblocks_h * (nblocks_w + 1) + 1), // LFs and a NUL
+                                               ._sums      = arenacalloc(memory, nblocks_w, sizeof(blocksum)),
+                                               ._width     = width,
+                                               ._height    = height,
+                                               ._block_d   = block_d,
+                                               ._nblocks_w = nblocks_w,
+                                               ._brow      = nblocks_h - 1, // the bottom block row comes first
+                                               ._arena     = memory };
+    if (!context->_buffer || !context->_sums) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        arenafree(memory, context->_buffer);
+        arenafree(memory, context->_sums);
+        return false;
+    }
 
-        buffer[caret++] = '\n';
-        // buffer[caret++] = '\r';
+    if (!unpackcompile(unpack, imstream, infhead, cpal, memory)) {
+        arenafree(memory, context->_buffer);
+        arenafree(memory, context->_sums);
+        return false;
     }
 
-    buffer[caret++] = 0; // using the last byte as null terminator
+    context->_buffer[nblocks_h * (nblocks_w + 1)] = 0;
+    return true;
+}
+
+// reports the pixels the stream did not get to, flushes the last block row and releases everything but the returned string
+static inline char* rleend(rlecontext* const restrict context, unpacker* const restrict unpack, rlecursor* const restrict cursor) {
+    const BITMAPINFOHEADER dimensions = { .biWidth = context->_width, .biHeight = context->_height }; // all rlemove() needs to know
+    rlemove(cursor, 0, context->_height, &dimensions, rlespan, context);
+    assert(!context->_brow);
+    rleflush(context);
 
-    // now caret == nwchars, so an attempt to write at caret will now raise an access violation exception or a heap corruption error
+    unpackfree(unpack);
+    arenafree(context->_arena, context->_sums);
+    return context->_buffer;
+}
 
-    __printf_debug("%5llu incomplete blocks at the bottom have been processed\n", incomplete);
-    __printf_debug("caret :: %lld, nwchars :: %lld\n", caret, nwchars);
-    assert(caret == nwchars);
+// run length encoded bitmaps are decoded and reduced in a single pass over the compressed stream (see <_rle.h>), on the calling thread
+// the codes can't be located without decoding everything before them, so there's nothing to split across a pool
+static inline char* to_rle_string(const bitmap* const restrict image, const cpalette* const cpal, arena* const memory) {
+    cpalette              fallback = { 0 };
+    const cpalette* const compiled = cpalpick(cpal, &fallback);
+    unpacker              unpack   = { 0 };
+    rlecontext            context  = { 0 };
+    rlecursor             cursor   = { 0 };
+    if (!rlebegin(&context, &unpack, image->_buffer, &image->_infoheader, compiled, memory)) return NULL;
+
+    rledecode(&cursor, image->_pixels, image->_infoheader.biSizeImage, true, &image->_infoheader, rlespan, &context);
+    return rleend(&context, &unpack, &cursor);
+}
 
-    return buffer;
+// a view width predicated dispatcher for to_raw_string and to_downscaled_string
+static inline char* to_view_string(
+    const imview* const restrict view, const cpalette* const cpal, threadpool* const pool, arena* const memory
+) {
+    if (view->_width <= CONSOLE_WIDTH) return to_raw_string(view, cpal, pool, memory);
+    return to_downscaled_string(view, cpal, pool, memory);
 }
 
-// an image width predicated dispatcher for to_raw_string and to_downscaled_string
-static inline char* to_string(const bitmap* const restrict image) {
-    if (image->_infoheader.biWidth <= CONSOLE_WIDTH) return to_raw_string(image);
-    return to_downscaled_string(image);
+// converts the whole bitmap, run length encoded bitmaps can't be viewed, they go to to_rle_string
+static inline char* to_string(
+    const bitmap* const restrict image, const cpalette* const cpal, threadpool* const pool, arena* const memory
+) {
+    if (!image->_pixels) return NULL; // bmpread failed and has already reported why
+    if (image->_infoheader.biCompression == RLE8 || image->_infoheader.biCompression == RLE4) return to_rle_string(image, cpal, memory);
+    const imview view = bmpview(image);
+    return to_view_string(&view, cpal, pool, memory);
 }
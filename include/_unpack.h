@@ -0,0 +1,276 @@
+#pragma once
+
+// clang-format off
+#include <_bitmap.h>
+#include <_kernels.h>
+// clang-format on
+
+// the converters work straight off the pixel buffer of the file, in whatever format the file stores its pixels in
+// instead of expanding everything to RGBQUADs first (a full extra copy of the image), every supported format gets its own pair of
+// unpackers, one that maps a scanline to characters (mapscanline()) and one that folds a scanline into block sums (foldscanline())
+//     32 bit BGRA          the vectorized RGBQUAD kernels, as is
+//     24 bit BGR           the vectorized 24 bit kernels, which shuffle triplets into RGBQUAD lanes inside the registers
+//     8 bit colour indexed a 256 entry index to character table, built from the colour table, so mapping a pixel is a single lookup
+//     16 bit               the same as 8 bit pixels, a 16 bit pixel can only take 65536 values, so every one of them is decoded (through
+//                          the colour masks) and mapped ahead of time
+//     32 bit BITFIELDS     pixels are decoded through the masks one at a time, unless the masks describe the plain BGRA layout
+// an unpacker is compiled once per conversion, for a given bitmap and compiled palette, its tables come from the arena of the conversion
+
+typedef enum { BGRA32, BGR24, INDEXED8, INDEXED16, MASKED32 } PIXEL_LAYOUT;
+
+typedef struct {
+        PIXEL_LAYOUT _layout;
+        RGBQUAD*     _colors;    // colour of every possible pixel value of the indexed layouts (NULL for the others)
+        char*        _chars;     // character of every possible pixel value of the indexed layouts i.e cpalmap(cpal, _colors + value)
+        uint32_t     _masks[3];  // MASKED32 only, blue, green and red masks, shifted down to bit 0
+        unsigned     _shifts[3]; // MASKED32 only, positions of the lowest set bit of the masks
+        arena*       _arena;     // where the tables came from, NULL for the heap
+} unpacker;
+
+// running sums of the pixels in a block, the downscalers keep one per block column of the block row being reduced
+typedef struct {
+        uint64_t _blue, _green, _red; // NOLINT(readability-isolate-declaration)
+} blocksum;
+
+// a channel extracted from a pixel with its (shifted down) mask and scaled to [0, 255], rounding to the nearest integer
+// e.g a 5 bit channel value v becomes (v * 255 + 15) / 31
+static inline unsigned char maskchannel(const uint32_t pixel, const uint32_t mask, const unsigned shift) {
+    const uint64_t value = (pixel >> shift) & mask;
+    return mask == UCHAR_MAX ? value : (value * UCHAR_MAX + mask / 2) / mask;
+}
+
+// imstream must hold at least the first bfOffBits bytes of a bitmap that passed bmpsupported()
+// returns false if the lookup tables could not be allocated (errors are reported to stderr), release the unpacker with unpackfree()
+static inline bool unpackcompile(
+    unpacker* const restrict               unpack,
+    const unsigned char* const restrict    imstream,
+    const BITMAPINFOHEADER* const restrict infhead,
+    const cpalette* const restrict         cpal,
+    arena* const restrict                  memory
+) {
+    *unpack           = (unpacker) { ._layout = BGRA32, ._colors = NULL, ._chars = NULL, ._arena = memory };
+
+    uint32_t masks[3] = { 0 };
+    bmpmasks(imstream, infhead, masks);
+    for (unsigned i = 0; i < 3; ++i) {
+        unpack->_shifts[i] = masks[i] ? __builtin_ctz(masks[i]) : 0;
+        unpack->_masks[i]  = masks[i] >> unpack->_shifts[i];
+    }
+
+    switch (infhead->biBitCount) {
+        case 32 :
+            unpack->_layout = masks[0] == 0x0000FF && masks[1] == 0x00FF00 && masks[2] == 0xFF0000 ? BGRA32 : MASKED32;
+            return true;
+        case 24 : unpack->_layout = BGR24; return true;
+        case 16 : unpack->_layout = INDEXED16; break;
+        default : unpack->_layout = INDEXED8; break; // RLE4 bitmaps too, their 16 colours are only ever looked up by the RLE decoder
+    }
+
+    const unsigned nvalues = 1U << infhead->biBitCount;
+    unpack->_colors        = arenacalloc(memory, nvalues, sizeof(RGBQUAD)); // values past the end of a short colour table decode to black
+    unpack->_chars         = arenaalloc(memory, nvalues);
+    if (!unpack->_colors || !unpack->_chars) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        arenafree(memory, unpack->_colors);
+        arenafree(memory, unpack->_chars);
+        unpack->_colors = NULL; // so that a call to unpackfree() on a failed unpacker is harmless
+        unpack->_chars  = NULL;
+        return false;
+    }
+
+    if (unpack->_layout == INDEXED8)
+        memcpy(unpack->_colors, imstream + bmpcolorsoffset(infhead), bmpncolors(infhead) * sizeof(RGBQUAD));
+    else
+        for (uint32_t value = 0; value < nvalues; ++value)
+            unpack->_colors[value] = (RGBQUAD) { .rgbBlue     = maskchannel(value, unpack->_masks[0], unpack->_shifts[0]),
+                                                 .rgbGreen    = maskchannel(value, unpack->_masks[1], unpack->_shifts[1]),
+                                                 .rgbRed      = maskchannel(value, unpack->_masks[2], unpack->_shifts[2]),
+                                                 .rgbReserved = 0 };
+
+    for (uint32_t value = 0; value < nvalues; ++value) unpack->_chars[value] = cpalmap(cpal, unpack->_colors + value);
+    return true;
+}
+
+static inline void unpackfree(unpacker* const unpack) {
+    arenafree(unpack->_arena, unpack->_colors);
+    arenafree(unpack->_arena, unpack->_chars);
+    memset(unpack, 0U, sizeof(unpacker));
+}
+
+// decodes pixel i of a scanline, for mappers that have no kernels of their own for the layout, one pixel at a time
+static inline RGBQUAD unpackpixel(const unpacker* const restrict unpack, const unsigned char* const restrict pixels, const long long i) {
+    switch (unpack->_layout) {
+        case BGRA32 : {
+            RGBQUAD pixel = { 0 };
+            memcpy(&pixel, pixels + 4 * i, sizeof(RGBQUAD));
+            return pixel;
+        }
+        case BGR24    : return (RGBQUAD) { .rgbBlue = pixels[3 * i], .rgbGreen = pixels[3 * i + 1], .rgbRed = pixels[3 * i + 2] };
+        case INDEXED8 : return unpack->_colors[pixels[i]];
+        case INDEXED16 : {
+            uint16_t value = 0; // bfOffBits need not be even, see mapscanline()
+            memcpy(&value, pixels + 2 * i, sizeof(uint16_t));
+            return unpack->_colors[value];
+        }
+        default /* MASKED32 */ : {
+            uint32_t value = 0;
+            memcpy(&value, pixels + 4 * i, sizeof(uint32_t));
+            return (RGBQUAD) { .rgbBlue  = maskchannel(value, unpack->_masks[0], unpack->_shifts[0]),
+                               .rgbGreen = maskchannel(value, unpack->_masks[1], unpack->_shifts[1]),
+                               .rgbRed   = maskchannel(value, unpack->_masks[2], unpack->_shifts[2]) };
+        }
+    }
+}
+
+// maps the width pixels of a scanline to characters, pixels points to the start of the scanline in the pixel buffer
+static inline void mapscanline(
+    const unpacker* const restrict      unpack,
+    const unsigned char* const restrict pixels,
+    const long long                     width,
+    const cpalette* const restrict      cpal,
+    char* const restrict                out
+) {
+    switch (unpack->_layout) {
+        case BGRA32 : scanline((const RGBQUAD*) pixels, width, cpal, out); break;
+        case BGR24  : bgrline(pixels, width, cpal, out); break;
+        case INDEXED8 :
+            for (long long i = 0; i < width; ++i) out[i] = unpack->_chars[pixels[i]];
+            break;
+        case INDEXED16 :
+            for (long long i = 0; i < width; ++i) {
+                // bfOffBits need not be even, so the pixels can't be dereferenced as uint16_ts
+                uint16_t value = 0;
+                memcpy(&value, pixels + 2 * i, sizeof(uint16_t));
+                out[i] = unpack->_chars[value];
+            }
+            break;
+        case MASKED32 :
+            for (long long i = 0; i < width; ++i) {
+                uint32_t value = 0;
+                memcpy(&value, pixels + 4 * i, sizeof(uint32_t));
+                out[i] = cpal->_chars[cpalbgroffset(
+                    cpal,
+                    maskchannel(value, unpack->_masks[0], unpack->_shifts[0]),
+                    maskchannel(value, unpack->_masks[1], unpack->_shifts[1]),
+                    maskchannel(value, unpack->_masks[2], unpack->_shifts[2])
+                )];
+            }
+            break;
+    }
+}
+
+// adds a scanline, left to right, into the per block column sums. blocks are block_d pixels wide except possibly the last one
+// the segment of the scanline that falls in a block is summed in 32 bit lanes first (a segment of up to 2 ^ 24 pixels can't overflow them),
+// a plain integer reduction the compiler is free to vectorize, and only then added to the 64 bit block sums
+// the segment loops are spelled out once per layout so that each one stays a tight loop the compiler can vectorize on its own
+static inline void foldscanline(
+    const unpacker* const restrict      unpack,
+    const unsigned char* const restrict pixels,
+    const long long                     width,
+    const long long                     block_d,
+    blocksum* const restrict            sums
+) {
+    assert(block_d < (1LL << 24));
+    for (long long col = 0, bcol = 0; col < width; col += block_d, ++bcol) { // NOLINT(readability-isolate-declaration)
+        const long long end  = min(col + block_d, width);
+        uint32_t        blue = 0, green = 0, red = 0; // NOLINT(readability-isolate-declaration)
+
+        switch (unpack->_layout) {
+            case BGRA32 :
+                for (long long c = col; c < end; ++c) {
+                    blue  += pixels[4 * c];
+                    green += pixels[4 * c + 1];
+                    red   += pixels[4 * c + 2];
+                }
+                break;
+            case BGR24 :
+                for (long long c = col; c < end; ++c) {
+                    blue  += pixels[3 * c];
+                    green += pixels[3 * c + 1];
+                    red   += pixels[3 * c + 2];
+                }
+                break;
+            case INDEXED8 :
+                for (long long c = col; c < end; ++c) {
+                    blue  += unpack->_colors[pixels[c]].rgbBlue;
+                    green += unpack->_colors[pixels[c]].rgbGreen;
+                    red   += unpack->_colors[pixels[c]].rgbRed;
+                }
+                break;
+            case INDEXED16 :
+                for (long long c = col; c < end; ++c) {
+                    uint16_t value = 0;
+                    memcpy(&value, pixels + 2 * c, sizeof(uint16_t));
+                    blue  += unpack->_colors[value].rgbBlue;
+                    green += unpack->_colors[value].rgbGreen;
+                    red   += unpack->_colors[value].rgbRed;
+                }
+                break;
+            case MASKED32 :
+                for (long long c = col; c < end; ++c) {
+                    uint32_t value = 0;
+                    memcpy(&value, pixels + 4 * c, sizeof(uint32_t));
+                    blue  += maskchannel(value, unpack->_masks[0], unpack->_shifts[0]);
+                    green += maskchannel(value, unpack->_masks[1], unpack->_shifts[1]);
+                    red   += maskchannel(value, unpack->_masks[2], unpack->_shifts[2]);
+                }
+                break;
+        }
+
+        sums[bcol]._blue  += blue;
+        sums[bcol]._green += green;
+        sums[bcol]._red   += red;
+    }
+}
+
+// foldscanline() for two scanlines of the same block row at once, upper and lower, the pair is summed pixel by pixel before the segment
+// reduction, so the block loop, its bounds and the read-modify-write of the 64 bit sums are paid once per pair of scanlines rather than
+// once per scanline. the cost of folding is mostly those for narrow blocks, the 1 and 2 pixel wide blocks of tall cells (see
+// to_aspect_string()) in particular. only the direct colour layouts get the fused loops, the others fold the scanlines one after the other
+static inline void foldscanlinepair(
+    const unpacker* const restrict      unpack,
+    const unsigned char* const restrict upper,
+    const unsigned char* const restrict lower,
+    const long long                     width,
+    const long long                     block_d,
+    blocksum* const restrict            sums
+) {
+    assert(block_d < (1LL << 23));
+    if (unpack->_layout != BGRA32 && unpack->_layout != BGR24) {
+        foldscanline(unpack, upper, width, block_d, sums);
+        foldscanline(unpack, lower, width, block_d, sums);
+        return;
+    }
+
+    const long long stride = unpack->_layout == BGRA32 ? 4 : 3;
+    if (block_d == 1) { // a block per pixel, nothing to reduce along the scanline
+        for (long long c = 0; c < width; ++c) {
+            sums[c]._blue  += upper[stride * c] + lower[stride * c];
+            sums[c]._green += upper[stride * c + 1] + lower[stride * c + 1];
+            sums[c]._red   += upper[stride * c + 2] + lower[stride * c + 2];
+        }
+        return;
+    }
+
+    for (long long col = 0, bcol = 0; col < width; col += block_d, ++bcol) { // NOLINT(readability-isolate-declaration)
+        const long long end  = min(col + block_d, width);
+        uint32_t        blue = 0, green = 0, red = 0; // NOLINT(readability-isolate-declaration)
+
+        if (stride == 4)
+            for (long long c = col; c < end; ++c) {
+                blue  += upper[4 * c] + lower[4 * c];
+                green += upper[4 * c + 1] + lower[4 * c + 1];
+                red   += upper[4 * c + 2] + lower[4 * c + 2];
+            }
+        else
+            for (long long c = col; c < end; ++c) {
+                blue  += upper[3 * c] + lower[3 * c];
+                green += upper[3 * c + 1] + lower[3 * c + 1];
+                red   += upper[3 * c + 2] + lower[3 * c + 2];
+            }
+
+        sums[bcol]._blue  += blue;
+        sums[bcol]._green += green;
+        sums[bcol]._red   += red;
+    }
+}
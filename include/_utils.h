@@ -15,9 +15,11 @@
 #include <unistd.h>
 
 #include <sys/fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 // clang-format off
+#include <_arena.h>
 #include <_wingdi.h>
 // clang-format on
 
@@ -29,7 +31,8 @@
     #define DEBUG_EXEC(...)
 #endif // _DEBUG
 
-static inline unsigned char* imopen(const char* const fpath, long* const nreadbytes) {
+// reads the whole file into a buffer from memory (NULL for the heap, see <_arena.h>)
+static inline unsigned char* imopen(const char* const fpath, long* const nreadbytes, arena* const memory) {
     *nreadbytes             = 0;
     unsigned char* buffer   = NULL;
     struct stat    filestat = {};
@@ -46,7 +49,7 @@ static inline unsigned char* imopen(const char* const fpath, long* const nreadby
         goto CLOSE_AND_RETURN;
     }
 
-    if (!(buffer = malloc(filestat.st_size))) { // caller is responsible for freeing this buffer
+    if (!(buffer = arenaalloc(memory, filestat.st_size))) { // caller is responsible for freeing this buffer, with arenafree(memory, buffer)
         fprintf(stderr, "Call to new() failed inside %s at line %d!\n", __FUNCTION__, __LINE__);
         goto CLOSE_AND_RETURN;
     }
@@ -56,7 +59,7 @@ static inline unsigned char* imopen(const char* const fpath, long* const nreadby
         assert(nbytes == filestat.st_size); // double checking
     } else {
         fprintf(stderr, "Call to read() failed inside %s at line %d!; errno %d\n", __FUNCTION__, __LINE__, errno);
-        free(buffer);
+        arenafree(memory, buffer);
         buffer = NULL;
     }
     // then, fall through the CLOSE_AND_RETURN label
@@ -67,6 +70,67 @@ CLOSE_AND_RETURN:
     return buffer;
 }
 
+// a zero copy alternative to imopen, maps the file into memory read only instead of copying it into a heap buffer
+// pages are only read in when they are first touched, so the caller can start working on the first few bytes right away
+// files smaller than minbytes are left alone, a mapping costs a page fault per page touched, which a read into memory that's already
+// there doesn't, so small files are better off read
+// caller is responsible for unmapping the returned buffer with munmap(buffer, *mapsize), returns NULL on failure
+// (e.g. when the file is empty, below minbytes or isn't mappable, like a pipe), in which case the caller could fall back to imopen
+static inline unsigned char* immap(const char* const fpath, const long minbytes, long* const mapsize) {
+    *mapsize                = 0;
+    unsigned char* buffer   = NULL;
+    struct stat    filestat = {};
+
+    const int fdesc         = open(fpath, O_RDONLY);
+    if (fdesc == -1) {
+        fprintf(stderr, "Call to open() failed inside %s at line %d!; errno %d\n", __FUNCTION__, __LINE__, errno);
+        return NULL;
+    }
+
+    if (fstat(fdesc, &filestat)) {
+        fprintf(stderr, "Call to fstat() failed inside %s at line %d!; errno %d\n", __FUNCTION__, __LINE__, errno);
+        goto CLOSE_AND_RETURN;
+    }
+
+    // nothing to map, or not worth mapping, not an error worth reporting
+    if (!S_ISREG(filestat.st_mode) || !filestat.st_size || filestat.st_size < minbytes) goto CLOSE_AND_RETURN;
+
+    // a private read only mapping, nobody writes to it and the mapping stays valid after the descriptor is closed
+    if ((buffer = mmap(NULL, filestat.st_size, PROT_READ, MAP_PRIVATE, fdesc, 0)) == MAP_FAILED) {
+        fprintf(stderr, "Call to mmap() failed inside %s at line %d!; errno %d\n", __FUNCTION__, __LINE__, errno);
+        buffer = NULL;
+    } else
+        *mapsize = filestat.st_size;
+
+CLOSE_AND_RETURN:
+    if (close(fdesc)) fprintf(stderr, "Call to close() failed inside %s at line %d!; errno %d\n", __FUNCTION__, __LINE__, errno);
+    return buffer;
+}
+
+// a write() that retries on short writes and interrupts, returns false when the bytes couldn't be written in full
+static inline bool writeall(const int fdesc, const unsigned char* restrict buffer, long long nbytes) {
+    while (nbytes > 0) {
+        const ssize_t nwritten = write(fdesc, buffer, nbytes);
+        if (nwritten == -1 && errno == EINTR) continue;
+        if (nwritten <= 0) return false;
+        buffer += nwritten;
+        nbytes -= nwritten;
+    }
+    return true;
+}
+
+// a read() that retries on short reads and interrupts, returns false on errors and when the end of file comes before nbytes were read
+static inline bool readall(const int fdesc, unsigned char* restrict buffer, long long nbytes) {
+    while (nbytes > 0) {
+        const ssize_t nread = read(fdesc, buffer, nbytes);
+        if (nread == -1 && errno == EINTR) continue;
+        if (nread <= 0) return false;
+        buffer += nread;
+        nbytes -= nread;
+    }
+    return true;
+}
+
 // characters in ascending order of luminance
 static const char palette_minimal[]  = { '_', '.', ',', '-', '=', '+', ':', ';', 'c', 'b', 'a', '!', '?', '1',
                                          '2', '3', '4', '5', '6', '7', '8', '9', '$', 'W', '#', '@', 'N' };
@@ -127,57 +191,57 @@ static inline unsigned luminosity(const RGBQUAD* const restrict pixel) {
 // taking it for granted that the input will never be a negative value,
 static inline unsigned nudge(const float _value) { return _value < 1.000000 ? 1 : (unsigned) _value; }
 
-static inline wchar_t arithmetic_mapper(
-    const RGBQUAD* const restrict pixel, const wchar_t* const restrict palette, const unsigned plength
+static inline char arithmetic_mapper(
+    const RGBQUAD* const restrict pixel, const char* const restrict palette, const unsigned plength
 ) {
     const unsigned offset = (((float) (pixel->rgbBlue)) + pixel->rgbGreen + pixel->rgbRed) / 3.000; // can range from 0 to 255
     // hence, offset / (float)(UCHAR_MAX) can range from 0.0 to 1.0
     return palette[offset ? nudge(offset / (float) (UCHAR_MAX) *plength) - 1 : 0];
 }
 
-static inline wchar_t weighted_mapper(const RGBQUAD* const restrict pixel, const wchar_t* const restrict palette, const unsigned plength) {
+static inline char weighted_mapper(const RGBQUAD* const restrict pixel, const char* const restrict palette, const unsigned plength) {
     const unsigned offset = pixel->rgbBlue * 0.299 + pixel->rgbGreen * 0.587 + pixel->rgbRed * 0.114;
     return palette[offset ? nudge(offset / (float) (UCHAR_MAX) *plength) - 1 : 0];
 }
 
-static inline wchar_t minmax_mapper(const RGBQUAD* const restrict pixel, const wchar_t* const restrict palette, const unsigned plength) {
+static inline char minmax_mapper(const RGBQUAD* const restrict pixel, const char* const restrict palette, const unsigned plength) {
     const unsigned offset = (((float) (min(min(pixel->rgbBlue, pixel->rgbGreen), pixel->rgbRed))) +
                              (fmax(fmax(pixel->rgbBlue, pixel->rgbGreen), pixel->rgbRed))) /
                             2.0000;
     return palette[offset ? nudge(offset / (float) (UCHAR_MAX) *plength) - 1 : 0];
 }
 
-static inline wchar_t luminosity_mapper(
-    const RGBQUAD* const restrict pixel, const wchar_t* const restrict palette, const unsigned plength
+static inline char luminosity_mapper(
+    const RGBQUAD* const restrict pixel, const char* const restrict palette, const unsigned plength
 ) {
     const unsigned offset = pixel->rgbBlue * 0.2126 + pixel->rgbGreen * 0.7152 + pixel->rgbRed * 0.0722;
     return palette[offset ? nudge(offset / (float) (UCHAR_MAX) *plength) - 1 : 0];
 }
 
-static inline wchar_t arithmetic_blockmapper(
-    const float rgbBlue, const float rgbGreen, const float rgbRed, const wchar_t* const restrict palette, const unsigned plength
+static inline char arithmetic_blockmapper(
+    const float rgbBlue, const float rgbGreen, const float rgbRed, const char* const restrict palette, const unsigned plength
 ) {
     const unsigned offset = (rgbBlue + rgbGreen + rgbRed) / 3.000; // can range from 0 to 255
     // hence, offset / (float)(UCHAR_MAX) can range from 0.0 to 1.0
     return palette[offset ? nudge(offset / (float) (UCHAR_MAX) *plength) - 1 : 0];
 }
 
-static inline wchar_t weighted_blockmapper(
-    const float rgbBlue, const float rgbGreen, const float rgbRed, const wchar_t* const restrict palette, const unsigned plength
+static inline char weighted_blockmapper(
+    const float rgbBlue, const float rgbGreen, const float rgbRed, const char* const restrict palette, const unsigned plength
 ) {
     const unsigned offset = rgbBlue * 0.299 + rgbGreen * 0.587 + rgbRed * 0.114;
     return palette[offset ? nudge(offset / (float) (UCHAR_MAX) *plength) - 1 : 0];
 }
 
-static inline wchar_t minmax_blockmapper(
-    const float rgbBlue, const float rgbGreen, const float rgbRed, const wchar_t* const restrict palette, const unsigned plength
+static inline char minmax_blockmapper(
+    const float rgbBlue, const float rgbGreen, const float rgbRed, const char* const restrict palette, const unsigned plength
 ) {
     const unsigned offset = (min(min(rgbBlue, rgbGreen), rgbRed) + fmax(max(rgbBlue, rgbGreen), rgbRed)) / 2.0000;
     return palette[offset ? nudge(offset / (float) (UCHAR_MAX) *plength) - 1 : 0];
 }
 
-static inline wchar_t luminosity_blockmapper(
-    const float rgbBlue, const float rgbGreen, const float rgbRed, const wchar_t* const restrict palette, const unsigned plength
+static inline char luminosity_blockmapper(
+    const float rgbBlue, const float rgbGreen, const float rgbRed, const char* const restrict palette, const unsigned plength
 ) {
     const unsigned offset = rgbBlue * 0.2126 + rgbGreen * 0.7152 + rgbRed * 0.0722;
     return palette[offset ? nudge(offset / (float) (UCHAR_MAX) *plength) - 1 : 0];
@@ -0,0 +1,110 @@
+#include <_clut.h>
+#include <time.h>
+
+// benchmarks the two colour lookup tables of <_clut.h> against each other and against the hardcoded weighted kernel of <_kernels.h>
+// bench.out [-j <n>] [path]
+// maps n pixels for n = 4 KiB to 64 Mi pixels, the time of every variant includes building its tables, as that is what a conversion pays
+// the pixels are random colours by default, which is the worst case for the full table, or the pixels of the bitmap at path, repeated
+// -j <n> fills the full table on a pool of n threads, it is filled on the calling thread by default
+
+static long long nanoseconds(void) {
+    struct timespec now = { 0 };
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+int main(const int argc, char* argv[]) {
+    long long nthreads = 1;
+    int       first    = 1;
+    if (first + 1 < argc && !strcmp(argv[first], "-j")) {
+        nthreads  = strtoll(argv[first + 1], NULL, 10);
+        first    += 2;
+    }
+    if (nthreads < 1 || first + 1 < argc) {
+        fputs("Error :: Inappropriate invocation! Programme expects an optional -j <n> and an optional path to a bitmap\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    const long long maxpixels = 1LL << 26;
+    RGBQUAD* const  pixels    = malloc(sizeof(RGBQUAD) * maxpixels);
+    char* const     out       = malloc(maxpixels);
+    if (!pixels || !out) {
+        fprintf(stderr, "Error in %s @ line %d: malloc failed!\n", __FUNCTION__, __LINE__);
+        return EXIT_FAILURE;
+    }
+
+    if (first < argc) { // the pixels of the bitmap, in the order they are on disk, repeated
+        bitmap image = bmpread(argv[first], NULL);
+        if (!image._pixels) return EXIT_FAILURE;
+        const imview   view    = bmpview(&image);
+        const cpalette cpal    = cpalcompile(smapper, spalette, sizeof(spalette));
+        unpacker       unpack  = { 0 };
+        long long      npixels = 0;
+        if (!unpackcompile(&unpack, view._headers, view._infoheader, &cpal, NULL)) return EXIT_FAILURE;
+        for (long long row = 0; npixels < maxpixels; row = (row + 1) % view._height)
+            for (long long x = 0; x < view._width && npixels < maxpixels; ++x)
+                pixels[npixels++] = unpackpixel(&unpack, imscanline(&view, row), x);
+        unpackfree(&unpack);
+        bmpclose(&image);
+    } else {
+        uint64_t state = 0x9E3779B97F4A7C15LLU;
+        for (long long i = 0; i < maxpixels; ++i) { // xorshift64, rand() would take longer than the benchmark
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            memcpy(pixels + i, &state, sizeof(RGBQUAD));
+        }
+    }
+
+    threadpool        pool  = { 0 };
+    threadpool* const ppool = nthreads > 1 && tpoolcreate(&pool, nthreads) ? &pool : NULL;
+
+    // the weights of the weighted mappers, so every variant maps the pixels the same way, give or take the single precision
+    const float bscale = 0.299F, gscale = 0.587F, rscale = 0.114F; // NOLINT(readability-isolate-declaration)
+    colourlut   probe  = { 0 };
+    clutcompile(&probe, bscale, gscale, rscale, spalette, sizeof(spalette), false, NULL, NULL);
+    long long nexact = 0;
+    for (unsigned i = 0; i < CLUT_BUCKETS * CLUT_BUCKETS * CLUT_BUCKETS; ++i) nexact += !probe._cube[i];
+    printf("%s pixels, %lld of the %u buckets of the cube fall back to the exact offset, clutcompile() picks the %s\n",
+           first < argc ? argv[first] : "random", nexact, CLUT_BUCKETS * CLUT_BUCKETS * CLUT_BUCKETS,
+           probe._kind == CLUT_CUBE ? "cube" : "exact offsets");
+    printf("%12s %12s %12s %12s %12s   (ms, tables included)\n", "pixels", "hardcoded", "exact", "cube", "full");
+
+    long long crossover = 0;
+    for (long long npixels = 1LL << 12; npixels <= maxpixels; npixels <<= 2) {
+        long long start = nanoseconds();
+        cpalette  cpal  = cpalcompile(WEIGHTED, spalette, sizeof(spalette));
+        scanline(pixels, npixels, &cpal, out);
+        const long long hardcoded = nanoseconds() - start;
+
+        colourlut lut = { 0 };
+        start         = nanoseconds();
+        clutcompile(&lut, bscale, gscale, rscale, spalette, sizeof(spalette), false, NULL, NULL);
+        clutline_exact(pixels, npixels, &lut, out);
+        const long long exact = nanoseconds() - start;
+
+        start = nanoseconds();
+        clutcompile(&lut, bscale, gscale, rscale, spalette, sizeof(spalette), false, NULL, NULL);
+        clutline_cube(pixels, npixels, &lut, out);
+        const long long cube = nanoseconds() - start;
+
+        start = nanoseconds();
+        if (!clutcompile(&lut, bscale, gscale, rscale, spalette, sizeof(spalette), true, ppool, NULL)) return EXIT_FAILURE;
+        clutline_full(pixels, npixels, &lut, out);
+        const long long full = nanoseconds() - start;
+        clutfree(&lut);
+
+        if (!crossover && full < cube) crossover = npixels;
+        printf("%12lld %12.3f %12.3f %12.3f %12.3f\n", npixels, hardcoded / 1E6, exact / 1E6, cube / 1E6, full / 1E6);
+    }
+
+    if (crossover)
+        printf("the full table beats the cube from %lld pixels on\n", crossover);
+    else
+        printf("the cube beats the full table at every size\n");
+
+    if (ppool) tpooldestroy(ppool);
+    free(pixels);
+    free(out);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,192 @@
+#include <_server.h>
+#include <time.h>
+
+// a small local client of the conversion server (see <_server.h> and -S), for trying it out and for load testing it
+// client.out [options] <socket> <paths...>
+// -c <n> opens n connections at once, one per thread, defaults to 1
+// -n <n> sends n requests down every connection, cycling through the paths, defaults to the number of paths
+// -w <n,...> asks for the renders at each of the comma separated widths instead of at the default width
+// -k <arithmetic|weighted|minmax|luminosity> and -P <minimal|base|extended> pick the mapper and the palette of the renders, they default to
+//        the ones bmpasc.out renders bitmaps with
+// -b sends the bytes of the bitmaps (read once, up front) instead of their paths
+// -q doesn't print the results, they are only ever printed with a single connection
+// the requests, the failures, the throughput and the latencies of the run are reported to stderr at the end
+
+typedef struct {
+        const char*                 _socket;
+        SERVER_REQUEST              _kind;
+        const unsigned char* const* _payloads;   // the absolute paths or the bytes of the bitmaps
+        const long long*            _lengths;
+        long long                   _npaths;
+        const long long*            _columns;
+        long long                   _ncolumns;
+        MAPPER_KIND                 _mapper;
+        unsigned                    _palette;    // index in cpalpalettes
+        long long                   _nrequests;  // per connection
+        bool                        _print;
+        long long*                  _latencies;  // _nrequests per connection, in nanoseconds, of the requests that succeeded
+        long long*                  _nsucceeded; // per connection
+} loadcontext;
+
+static long long nanoseconds(void) {
+    struct timespec now = { 0 };
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static int ascending(const void* const left, const void* const right) {
+    const long long l = *(const long long*) left, r = *(const long long*) right; // NOLINT(readability-isolate-declaration)
+    return (l > r) - (l < r);
+}
+
+// runs connections [first, last)
+static void loadconnections(const void* const restrict _context, const long long first, const long long last) {
+    const loadcontext* const context = _context;
+    for (long long c = first; c < last; ++c) {
+        long long* const latencies = context->_latencies + c * context->_nrequests;
+        const int        fdesc     = clientconnect(context->_socket);
+        if (fdesc == -1) continue; // every request of the connection failed
+
+        arena memory = { 0 };
+        for (long long r = 0; r < context->_nrequests; ++r) {
+            arenareset(&memory);
+            const long long     path                       = r % context->_npaths;
+            char*               strings[PYRAMID_MAXLEVELS] = { 0 };
+            const long long     start                      = nanoseconds();
+            const SERVER_STATUS status                     = clientconvert(
+                fdesc,
+                context->_kind,
+                context->_payloads[path],
+                context->_lengths[path],
+                context->_columns,
+                context->_ncolumns,
+                context->_mapper,
+                context->_palette,
+                strings,
+                &memory
+            );
+            if (status == SERVER_DISCONNECTED || status == SERVER_BADREQUEST) break; // the rest of the requests of the connection failed
+            if (status != SERVER_OK) continue;
+
+            latencies[context->_nsucceeded[c]++] = nanoseconds() - start;
+            for (long long l = 0; context->_print && l < (context->_ncolumns ? context->_ncolumns : 1); ++l) {
+                fputs(strings[l], stdout);
+                fputs("\n\n", stdout);
+            }
+        }
+        arenadestroy(&memory);
+        close(fdesc);
+    }
+}
+
+int main(const int argc, char* argv[]) {
+    int       first                      = 1;
+    long long nconnections               = 1;
+    long long nrequests                  = 0; // 0 means one request per path
+    long long columns[PYRAMID_MAXLEVELS] = { 0 };
+    long long ncolumns                   = 0; // 0 means the default width
+    int       kind                       = smapper;
+    int       ipalette                   = 1; // palette_base, see spalette
+    bool      bytes                      = false;
+    bool      quiet                      = false;
+    for (; first < argc && argv[first][0] == '-'; ++first) {
+        if (!strcmp(argv[first], "-c") && first + 1 < argc)
+            nconnections = strtoll(argv[++first], NULL, 10);
+        else if (!strcmp(argv[first], "-n") && first + 1 < argc)
+            nrequests = strtoll(argv[++first], NULL, 10);
+        else if (!strcmp(argv[first], "-w") && first + 1 < argc) {
+            for (char *width = argv[++first], *end = NULL;; width = end + 1) { // NOLINT(readability-isolate-declaration)
+                const long long value = strtoll(width, &end, 10);
+                if (end == width || value <= 0 || (*end && *end != ',') || ncolumns == PYRAMID_MAXLEVELS) {
+                    fprintf(
+                        stderr, "Error :: -w expects up to %lld comma separated positive widths, not %s\n", PYRAMID_MAXLEVELS, argv[first]
+                    );
+                    return EXIT_FAILURE;
+                }
+                columns[ncolumns++] = value;
+                if (!*end) break;
+            }
+        } else if (!strcmp(argv[first], "-k") && first + 1 < argc) {
+            if ((kind = cpalnameindex(argv[++first], cpalmappernames, CPAL_NMAPPERS)) == -1) {
+                fprintf(stderr, "Error :: unknown mapper %s\n", argv[first]);
+                return EXIT_FAILURE;
+            }
+        } else if (!strcmp(argv[first], "-P") && first + 1 < argc) {
+            if ((ipalette = cpalnameindex(argv[++first], cpalpalettenames, CPAL_NPALETTES)) == -1) {
+                fprintf(stderr, "Error :: unknown palette %s\n", argv[first]);
+                return EXIT_FAILURE;
+            }
+        } else if (!strcmp(argv[first], "-b"))
+            bytes = true;
+        else if (!strcmp(argv[first], "-q"))
+            quiet = true;
+        else {
+            fprintf(stderr, "Error :: unknown option %s\n", argv[first]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (first + 1 >= argc || nconnections < 1 || nrequests < 0) {
+        fputs("Error :: Inappropriate invocation! Programme expects the path of a socket and at least one path to a bitmap\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    // the server resolves relative paths against its own working directory, not this one
+    const char* const     sockpath   = argv[first];
+    const long long       npaths     = argc - first - 1;
+    const long long       nsent      = nrequests ? nrequests : npaths;
+    const unsigned char** payloads   = calloc(npaths, sizeof(unsigned char*));
+    long long* const      lengths    = calloc(npaths, sizeof(long long));
+    long long* const      latencies  = malloc(sizeof(long long) * nconnections * nsent);
+    long long* const      nsucceeded = calloc(nconnections, sizeof(long long));
+    bool                  ready      = payloads && lengths && latencies && nsucceeded;
+    for (long long i = 0; ready && i < npaths; ++i) {
+        long size   = 0;
+        payloads[i] = bytes ? imopen(argv[first + 1 + i], &size, NULL) : (unsigned char*) realpath(argv[first + 1 + i], NULL);
+        lengths[i]  = bytes ? size : (payloads[i] ? (long long) strlen((const char*) payloads[i]) : 0);
+        if (!payloads[i]) fprintf(stderr, "Error :: could not read %s\n", argv[first + 1 + i]);
+        ready = payloads[i];
+    }
+
+    threadpool        pool  = { 0 };
+    threadpool* const ppool = (ready && nconnections > 1 && tpoolcreate(&pool, nconnections)) ? &pool : NULL;
+    const loadcontext context = { ._socket     = sockpath,
+                                  ._kind       = bytes ? SERVER_BITMAP : SERVER_PATH,
+                                  ._payloads   = payloads,
+                                  ._lengths    = lengths,
+                                  ._npaths     = npaths,
+                                  ._columns    = columns,
+                                  ._ncolumns   = ncolumns,
+                                  ._mapper     = kind,
+                                  ._palette    = ipalette,
+                                  ._nrequests  = nsent,
+                                  ._print      = !quiet && nconnections == 1,
+                                  ._latencies  = latencies,
+                                  ._nsucceeded = nsucceeded };
+
+    const long long start = nanoseconds();
+    if (ready) tpoolfor(ppool, nconnections, loadconnections, &context); // a pool of one worker per connection, one connection per band
+    const long long elapsed = nanoseconds() - start;
+    if (ppool) tpooldestroy(ppool);
+
+    // the latencies of the requests that succeeded, moved together and sorted
+    long long nlatencies = 0;
+    for (long long c = 0; ready && c < nconnections; ++c)
+        for (long long r = 0; r < nsucceeded[c]; ++r) latencies[nlatencies++] = latencies[c * nsent + r];
+    if (nlatencies) qsort(latencies, nlatencies, sizeof(long long), ascending);
+
+    if (ready) {
+        fprintf(stderr, "%lld requests over %lld connections, %lld failed, in %.3f s, %.1f requests/s\n", nconnections * nsent,
+                nconnections, nconnections * nsent - nlatencies, elapsed / 1E9, nlatencies / (elapsed / 1E9));
+        if (nlatencies)
+            fprintf(stderr, "latencies :: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", latencies[nlatencies / 2] / 1E6,
+                    latencies[min(nlatencies * 99 / 100, nlatencies - 1)] / 1E6, latencies[nlatencies - 1] / 1E6);
+    }
+
+    for (long long i = 0; payloads && i < npaths; ++i) free((void*) payloads[i]);
+    free(payloads);
+    free(lengths);
+    free(latencies);
+    free(nsucceeded);
+    return ready && nlatencies == nconnections * nsent ? EXIT_SUCCESS : EXIT_FAILURE;
+}
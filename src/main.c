@@ -1,51 +1,427 @@
 #ifndef __TEST__
+    #include <_batch.h>
+    #include <_cache.h>
+    #include <_colour.h>
+    #include <_cpenalty.h>
+    #include <_grid.h>
+    #include <_output.h>
+    #include <_pyramid.h>
+    #include <_sequence.h>
+    #include <_server.h>
+    #include <_stream.h>
+    #include <_subcell.h>
     #include <_tostring.h>
 
+// prints the images converted in batch mode (see <_batch.h>), in the order they were given in, coalesced by the output in context
+static void emitimage(const char* const restrict path, const char* const restrict string, void* const restrict context) {
+    if (!string) {
+        fprintf(stderr, "Error :: failed processing image %s!\n", path);
+        return;
+    }
+    const char* const strings[] = { string };
+    outputstrings(context, strings, 1);
+}
+
+// renders a grid in colour with -t, in half blocks with -H, in braille with -D and as plain characters otherwise
+static char* rendergrid(
+    const blockgrid* const restrict grid,
+    const cpalette* const restrict  cpal,
+    const char                      mode,
+    threadpool* const               pool,
+    arena* const                    memory
+) {
+    switch (mode) {
+        case 't' : return to_colour_string(grid, cpal, pool, memory);
+        case 'H' : return to_halfblock_string(grid, pool, memory);
+        case 'D' : return to_braille_string(grid, cpal, pool, memory);
+        default  : return to_grid_string(grid, cpal, memory);
+    }
+}
+
 int main(const int argc, char* argv[]) {
     #ifdef _DEBUG
 
-    const wchar_t* const bitmaps[] = { L"./test/bobmarley.bmp", L"./test/football.bmp", L"./test/garfield.bmp", L"./test/gewn.bmp",
-                                       L"./test/girl.bmp",      L"./test/jennifer.bmp", L"./test/messi.bmp",    L"./test/supergirl.bmp",
-                                       L"./test/time.bmp",      L"./test/uefa2024.bmp", L"./test/vendetta.bmp", NULL };
-    const wchar_t**      _ptr      = bitmaps;
-    while (*_ptr) {
-        bitmap_t image                     = bmpread(*_ptr);
-        const wchar_t* const restrict wstr = to_string(&image);
-        if (!wstr) {
-            wprintf_s(L"Error :: failed processing image %s!\n", *_ptr);
-            bmpclose(&image);
+    const char* const bitmaps[] = { "./test/bobmarley.bmp", "./test/football.bmp", "./test/garfield.bmp", "./test/gewn.bmp",
+                                    "./test/girl.bmp",      "./test/jennifer.bmp", "./test/messi.bmp",    "./test/supergirl.bmp",
+                                    "./test/time.bmp",      "./test/uefa2024.bmp", "./test/vendetta.bmp", NULL };
+    output            out       = { 0 };
+    outputopen(&out, STDOUT_FILENO, 0);
+    for (const char* const* _ptr = bitmaps; *_ptr; ++_ptr) {
+        bitmap            image = bmpread(*_ptr, NULL);
+        const char* const str   = to_string(&image, NULL, NULL, NULL);
+        bmpclose(&image);
+        if (!str) {
+            fprintf(stderr, "Error :: failed processing image %s!\n", *_ptr);
             continue; // move on to the next image
         }
 
-        _putws(wstr);
-        _putws(L"\n\n");
-        free(wstr);
-        bmpclose(&image);
-        _ptr++;
+        outputstrings(&out, &str, 1);
+        free((char*) str);
     }
+    outputclose(&out);
 
     #else // N_DEBUG
 
-    if (argc == 1) {
-        fputws(L"Error :: Inappropriate invocation! Programme expects at least one path to a bitmap image\n", stderr);
+    // options come before the paths
+    // -j <n> sets the number of threads each conversion is split across, defaults to the number of cores
+    // -s streams the bitmaps from disk a few scanlines at a time (see <_stream.h>), for bitmaps too large to be loaded into memory
+    // -b <n> batch mode, converts up to n images at a time, one per thread, instead of splitting each one across the threads
+    //        (see <_batch.h>), the images are still printed in the order they were given in
+    // -p <n> reads the next n files ahead in the background, while the current ones convert (see <_prefetch.h>), defaults to 4
+    //        0 disables it
+    // -m reports how much buffer reuse the arenas (see <_arena.h>) got out of the run, and the hits and misses of the cache, to stderr
+    // -w <n,...> renders the images at each of the comma separated widths (in characters) instead of at the default width, all of them
+    //        in a single pass over the pixels (see <_pyramid.h>), one after the other. not available with -s and -b
+    // -e saves the block averages of every image (see <_grid.h>) to <path>.grid, instead of printing the image
+    // -g renders grids saved with -e, instead of bitmaps, with the mapper and the palette picked by -k and -c
+    // -k <arithmetic|weighted|minmax|luminosity> and -c <minimal|base|extended> pick the mapper and the palette images and grids are
+    //        rendered with, default to the ones the converters are compiled with (see <_tostring.h>). not available with -s, -b and -F
+    //        -e and -g are not available with -s, -b and -w
+    // -C <directory> keeps the results in a cache in the directory (see <_cache.h>), shared by every process pointed at it, images seen
+    //        before are printed straight from it. not available with -s, -b, -e and -g
+    // -L <n> caps the size of the cache at n MiB, defaults to 256
+    // -t paints every character in the colour of its block with 24 bit ANSI escapes (see <_colour.h>), bitmaps and grids alike
+    //        not available with -s, -b, -w, -e and -C
+    // -H renders two samples per character, one above the other, as coloured half blocks and -D 2 x 4 samples per character as braille
+    //        patterns (see <_subcell.h>), bitmaps and grids alike. in UTF-8, and with the same restrictions as -t, which they replace
+    // -a <w:h> reduces the images in blocks w wide and h tall rather than square ones (see to_aspect_string()), e.g -a 1:2 for the
+    //        usual terminal fonts, which keeps the images from being stretched vertically. not available with -s, -b, -w, -e, -g, -C,
+    //        -t, -H and -D, nor with run length encoded bitmaps
+    // -P <bllim,bulim,gllim,gulim,rllim,rulim,penalty> renders a character per pixel, scaling the offsets of the pixels whose blue, green
+    //        or red value falls in [bllim, bulim], [gllim, gulim] or [rllim, rulim] down by the penalty (see <_cpenalty.h>), identical
+    //        limits leave a channel out. with the same restrictions as -a, which it replaces
+    // -F plays the bitmaps back as the frames of an animation (see <_sequence.h>), each drawn in place of the one before by rewriting
+    //        only the cells that changed. the paths of the frames are read from stdin, one per line, when none are given. -s and -a
+    //        apply to the frames, the other options that shape the output are not available
+    // -R skips the rows of a frame that hash the same as they did in the frame before, without comparing their cells, with -F only
+    // -S <socket> serves conversions on a unix domain socket at the given path (see <_server.h>) until interrupted, instead of converting
+    //        the paths given, up to -j clients at once. takes no paths, and no options but -j, the requests carry their own widths
+    // the images are written to stdout with a system call each (see <_output.h>), or coalesced into large writes in batch mode
+    int         first                      = 1;
+    unsigned    nthreads                   = ncores();
+    unsigned    ninflight                  = 0; // 0 means no batch mode
+    unsigned    nahead                     = 4;
+    long long   columns[PYRAMID_MAXLEVELS] = { 0 };
+    long long   ncolumns                   = 0; // 0 means the default width
+    bool        stream                     = false;
+    bool        arenastat                  = false;
+    bool        exportgrid                 = false;
+    bool        loadgrid                   = false;
+    bool        truecolour                 = false;
+    char        subcells                   = 0; // 'H' for half blocks, 'D' for braille
+    long long   aspectw                    = 0; // 0 means square blocks
+    long long   aspecth                    = 0;
+    bool        sequencemode               = false;
+    bool        hashrows                   = false;
+    int         kind                       = smapper;
+    int         ipalette                   = 1; // palette_base, see spalette
+    bool        pickedcpal                 = false; // -k or -c was given
+    bool        penalize                   = false;
+    cpenalty    cpen                       = { 0 };
+    const char* cachedir                   = NULL;
+    long long   cachelimit                 = CACHE_MAXBYTES;
+    const char* serversocket               = NULL;
+    for (; first < argc && argv[first][0] == '-'; ++first) {
+        if (!strcmp(argv[first], "-j") && first + 1 < argc)
+            nthreads = strtoul(argv[++first], NULL, 10);
+        else if (!strcmp(argv[first], "-b") && first + 1 < argc)
+            ninflight = strtoul(argv[++first], NULL, 10);
+        else if (!strcmp(argv[first], "-p") && first + 1 < argc)
+            nahead = strtoul(argv[++first], NULL, 10);
+        else if (!strcmp(argv[first], "-w") && first + 1 < argc) {
+            for (char *width = argv[++first], *end = NULL;; width = end + 1) { // NOLINT(readability-isolate-declaration)
+                const long long value = strtoll(width, &end, 10);
+                if (end == width || value <= 0 || (*end && *end != ',') || ncolumns == PYRAMID_MAXLEVELS) {
+                    fprintf(
+                        stderr, "Error :: -w expects up to %lld comma separated positive widths, not %s\n", PYRAMID_MAXLEVELS, argv[first]
+                    );
+                    return EXIT_FAILURE;
+                }
+                columns[ncolumns++] = value;
+                if (!*end) break;
+            }
+        } else if (!strcmp(argv[first], "-k") && first + 1 < argc) {
+            pickedcpal = true;
+            if ((kind = cpalnameindex(argv[++first], cpalmappernames, CPAL_NMAPPERS)) == -1) {
+                fprintf(stderr, "Error :: unknown mapper %s\n", argv[first]);
+                return EXIT_FAILURE;
+            }
+        } else if (!strcmp(argv[first], "-c") && first + 1 < argc) {
+            pickedcpal = true;
+            if ((ipalette = cpalnameindex(argv[++first], cpalpalettenames, CPAL_NPALETTES)) == -1) {
+                fprintf(stderr, "Error :: unknown palette %s\n", argv[first]);
+                return EXIT_FAILURE;
+            }
+        } else if (!strcmp(argv[first], "-s"))
+            stream = true;
+        else if (!strcmp(argv[first], "-m"))
+            arenastat = true;
+        else if (!strcmp(argv[first], "-e"))
+            exportgrid = true;
+        else if (!strcmp(argv[first], "-g"))
+            loadgrid = true;
+        else if (!strcmp(argv[first], "-t"))
+            truecolour = true;
+        else if (!strcmp(argv[first], "-H") || !strcmp(argv[first], "-D")) {
+            if (subcells && subcells != argv[first][1]) {
+                fputs("Error :: -H and -D can't be combined with each other\n", stderr);
+                return EXIT_FAILURE;
+            }
+            subcells = argv[first][1];
+        } else if (!strcmp(argv[first], "-a") && first + 1 < argc) {
+            char* height = NULL;
+            aspectw      = strtoll(argv[++first], &height, 10);
+            aspecth      = *height == ':' ? strtoll(height + 1, &height, 10) : 0;
+            if (aspectw <= 0 || aspecth <= 0 || *height) {
+                fprintf(stderr, "Error :: -a expects an aspect ratio as <width>:<height>, not %s\n", argv[first]);
+                return EXIT_FAILURE;
+            }
+        } else if (!strcmp(argv[first], "-P") && first + 1 < argc) {
+            unsigned char limits[6] = { 0 };
+            char*         value     = argv[++first];
+            char*         end       = NULL;
+            bool          valid     = true;
+            for (unsigned l = 0; l < 6 && valid; ++l, value = end + 1) {
+                const unsigned long limit = strtoul(value, &end, 10);
+                valid                     = end != value && *end == ',' && limit <= UCHAR_MAX;
+                limits[l]                 = limit;
+            }
+            const float penalty = valid ? strtof(value, &end) : -1.0F;
+            if (!valid || end == value || *end || !(penalty >= 0.00000 && penalty <= ONE)) {
+                fprintf(
+                    stderr, "Error :: -P expects 6 comma separated limits in [0, 255] and a penalty in [0.0, 1.0], not %s\n", argv[first]
+                );
+                return EXIT_FAILURE;
+            }
+            cpen     = cpencompile(limits[0], limits[1], limits[2], limits[3], limits[4], limits[5], penalty);
+            penalize = true;
+        } else if (!strcmp(argv[first], "-F"))
+            sequencemode = true;
+        else if (!strcmp(argv[first], "-R"))
+            hashrows = true;
+        else if (!strcmp(argv[first], "-C") && first + 1 < argc)
+            cachedir = argv[++first];
+        else if (!strcmp(argv[first], "-L") && first + 1 < argc)
+            cachelimit = strtoll(argv[++first], NULL, 10) << 20;
+        else if (!strcmp(argv[first], "-S") && first + 1 < argc)
+            serversocket = argv[++first];
+        else {
+            fprintf(stderr, "Error :: unknown option %s\n", argv[first]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (serversocket) {
+        if (first < argc || stream || ninflight || ncolumns || exportgrid || loadgrid || cachedir || truecolour || subcells || aspectw ||
+            sequencemode || pickedcpal || penalize) {
+            fputs("Error :: -S takes no paths, and can only be combined with -j\n", stderr);
+            return EXIT_FAILURE;
+        }
+
+        threadpool        pool  = { 0 };
+        threadpool* const ppool = (nthreads > 1 && tpoolcreate(&pool, nthreads)) ? &pool : NULL; // NULL serves one client at a time
+        const bool        done  = serverrun(serversocket, ppool);
+        if (ppool) tpooldestroy(ppool); // waits for the clients still connected to hang up
+        return done ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (first >= argc && !sequencemode) { // frames can come from stdin
+        fputs("Error :: Inappropriate invocation! Programme expects at least one path to a bitmap image\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    if (ncolumns && (stream || ninflight)) {
+        fputs("Error :: -w can't be combined with -s or -b\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    if ((exportgrid || loadgrid) && (stream || ninflight || ncolumns || (exportgrid && loadgrid))) {
+        fputs("Error :: -e and -g can't be combined with each other, or with -s, -b or -w\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    if (pickedcpal && (stream || ninflight || sequencemode)) {
+        fputs("Error :: -k and -c can't be combined with -s, -b or -F\n", stderr);
+        return EXIT_FAILURE;
+    }
+    const cpalette cpal = cpalcompile(kind, cpalpalettes[ipalette], cpalplengths[ipalette]);
+
+    if (truecolour && (stream || ninflight || ncolumns || exportgrid || cachedir || subcells)) {
+        fputs("Error :: -t can't be combined with -s, -b, -w, -e, -C, -H or -D\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    if (subcells && (stream || ninflight || ncolumns || exportgrid || cachedir)) {
+        fputs("Error :: -H and -D can't be combined with -s, -b, -w, -e or -C\n", stderr);
+        return EXIT_FAILURE;
+    }
+    const char rendermode = truecolour ? 't' : subcells; // how grids are rendered, see rendergrid()
+
+    if (sequencemode && (ninflight || ncolumns || exportgrid || loadgrid || cachedir || rendermode)) {
+        fputs("Error :: -F can't be combined with -b, -w, -e, -g, -C, -t, -H or -D\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    if (hashrows && !sequencemode) {
+        fputs("Error :: -R only applies to -F\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    if (aspectw && !sequencemode && (stream || ninflight || ncolumns || exportgrid || loadgrid || cachedir || rendermode)) {
+        fputs("Error :: -a can't be combined with -s, -b, -w, -e, -g, -C, -t, -H or -D\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    if (penalize && (stream || ninflight || ncolumns || exportgrid || loadgrid || cachedir || rendermode || aspectw || sequencemode)) {
+        fputs("Error :: -P can't be combined with -s, -b, -w, -e, -g, -C, -t, -H, -D, -a or -F\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    if (cachedir && (stream || ninflight || exportgrid || loadgrid)) {
+        fputs("Error :: -C can't be combined with -s, -b, -e or -g\n", stderr);
         return EXIT_FAILURE;
     }
+    resultcache        cache  = { 0 };
+    resultcache* const pcache = (cachedir && cacheopen(&cache, cachedir, cachelimit)) ? &cache : NULL; // runs on without a cache
+
+    threadpool        pool  = { 0 };
+    threadpool* const ppool = (nthreads > 1 && tpoolcreate(&pool, nthreads)) ? &pool : NULL; // NULL means single threaded conversions
+
+    const char* const* const paths     = (const char* const*) argv + first;
+    const long long          npaths    = argc - first;
+    prefetcher               prefetch  = { 0 };
+    // a single image has nothing to be read ahead of it
+    prefetcher* const        pprefetch = (nahead && npaths > 1 && prefetchstart(&prefetch, paths, npaths, nahead)) ? &prefetch : NULL;
+
+    output out = { 0 };
+    if (!outputopen(&out, STDOUT_FILENO, ninflight ? OUTPUT_BATCHBYTES : 0)) outputopen(&out, STDOUT_FILENO, 0); // runs on unbatched
+
+    arenastats stats = { 0 };
+    if (sequencemode) {
+        sequencestats seqstats = { 0 };
+        const bool    done     = sequencerun(first < argc ? paths : NULL, npaths, stdin, hashrows, stream, aspectw, aspecth, ppool,
+                                             pprefetch, &out, &seqstats, &stats);
+        const bool    written  = outputclose(&out);
+        if (arenastat) {
+            arenareport(&stats, stderr);
+            sequencereport(&seqstats, stderr);
+        }
+        if (pprefetch) prefetchstop(pprefetch);
+        if (ppool) tpooldestroy(ppool);
+        return done && written ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (ninflight) {
+        const bool done    = batchrun(ppool, pprefetch, paths, npaths, ninflight, stream, emitimage, &out, &stats);
+        const bool written = outputclose(&out);
+        if (arenastat) arenareport(&stats, stderr);
+        if (pprefetch) prefetchstop(pprefetch);
+        if (ppool) tpooldestroy(ppool);
+        return done && written ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    for (int i = 1; i < argc; ++i) {
-        bitmap image                       = bmpread(argv[i]);
-        const wchar_t* const restrict wstr = to_string(&image);
-        if (!wstr) {
-            wprintf_s(L"Error :: failed processing image %s!\n", argv[i]);
+    arena memory  = { 0 }; // all the buffers of an image come from here, and go back before the next image
+    bool  written = true;
+    for (int i = first; i < argc; ++i) {
+        arenareset(&memory);
+        prefetchadvance(pprefetch, i - first + 1); // the files after this one are up next
+        if (loadgrid) {
+            blockgrid         grid = { 0 };
+            const char* const str  = gridload(&grid, argv[i], &memory) ? rendergrid(&grid, &cpal, rendermode, ppool, &memory) : NULL;
+            if (!str) {
+                fprintf(stderr, "Error :: failed processing grid %s!\n", argv[i]);
+                continue;
+            }
+
+            written &= outputstrings(&out, &str, 1);
+            continue;
+        }
+
+        if (stream) {
+            const char* const str = to_streamed_string(argv[i], &memory);
+            if (!str) {
+                fprintf(stderr, "Error :: failed processing image %s!\n", argv[i]);
+                continue;
+            }
+
+            written &= outputstrings(&out, &str, 1);
+            continue;
+        }
+
+        bitmap image = bmpread(argv[i], &memory);
+        if (rendermode) {
+            // braille takes two samples across per character, the others one
+            blockgrid         grid     = { 0 };
+            const long long   nsamples = rendermode == 'D' ? 2 * CONSOLE_WIDTH : CONSOLE_WIDTH;
+            const char* const str      = bmpsample(&grid, &image, nsamples, ppool, &memory)
+                                             ? rendergrid(&grid, &cpal, rendermode, ppool, &memory)
+                                             : NULL;
             bmpclose(&image);
-            continue; // move on to the next image
+            if (!str) {
+                fprintf(stderr, "Error :: failed processing image %s!\n", argv[i]);
+                continue;
+            }
+
+            written &= outputstrings(&out, &str, 1);
+            continue;
+        }
+
+        if (aspectw || penalize) {
+            // run length encoded bitmaps can't be viewed, and only ever come in square blocks
+            const unsigned    compression = image._infoheader.biCompression;
+            const bool        viewable    = image._pixels && compression != RLE8 && compression != RLE4;
+            const imview      view        = viewable ? bmpview(&image) : (imview) { 0 };
+            const char* const str         = !viewable ? NULL
+                                            : penalize ? to_penalized_string(&view, &cpal, &cpen, ppool, &memory)
+                                                       : to_aspect_string(&view, aspectw, aspecth, &cpal, ppool, &memory);
+            bmpclose(&image);
+            if (!str) {
+                fprintf(stderr, "Error :: failed processing image %s!\n", argv[i]);
+                continue;
+            }
+
+            written &= outputstrings(&out, &str, 1);
+            continue;
         }
 
-        _putws(wstr);
-        _putws(L"\n\n");
-        free(wstr);
+        if (exportgrid) {
+            char      gridpath[PATH_MAX] = { 0 };
+            blockgrid grid               = { 0 };
+            if (snprintf(gridpath, PATH_MAX, "%s.grid", argv[i]) >= PATH_MAX || !bmpgrid(&grid, &image, ppool, &memory) ||
+                !gridsave(&grid, gridpath))
+                fprintf(stderr, "Error :: failed saving the grid of image %s!\n", argv[i]);
+            bmpclose(&image);
+            continue;
+        }
+
+        // one string per width with -w, from the cache if it has them
+        char*           strings[PYRAMID_MAXLEVELS] = { 0 };
+        const long long nstrings                   = ncolumns ? ncolumns : 1;
+        const cachekey  key                        = pcache && image._pixels ? cachekeyof(&image, &cpal, columns, ncolumns)
+                                                                             : (cachekey) { 0 };
+        if (!pcache || !image._pixels || !cachefind(pcache, key, strings, nstrings, &memory)) {
+            if (!to_strings(&image, columns, ncolumns, &cpal, strings, ppool, &memory)) {
+                fprintf(stderr, "Error :: failed processing image %s!\n", argv[i]);
+                bmpclose(&image);
+                continue; // move on to the next image
+            }
+            if (pcache) cachestore(pcache, key, (const char* const*) strings, nstrings);
+        }
+
+        // with -w, the same output as one run per width, in a single system call
+        written &= outputstrings(&out, (const char* const*) strings, nstrings);
         bmpclose(&image);
     }
 
+    written &= outputclose(&out);
+    arenatally(&stats, &memory);
+    if (arenastat) arenareport(&stats, stderr);
+    if (arenastat && pcache) cachereport(&pcache->_stats, stderr);
+    arenadestroy(&memory);
+    if (pprefetch) prefetchstop(pprefetch);
+    if (ppool) tpooldestroy(ppool);
+    if (!written) return EXIT_FAILURE;
+
     #endif
 
     return EXIT_SUCCESS;
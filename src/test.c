@@ -2,7 +2,25 @@
 
     #define TEST_TIMES 5LL // DON'T EVEN THINK ABOUT INCREASING THIS. WITH 5 ALONE, TESTING TOOK A FEW MINUTES TO FINISH!
     #include <time.h>
-    #include <tostring.h>
+    #include <sys/ioctl.h>
+    #include <_tostring.h>
+    #include <_batch.h>
+    #include <_cache.h>
+    #include <_clut.h>
+    #include <_colour.h>
+    #include <_cpenalty.h>
+    #include <_grid.h>
+    #include <_integral.h>
+    #include <_output.h>
+    #include <_penalty.h>
+    #include <_pyramid.h>
+    #include <_sequence.h>
+    #include <_server.h>
+    #include <_subcell.h>
+
+    #ifndef _MSC_VER
+        #define __crt_countof(array) (sizeof(array) / sizeof(*(array)))
+    #endif
 
 static_assert(sizeof(BITMAPINFOHEADER) == 40LLU);
 static_assert(sizeof(BITMAPFILEHEADER) == 14LLU);
@@ -12,7 +30,7 @@ static const RGBQUAD mid                    = { .rgbBlue = 0x80, .rgbGreen = 0x8
 static const RGBQUAD max                    = { .rgbBlue = 0xFF, .rgbGreen = 0xFF, .rgbRed = 0xFF, .rgbReserved = 0xFF };
 
 // a 300 byte chunk extracted from a real BMP file, for testing
-static const unsigned char const dummybmp[] = {
+static const unsigned char dummybmp[] = {
     66, 77,  54, 129, 21, 0,   0,   0,  0,  0,   54,  0,  0,  0,   40, 0, 0,  0,   222, 2, 0,  0,   224, 1, 0,  0,   1, 0, 32, 0,   0, 0,
     0,  0,   0,  0,   0,  0,   196, 14, 0,  0,   196, 14, 0,  0,   0,  0, 0,  0,   0,   0, 0,  0,   2,   2, 8,  255, 2, 2, 8,  255, 1, 1,
     7,  255, 1,  1,   7,  255, 0,   0,  6,  255, 0,   1,  5,  255, 0,  1, 5,  255, 0,   1, 5,  255, 0,   1, 5,  255, 2, 1, 5,  255, 7, 4,
@@ -25,10 +43,38 @@ static const unsigned char const dummybmp[] = {
     19, 255, 8,  8,   20, 255, 8,   8,  20, 255, 8,   8
 };
 
+// an rlesink that paints the spans it receives into an 8 pixel wide grid of colour indices, for __TEST_RLE__
+static void rlepaint(
+    void* const restrict grid,
+    const long long      y,
+    const long long      nrows,
+    const long long      x,
+    const long long      count,
+    const unsigned char  even,
+    const unsigned char  odd
+) {
+    for (long long r = y; r < y + nrows; ++r)
+        for (long long i = 0; i < count; ++i) ((unsigned char (*)[8]) grid)[r][x + i] = i & 1 ? odd : even;
+}
+
+// the results batchcheck() expects, in the order of the paths, for __TEST_STREAM__
+typedef struct {
+        const char* const* _paths;
+        char* const*       _expected;
+        long long          _nemitted;
+} batchexpect;
+
+// a batchemit that checks the images come out in the order of the paths, rendered as the converters render them
+static void batchcheck(const char* const restrict path, const char* const restrict string, void* const restrict context) {
+    batchexpect* const expect = context;
+    assert(path == expect->_paths[expect->_nemitted] && string && !strcmp(string, expect->_expected[expect->_nemitted]));
+    expect->_nemitted++;
+}
+
 static const float RNDMAX = RAND_MAX + 2.0000;
 // the + 2.0000 is just for extra safety that we do not get too close to 1.000 when dividing rand() by RNDMAX
 
-int wmain(void) {
+int main(void) {
     srand(time(NULL));
 
     #pragma region __TEST_BMP_STARTTAGS__
@@ -91,49 +137,49 @@ int wmain(void) {
                 // if ((bscaler + gscaler + rscaler) > ONE) wprintf_s(L"%.10lf\n", bscaler + gscaler + rscaler);
 
                 // make sure none of the below raise an access violation exception!
-                arithmetic_mapper(&temp, palette, __crt_countof(palette));
+                arithmetic_mapper(&temp, palette_base, __crt_countof(palette_base));
                 arithmetic_mapper(&temp, palette_minimal, __crt_countof(palette_minimal));
                 arithmetic_mapper(&temp, palette_extended, __crt_countof(palette_extended));
 
-                weighted_mapper(&temp, palette, __crt_countof(palette));
+                weighted_mapper(&temp, palette_base, __crt_countof(palette_base));
                 weighted_mapper(&temp, palette_minimal, __crt_countof(palette_minimal));
                 weighted_mapper(&temp, palette_extended, __crt_countof(palette_extended));
 
-                minmax_mapper(&temp, palette, __crt_countof(palette));
+                minmax_mapper(&temp, palette_base, __crt_countof(palette_base));
                 minmax_mapper(&temp, palette_minimal, __crt_countof(palette_minimal));
                 minmax_mapper(&temp, palette_extended, __crt_countof(palette_extended));
 
-                luminosity_mapper(&temp, palette, __crt_countof(palette));
+                luminosity_mapper(&temp, palette_base, __crt_countof(palette_base));
                 luminosity_mapper(&temp, palette_minimal, __crt_countof(palette_minimal));
                 luminosity_mapper(&temp, palette_extended, __crt_countof(palette_extended));
 
-                tunable_mapper(&temp, bscaler, gscaler, rscaler, palette, __crt_countof(palette));
+                tunable_mapper(&temp, bscaler, gscaler, rscaler, palette_base, __crt_countof(palette_base));
                 tunable_mapper(&temp, bscaler, gscaler, rscaler, palette_minimal, __crt_countof(palette_minimal));
                 tunable_mapper(&temp, bscaler, gscaler, rscaler, palette_extended, __crt_countof(palette_extended));
 
                 // test the block mappers
-                arithmetic_blockmapper(blue, green, red, palette, __crt_countof(palette));
+                arithmetic_blockmapper(blue, green, red, palette_base, __crt_countof(palette_base));
                 arithmetic_blockmapper(blue, green, red, palette_minimal, __crt_countof(palette_minimal));
                 arithmetic_blockmapper(blue, green, red, palette_extended, __crt_countof(palette_extended));
 
-                weighted_blockmapper(blue, green, red, palette, __crt_countof(palette));
+                weighted_blockmapper(blue, green, red, palette_base, __crt_countof(palette_base));
                 weighted_blockmapper(blue, green, red, palette_minimal, __crt_countof(palette_minimal));
                 weighted_blockmapper(blue, green, red, palette_extended, __crt_countof(palette_extended));
 
-                minmax_blockmapper(blue, green, red, palette, __crt_countof(palette));
+                minmax_blockmapper(blue, green, red, palette_base, __crt_countof(palette_base));
                 minmax_blockmapper(blue, green, red, palette_minimal, __crt_countof(palette_minimal));
                 minmax_blockmapper(blue, green, red, palette_extended, __crt_countof(palette_extended));
 
-                luminosity_blockmapper(blue, green, red, palette, __crt_countof(palette));
+                luminosity_blockmapper(blue, green, red, palette_base, __crt_countof(palette_base));
                 luminosity_blockmapper(blue, green, red, palette_minimal, __crt_countof(palette_minimal));
                 luminosity_blockmapper(blue, green, red, palette_extended, __crt_countof(palette_extended));
 
-                tunable_blockmapper(blue, bscaler, green, gscaler, red, rscaler, palette, __crt_countof(palette));
+                tunable_blockmapper(blue, bscaler, green, gscaler, red, rscaler, palette_base, __crt_countof(palette_base));
                 tunable_blockmapper(blue, bscaler, green, gscaler, red, rscaler, palette_minimal, __crt_countof(palette_minimal));
                 tunable_blockmapper(blue, bscaler, green, gscaler, red, rscaler, palette_extended, __crt_countof(palette_extended));
 
                 // test penalizing mappers
-                penalizing_arithmeticmapper(&temp, blue, green, green, red, red, blue, palette, __crt_countof(palette), rnd);
+                penalizing_arithmeticmapper(&temp, blue, green, green, red, red, blue, palette_base, __crt_countof(palette_base), rnd);
                 penalizing_arithmeticmapper(
                     &temp, blue, green, green, red, red, blue, palette_minimal, __crt_countof(palette_minimal), rnd
                 );
@@ -141,17 +187,17 @@ int wmain(void) {
                     &temp, blue, green, green, red, red, blue, palette_extended, __crt_countof(palette_extended), rnd
                 );
 
-                penalizing_weightedmapper(&temp, blue, green, green, red, red, blue, palette, __crt_countof(palette), rnd);
+                penalizing_weightedmapper(&temp, blue, green, green, red, red, blue, palette_base, __crt_countof(palette_base), rnd);
                 penalizing_weightedmapper(&temp, blue, green, green, red, red, blue, palette_minimal, __crt_countof(palette_minimal), rnd);
                 penalizing_weightedmapper(
                     &temp, blue, green, green, red, red, blue, palette_extended, __crt_countof(palette_extended), rnd
                 );
 
-                penalizing_minmaxmapper(&temp, blue, green, green, red, red, blue, palette, __crt_countof(palette), rnd);
+                penalizing_minmaxmapper(&temp, blue, green, green, red, red, blue, palette_base, __crt_countof(palette_base), rnd);
                 penalizing_minmaxmapper(&temp, blue, green, green, red, red, blue, palette_minimal, __crt_countof(palette_minimal), rnd);
                 penalizing_minmaxmapper(&temp, blue, green, green, red, red, blue, palette_extended, __crt_countof(palette_extended), rnd);
 
-                penalizing_luminositymapper(&temp, blue, green, green, red, red, blue, palette, __crt_countof(palette), rnd);
+                penalizing_luminositymapper(&temp, blue, green, green, red, red, blue, palette_base, __crt_countof(palette_base), rnd);
                 penalizing_luminositymapper(
                     &temp, blue, green, green, red, red, blue, palette_minimal, __crt_countof(palette_minimal), rnd
                 );
@@ -165,7 +211,7 @@ int wmain(void) {
                     g = (rand() / (float) RAND_MAX) * UCHAR_MAX;
                     r = (rand() / (float) RAND_MAX) * UCHAR_MAX;
 
-                    penalizing_arithmeticblockmapper(blue, green, red, b, g, g, r, r, b, palette, __crt_countof(palette), rnd);
+                    penalizing_arithmeticblockmapper(blue, green, red, b, g, g, r, r, b, palette_base, __crt_countof(palette_base), rnd);
                     penalizing_arithmeticblockmapper(
                         blue, green, red, b, g, g, r, r, b, palette_minimal, __crt_countof(palette_minimal), rnd
                     );
@@ -173,7 +219,7 @@ int wmain(void) {
                         blue, green, red, b, g, g, r, r, b, palette_extended, __crt_countof(palette_extended), rnd
                     );
 
-                    penalizing_weightedblockmapper(blue, green, red, b, g, g, r, r, b, palette, __crt_countof(palette), rnd);
+                    penalizing_weightedblockmapper(blue, green, red, b, g, g, r, r, b, palette_base, __crt_countof(palette_base), rnd);
                     penalizing_weightedblockmapper(
                         blue, green, red, b, g, g, r, r, b, palette_minimal, __crt_countof(palette_minimal), rnd
                     );
@@ -181,13 +227,13 @@ int wmain(void) {
                         blue, green, red, b, g, g, r, r, b, palette_extended, __crt_countof(palette_extended), rnd
                     );
 
-                    penalizing_minmaxblockmapper(blue, green, red, b, g, g, r, r, b, palette, __crt_countof(palette), rnd);
+                    penalizing_minmaxblockmapper(blue, green, red, b, g, g, r, r, b, palette_base, __crt_countof(palette_base), rnd);
                     penalizing_minmaxblockmapper(blue, green, red, b, g, g, r, r, b, palette_minimal, __crt_countof(palette_minimal), rnd);
                     penalizing_minmaxblockmapper(
                         blue, green, red, b, g, g, r, r, b, palette_extended, __crt_countof(palette_extended), rnd
                     );
 
-                    penalizing_luminosityblockmapper(blue, green, red, b, g, g, r, r, b, palette, __crt_countof(palette), rnd);
+                    penalizing_luminosityblockmapper(blue, green, red, b, g, g, r, r, b, palette_base, __crt_countof(palette_base), rnd);
                     penalizing_luminosityblockmapper(
                         blue, green, red, b, g, g, r, r, b, palette_minimal, __crt_countof(palette_minimal), rnd
                     );
@@ -201,15 +247,743 @@ int wmain(void) {
 
     #pragma endregion
 
+    #pragma region __TEST_CPALETTE__
+    // compiled palettes must map every possible pixel to the exact same character as the mappers they replace
+    static const char* const palettes[] = { palette_minimal, palette_base, palette_extended };
+    static const unsigned    plengths[] = { sizeof(palette_minimal), sizeof(palette_base), sizeof(palette_extended) };
+
+    for (unsigned p = 0; p < __crt_countof(palettes); ++p) {
+        const cpalette arithmeticcpal = cpalcompile(ARITHMETIC, palettes[p], plengths[p]);
+        const cpalette weightedcpal   = cpalcompile(WEIGHTED, palettes[p], plengths[p]);
+        const cpalette minmaxcpal     = cpalcompile(MINMAX, palettes[p], plengths[p]);
+        const cpalette luminositycpal = cpalcompile(LUMINOSITY, palettes[p], plengths[p]);
+
+        for (unsigned blue = 0; blue <= UCHAR_MAX; ++blue) {
+            for (unsigned green = 0; green <= UCHAR_MAX; ++green) {
+                for (unsigned red = 0; red <= UCHAR_MAX; ++red) {
+                    temp.rgbBlue  = blue;
+                    temp.rgbGreen = green;
+                    temp.rgbRed   = red;
+
+                    assert(cpalmap(&arithmeticcpal, &temp) == arithmetic_mapper(&temp, palettes[p], plengths[p]));
+                    assert(cpalmap(&weightedcpal, &temp) == weighted_mapper(&temp, palettes[p], plengths[p]));
+                    assert(cpalmap(&minmaxcpal, &temp) == minmax_mapper(&temp, palettes[p], plengths[p]));
+                    assert(cpalmap(&luminositycpal, &temp) == luminosity_mapper(&temp, palettes[p], plengths[p]));
+
+                    assert(
+                        cpalblockmap(&arithmeticcpal, blue, green, red) ==
+                        arithmetic_blockmapper(blue, green, red, palettes[p], plengths[p])
+                    );
+                    assert(
+                        cpalblockmap(&weightedcpal, blue, green, red) ==
+                        weighted_blockmapper(blue, green, red, palettes[p], plengths[p])
+                    );
+                    assert(
+                        cpalblockmap(&minmaxcpal, blue, green, red) ==
+                        minmax_blockmapper(blue, green, red, palettes[p], plengths[p])
+                    );
+                    assert(
+                        cpalblockmap(&luminositycpal, blue, green, red) ==
+                        luminosity_blockmapper(blue, green, red, palettes[p], plengths[p])
+                    );
+                }
+            }
+        }
+    }
+
+    // and so must the converters, a narrow image is mapped a pixel at a time, one scanline of characters and a LF per scanline
+    static RGBQUAD         cpalpixels[16][100] = { 0 };
+    const BITMAPINFOHEADER cpalhead = { .biSize = 40, .biWidth = 100, .biHeight = -16, .biBitCount = 32, .biCompression = RGB };
+    for (unsigned r = 0; r < 16; ++r)
+        for (unsigned c = 0; c < 100; ++c) cpalpixels[r][c] = (RGBQUAD) { .rgbBlue = rand(), .rgbGreen = rand(), .rgbRed = rand() };
+    const imview cpalview = imscanlines(dummybmp, &cpalhead, (const unsigned char*) cpalpixels, 16, false);
+
+    for (unsigned p = 0; p < __crt_countof(palettes); ++p) {
+        for (unsigned kind = ARITHMETIC; kind <= LUMINOSITY; ++kind) {
+            const cpalette cpal = cpalcompile(kind, palettes[p], plengths[p]);
+            char* const    str  = to_view_string(&cpalview, &cpal, NULL, NULL);
+            assert(str && strlen(str) == 16 * 101);
+            for (unsigned r = 0; r < 16; ++r) {
+                for (unsigned c = 0; c < 100; ++c) {
+                    const RGBQUAD* const pixel    = &cpalpixels[r][c];
+                    const char           expected = kind == ARITHMETIC ? arithmetic_mapper(pixel, palettes[p], plengths[p])
+                                                  : kind == WEIGHTED   ? weighted_mapper(pixel, palettes[p], plengths[p])
+                                                  : kind == MINMAX     ? minmax_mapper(pixel, palettes[p], plengths[p])
+                                                                       : luminosity_mapper(pixel, palettes[p], plengths[p]);
+                    assert(str[r * 101 + c] == expected);
+                }
+                assert(str[r * 101 + 100] == '\n');
+            }
+            free(str);
+        }
+    }
+    #pragma endregion
+
+    #pragma region __TEST_KERNELS__
+    // every scanline kernel the host can run must agree with the scalar kernel on every possible pixel
+    // odd chunk lengths make sure the scalar tails of the vectorized kernels get exercised too
+    static const MAPPER_KIND kinds[]            = { ARITHMETIC, WEIGHTED, MINMAX, LUMINOSITY };
+    static RGBQUAD           chunk[4099]        = { 0 };
+    static unsigned char     triplets[4099 * 3] = { 0 }; // the same pixels, packed as BGR triplets for the 24 bit kernels
+    static char              expected[4099] = { 0 }, got[4099] = { 0 }; // NOLINT(readability-isolate-declaration)
+    const scanline_kernel    kernels[]          = { scanline_sse42, scanline_avx2, scanline_avx512 };
+    const bool               supported[]        = { __builtin_cpu_supports("sse4.2"),
+                                                    __builtin_cpu_supports("avx2"),
+                                                    __builtin_cpu_supports("avx512f") };
+    const bgr_kernel         bgrkernels[]       = { bgrline_scalar, bgrline_sse42, bgrline_avx2 };
+    const bool               bgrsupported[]     = { true, __builtin_cpu_supports("sse4.2"), __builtin_cpu_supports("avx2") };
+
+    for (unsigned k = 0; k < __crt_countof(kinds); ++k) {
+        const cpalette cpal = cpalcompile(kinds[k], palette_extended, sizeof(palette_extended));
+
+        for (unsigned long base = 0; base < (1LU << 24); base += __crt_countof(chunk)) {
+            const long long length = min(__crt_countof(chunk), (1LU << 24) - base);
+            for (long long i = 0; i < length; ++i) {
+                chunk[i].rgbBlue  = (base + i) & 0xFF;
+                chunk[i].rgbGreen = ((base + i) >> 8) & 0xFF;
+                chunk[i].rgbRed   = ((base + i) >> 16) & 0xFF;
+                memcpy(triplets + 3 * i, chunk + i, 3);
+            }
+
+            scanline_scalar(chunk, length, &cpal, expected);
+            for (unsigned v = 0; v < __crt_countof(kernels); ++v) {
+                if (!supported[v]) continue;
+                kernels[v](chunk, length, &cpal, got);
+                assert(!memcmp(expected, got, length));
+            }
+            for (unsigned v = 0; v < __crt_countof(bgrkernels); ++v) {
+                if (!bgrsupported[v]) continue;
+                bgrkernels[v](triplets, length, &cpal, got);
+                assert(!memcmp(expected, got, length));
+            }
+        }
+    }
+    #pragma endregion
+
+    #pragma region __TEST_UNPACKERS__
+    // every 16 bit pixel of a 5-6-5 BITFIELDS bitmap and every index of a short colour table, against independently expanded RGBQUADs
+    unsigned char          imstream[54 + 256 * sizeof(RGBQUAD)] = { 0 };
+    static unsigned char   values[1LU << 17]                    = { 0 }; // every 16 bit value, as little endian pixels
+    static char            mapped[1LU << 16]                    = { 0 };
+    const cpalette         cpal16                               = cpalcompile(WEIGHTED, palette_extended, sizeof(palette_extended));
+    const BITMAPINFOHEADER bitfields = { .biSize = 40, .biWidth = 1 << 16, .biHeight = 1, .biBitCount = 16, .biCompression = BITFIELDS };
+    memcpy(imstream + 54, (const uint32_t[]) { 0xF800, 0x07E0, 0x001F }, 3 * sizeof(uint32_t)); // red, green and blue masks, unaligned
+
+    unpacker unpack = { 0 };
+    assert(unpackcompile(&unpack, imstream, &bitfields, &cpal16, NULL) && unpack._layout == INDEXED16);
+    for (uint32_t v = 0; v < (1LU << 16); ++v) memcpy(values + 2 * v, &v, sizeof(uint16_t));
+    mapscanline(&unpack, values, 1LL << 16, &cpal16, mapped);
+
+    blocksum total = { 0 };
+    foldscanline(&unpack, values, 1LL << 16, 1LL << 16, &total); // the whole scanline as a single block
+    uint64_t blue = 0, green = 0, red = 0;                        // NOLINT(readability-isolate-declaration)
+    for (uint32_t v = 0; v < (1LU << 16); ++v) {
+        const RGBQUAD pixel = { .rgbBlue  = ((v & 0x1F) * 255 + 15) / 31,
+                                .rgbGreen = (((v >> 5) & 0x3F) * 255 + 31) / 63,
+                                .rgbRed   = ((v >> 11) * 255 + 15) / 31 };
+        assert(mapped[v] == cpalmap(&cpal16, &pixel));
+        blue  += pixel.rgbBlue;
+        green += pixel.rgbGreen;
+        red   += pixel.rgbRed;
+    }
+    assert(total._blue == blue && total._green == green && total._red == red);
+    unpackfree(&unpack);
+
+    // an 8 bit bitmap with only 7 colours in its colour table, indices past the table must decode to black
+    const BITMAPINFOHEADER indexed = { .biSize = 40, .biWidth = 256, .biHeight = 1, .biBitCount = 8, .biClrUsed = 7 };
+    for (unsigned i = 0; i < 7; ++i) ((RGBQUAD*) (imstream + 54))[i] = (RGBQUAD) { .rgbBlue = i * 40, .rgbGreen = 255 - i, .rgbRed = i };
+    assert(unpackcompile(&unpack, imstream, &indexed, &cpal16, NULL) && unpack._layout == INDEXED8);
+    for (unsigned i = 0; i < 256; ++i) values[i] = i;
+    mapscanline(&unpack, values, 256, &cpal16, mapped);
+    for (unsigned i = 0; i < 256; ++i)
+        assert(mapped[i] == (i < 7 ? cpalmap(&cpal16, (RGBQUAD*) (imstream + 54) + i) : cpalmap(&cpal16, &min)));
+    unpackfree(&unpack);
+    #pragma endregion
+
+    #pragma region __TEST_RLE__
+    // an 8 x 4 RLE4 bitmap exercising every kind of code, scanlines are listed bottom up
+    static const unsigned char rlestream[] = {
+        0x05, 0x12,             // a run of 5 pixels alternating between colours 1 and 2
+        0x00, 0x03, 0x34, 0x50, // 3 literal pixels, 3 4 5
+        0x00, 0x00,             // end of the scanline
+        0x00, 0x02, 0x02, 0x01, // delta, skips scanline 1 and the first 2 pixels of scanline 2
+        0x0A, 0x77,             // a run of 10 pixels of colour 7, only 6 of which fit in the scanline
+        0x00, 0x01              // end of the bitmap, scanline 3 is skipped
+    };
+    static const unsigned char rleexpected[4][8] = {
+        { 1, 2, 1, 2, 1, 3, 4, 5 },
+        { 0, 0, 0, 0, 0, 0, 0, 0 },
+        { 0, 0, 7, 7, 7, 7, 7, 7 },
+        { 0, 0, 0, 0, 0, 0, 0, 0 }
+    };
+    unsigned char          rlegrid[4][8] = { 0 };
+    const BITMAPINFOHEADER rle4          = { .biSize = 40, .biWidth = 8, .biHeight = 4, .biBitCount = 4, .biCompression = RLE4 };
+    rlecursor              cursor        = { 0 };
+    memset(rlegrid, 0xFF, sizeof(rlegrid)); // every pixel must be painted, skipped ones included
+
+    // not a single code is decoded when the stream is shorter than the longest code and more of it is yet to come
+    assert(!rledecode(&cursor, rlestream, sizeof(rlestream), false, &rle4, rlepaint, rlegrid));
+    assert(rledecode(&cursor, rlestream, sizeof(rlestream), true, &rle4, rlepaint, rlegrid) == sizeof(rlestream) && cursor._done);
+    rlemove(&cursor, 0, rle4.biHeight, &rle4, rlepaint, rlegrid);
+    assert(!memcmp(rlegrid, rleexpected, sizeof(rlegrid)));
+    #pragma endregion
+
+    #pragma region __TEST_VIEWS__
+    // the same 3 x 4 image stored bottom up and top down, the blue channel of every pixel holds its row and column (in image order)
+    RGBQUAD                bottomup[4][3] = { 0 }, topdown[4][3] = { 0 }; // NOLINT(readability-isolate-declaration)
+    const BITMAPINFOHEADER buhead         = { .biSize = 40, .biWidth = 3, .biHeight = 4, .biBitCount = 32, .biCompression = RGB };
+    const BITMAPINFOHEADER tdhead         = { .biSize = 40, .biWidth = 3, .biHeight = -4, .biBitCount = 32, .biCompression = RGB };
+    for (unsigned r = 0; r < 4; ++r)
+        for (unsigned c = 0; c < 3; ++c) bottomup[3 - r][c] = topdown[r][c] = (RGBQUAD) { .rgbBlue = r * 16 + c, .rgbRed = 0xFF };
+
+    const imview buview = imscanlines(dummybmp, &buhead, (const unsigned char*) bottomup, 4, false);
+    const imview tdview = imscanlines(dummybmp, &tdhead, (const unsigned char*) topdown, 4, false);
+    assert(buview._stride == -12 && tdview._stride == 12);
+    for (unsigned r = 0; r < 4; ++r)
+        for (unsigned c = 0; c < 3; ++c) {
+            assert(((const RGBQUAD*) imscanline(&buview, r))[c].rgbBlue == r * 16 + c);
+            assert(((const RGBQUAD*) imscanline(&tdview, r))[c].rgbBlue == r * 16 + c);
+        }
+
+    // crops are clamped to the edges of the view
+    const imview crop = imcrop(&buview, 1, 2, 5, 5);
+    assert(crop._width == 2 && crop._height == 2);
+    assert(((const RGBQUAD*) imscanline(&crop, 1))[1].rgbBlue == 3 * 16 + 2);
+
+    char* const bustr = to_view_string(&buview, NULL, NULL, NULL);
+    char* const tdstr = to_view_string(&tdview, NULL, NULL, NULL);
+    char* const cstr  = to_view_string(&crop, NULL, NULL, NULL);
+    assert(bustr && tdstr && cstr && !strcmp(bustr, tdstr));
+    assert(strlen(cstr) == 6 && !strncmp(cstr, bustr + 2 * 4 + 1, 2)); // 4 characters per row of the image, 3 pixels + a LF
+    free(bustr);
+    free(tdstr);
+    free(cstr);
+    #pragma endregion
+
+    #pragma region __TEST_ASPECT__
+    // folding a pair of scanlines at once sums the same as folding them one after the other, with and without incomplete blocks
+    const BITMAPINFOHEADER bgrhead = { .biSize = 40, .biWidth = 1000, .biHeight = 2, .biBitCount = 24, .biCompression = RGB };
+    blocksum               pairsums[1000] = { 0 }, singlesums[1000] = { 0 }; // NOLINT(readability-isolate-declaration)
+    for (unsigned i = 0; i < 6000; ++i) values[i] = i * 7 + (i >> 5);
+    assert(unpackcompile(&unpack, imstream, &bgrhead, &cpal16, NULL) && unpack._layout == BGR24);
+    for (const long long* block = (const long long[]) { 1, 3, 7, 0 }; *block; ++block) {
+        memset(pairsums, 0U, sizeof(pairsums));
+        memset(singlesums, 0U, sizeof(singlesums));
+        foldscanlinepair(&unpack, values, values + 3000, 1000, *block, pairsums);
+        foldscanline(&unpack, values, 1000, *block, singlesums);
+        foldscanline(&unpack, values + 3000, 1000, *block, singlesums);
+        assert(!memcmp(pairsums, singlesums, sizeof(pairsums)));
+    }
+    unpackfree(&unpack);
+
+    // 1 : 1 blocks are the square blocks, 1 : 2 blocks average pairs of scanlines into half as many rows
+    const cpalette aspectcpal = cpalcompile(smapper, spalette, sizeof(spalette));
+    char* const    squarestr  = to_aspect_string(&buview, 1, 1, NULL, NULL, NULL);
+    char* const    tallstr    = to_aspect_string(&buview, 1, 2, NULL, NULL, NULL);
+    char* const    viewstr11  = to_view_string(&buview, NULL, NULL, NULL);
+    assert(squarestr && tallstr && viewstr11 && !strcmp(squarestr, viewstr11) && strlen(tallstr) == 2 * 4);
+    for (unsigned r = 0; r < 2; ++r)
+        for (unsigned c = 0; c < 3; ++c) {
+            const blocksum pair = { ._blue = (2 * r * 16 + c) + ((2 * r + 1) * 16 + c), ._red = 2 * 0xFF };
+            assert(tallstr[r * 4 + c] == blockaverage(&pair, rcpcompute(2), &aspectcpal));
+        }
+    free(squarestr);
+    free(tallstr);
+    free(viewstr11);
+    #pragma endregion
+
+    #pragma region __TEST_PENALTY__
+    // a penalty without limits changes nothing, and with limits the kernels and the scalar path pick the very character the penalizing
+    // mappers pick, for every one of the 2^24 pixels, a row of 65536 green and red values at a time
+    RGBQUAD* const penpixels = malloc(sizeof(RGBQUAD) * 65536);
+    char* const    penscalar = malloc(65536), *const penvector = malloc(65536), *const plain = malloc(65536); // NOLINT
+    assert(penpixels && penscalar && penvector && plain);
+    const penalty_kernel penkernels[]   = { penline_sse42, penline_avx2 };
+    const bool           pensupported[] = { __builtin_cpu_supports("sse4.2"), __builtin_cpu_supports("avx2") };
+    for (unsigned kind = ARITHMETIC; kind <= LUMINOSITY; ++kind) {
+        const cpalette pencpal = cpalcompile(kind, palette_extended, sizeof(palette_extended));
+        const cpenalty none    = cpencompile(UCHAR_MAX, UCHAR_MAX, 0, 0, 7, 7, 0.75);
+        const float    penalty = rand() / RNDMAX;
+        const cpenalty cpen    = cpencompile(20, 90, 100, 100, 180, 255, penalty);
+        const unsigned penplen = sizeof(palette_extended);
+        for (unsigned blue = 0; blue <= UCHAR_MAX; ++blue) {
+            for (unsigned i = 0; i < 65536; ++i) penpixels[i] = (RGBQUAD) { .rgbBlue = blue, .rgbGreen = i >> 8, .rgbRed = i & 0xFF };
+            scanline(penpixels, 65536, &pencpal, plain);
+            penline_scalar(penpixels, 65536, &pencpal, &none, penscalar);
+            assert(!memcmp(penscalar, plain, 65536));
+            penline_scalar(penpixels, 65536, &pencpal, &cpen, penscalar);
+            for (unsigned k = 0; k < __crt_countof(penkernels); ++k) {
+                if (!pensupported[k]) continue;
+                penkernels[k](penpixels, 65536, &pencpal, &none, penvector);
+                assert(!memcmp(penvector, plain, 65536));
+                penkernels[k](penpixels, 65536, &pencpal, &cpen, penvector);
+                assert(!memcmp(penvector, penscalar, 65536));
+            }
+            for (unsigned i = 0; i < 65536; ++i) {
+                const RGBQUAD* const pixel = penpixels + i;
+                char                 legacy = 0;
+                switch (kind) {
+                    case ARITHMETIC :
+                        legacy = penalizing_arithmeticmapper(pixel, 20, 90, 100, 100, 180, 255, palette_extended, penplen, penalty);
+                        break;
+                    case WEIGHTED :
+                        legacy = penalizing_weightedmapper(pixel, 20, 90, 100, 100, 180, 255, palette_extended, penplen, penalty);
+                        break;
+                    case MINMAX :
+                        legacy = penalizing_minmaxmapper(pixel, 20, 90, 100, 100, 180, 255, palette_extended, penplen, penalty);
+                        break;
+                    default :
+                        legacy = penalizing_luminositymapper(pixel, 20, 90, 100, 100, 180, 255, palette_extended, penplen, penalty);
+                }
+                assert(penscalar[i] == legacy);
+            }
+        }
+    }
+    free(penpixels);
+    free(penscalar);
+    free(penvector);
+    free(plain);
+
+    // and so do the converters, whatever the storage order
+    const cpalette viewcpal = cpalcompile(smapper, spalette, sizeof(spalette));
+    const cpenalty viewnone = cpencompile(0, 0, 0, 0, 0, 0, 0.5);
+    char* const    penstr   = to_penalized_string(&buview, &viewcpal, &viewnone, NULL, NULL);
+    char* const    rawstr   = to_view_string(&tdview, NULL, NULL, NULL);
+    assert(penstr && rawstr && !strcmp(penstr, rawstr));
+    free(penstr);
+    free(rawstr);
+    #pragma endregion
+
+    #pragma region __TEST_CLUT__
+    // whichever way a colour lookup table maps a pixel, it lands on the character tunable_mapper() picks
+    RGBQUAD clutpixels[1000] = { 0 };
+    char    clutexacts[1000] = { 0 }, clutcubes[1000] = { 0 }, clutfulls[1000] = { 0 }; // NOLINT(readability-isolate-declaration)
+    for (unsigned i = 0; i < 1000; ++i) clutpixels[i] = (RGBQUAD) { .rgbBlue = rand(), .rgbGreen = rand(), .rgbRed = rand() };
+    for (unsigned t = 0; t < 4; ++t) {
+        // weights adding up to just under 1.0 and then to a quarter of that, the first weighting leaves the cube to the exact offsets
+        const float bweight = rand() / RNDMAX, gweight = rand() / RNDMAX, rweight = rand() / RNDMAX; // NOLINT
+        const float sum     = (bweight + gweight + rweight) * (t & 1 ? 4.04F : 1.01F);
+        colourlut   lut     = { 0 };
+        assert(clutcompile(&lut, bweight / sum, gweight / sum, rweight / sum, palette_minimal, sizeof(palette_minimal), t > 1, NULL, NULL));
+        assert(lut._kind == (t > 1 ? CLUT_FULL : t ? CLUT_CUBE : CLUT_EXACT));
+        clutline_exact(clutpixels, 1000, &lut, clutexacts);
+        clutline_cube(clutpixels, 1000, &lut, clutcubes);
+        assert(!memcmp(clutexacts, clutcubes, 1000));
+        if (lut._full) {
+            clutline_full(clutpixels, 1000, &lut, clutfulls);
+            assert(!memcmp(clutexacts, clutfulls, 1000));
+        }
+        for (unsigned i = 0; i < 1000; ++i) {
+            const unsigned offset = clutpixels[i].rgbBlue * (bweight / sum) + clutpixels[i].rgbGreen * (gweight / sum) +
+                                    clutpixels[i].rgbRed * (rweight / sum);
+            assert(clutexacts[i] == palette_minimal[offset ? nudge(offset / (float) (UCHAR_MAX) *sizeof(palette_minimal)) - 1 : 0]);
+            assert(clutmap(&lut, clutpixels + i) == clutexacts[i]);
+        }
+        clutfree(&lut);
+    }
+    #pragma endregion
+
+    #pragma region __TEST_INTEGRAL__
+    // the views of __TEST_VIEWS__, the sums of any rectangle must match the pixels, whatever the storage order
+    integral butable = { 0 }, tdtable = { 0 }; // NOLINT(readability-isolate-declaration)
+    assert(integralbuild(&butable, &buview, NULL, NULL, NULL) && integralbuild(&tdtable, &tdview, NULL, NULL, NULL));
+    for (long long top = 0; top < 4; ++top)
+        for (long long bottom = top + 1; bottom <= 4; ++bottom)
+            for (long long left = 0; left < 3; ++left)
+                for (long long right = left + 1; right <= 3; ++right) {
+                    uint64_t expected = 0;
+                    for (long long r = top; r < bottom; ++r)
+                        for (long long c = left; c < right; ++c) expected += r * 16 + c;
+                    const blocksum busum = integralsum(&butable, left, top, right, bottom);
+                    const blocksum tdsum = integralsum(&tdtable, left, top, right, bottom);
+                    assert(busum._blue == expected && !busum._green && busum._red == 0xFFLLU * (bottom - top) * (right - left));
+                    assert(!memcmp(&busum, &tdsum, sizeof(blocksum)));
+                }
+
+    // 2 columns of 1 and 2 pixels, rows of 1 pixel (3 / 2), the number of rows follows from the aspect ratio
+    char* const narrow = to_integral_string(&butable, 2, NULL, NULL, NULL);
+    assert(narrow && strlen(narrow) == 3 * 3 && narrow[2] == '\n' && narrow[5] == '\n' && narrow[8] == '\n');
+    free(narrow);
+    integralfree(&butable);
+    integralfree(&tdtable);
+    #pragma endregion
+
+    #pragma region __TEST_PYRAMID__
+    // every level of a pyramid must be identical to a render at that width through a summed-area table, whatever the storage order
+    const long long widths[]                    = { 3, 1, 2, 7 }; // 7 is clamped to the width of the image
+    char*           bulevels[PYRAMID_MAXLEVELS] = { 0 }, *tdlevels[PYRAMID_MAXLEVELS] = { 0 }; // NOLINT(readability-isolate-declaration)
+    assert(to_pyramid_strings(&buview, widths, 4, NULL, bulevels, NULL, NULL));
+    assert(to_pyramid_strings(&tdview, widths, 4, NULL, tdlevels, NULL, NULL));
+    assert(integralbuild(&butable, &buview, NULL, NULL, NULL));
+    for (long long l = 0; l < 4; ++l) {
+        char* const single = to_integral_string(&butable, widths[l], NULL, NULL, NULL);
+        assert(single && !strcmp(single, bulevels[l]) && !strcmp(single, tdlevels[l]));
+        free(single);
+        free(bulevels[l]);
+        free(tdlevels[l]);
+    }
+
+    // and with any other mapper and palette, as long as both are given the same one
+    const cpalette widthcpal = cpalcompile(MINMAX, palette_extended, sizeof(palette_extended));
+    assert(to_pyramid_strings(&buview, widths, 4, &widthcpal, bulevels, NULL, NULL));
+    for (long long l = 0; l < 4; ++l) {
+        char* const single = to_integral_string(&butable, widths[l], &widthcpal, NULL, NULL);
+        assert(single && !strcmp(single, bulevels[l]));
+        free(single);
+        free(bulevels[l]);
+    }
+    integralfree(&butable);
+    #pragma endregion
+
+    #pragma region __TEST_GRID__
+    // rendering the grid of a view with the palette the converters use must give back what the converters return, saved or not
+    const cpalette gridcpal = cpalcompile(smapper, spalette, sizeof(spalette));
+    blockgrid      grid = { 0 }, loaded = { 0 }; // NOLINT(readability-isolate-declaration)
+    assert(gridbuild(&grid, &buview, NULL, NULL) && grid._columns == 3 && grid._rows == 4);
+    assert(gridsave(&grid, "./test.grid") && gridload(&loaded, "./test.grid", NULL));
+    assert(loaded._columns == 3 && loaded._rows == 4 && !memcmp(grid._cells, loaded._cells, sizeof(blockfixed) * 12));
+    unlink("./test.grid");
+
+    char* const viewstr = to_view_string(&buview, NULL, NULL, NULL);
+    char* const gridstr = to_grid_string(&loaded, &gridcpal, NULL);
+    assert(viewstr && gridstr && !strcmp(viewstr, gridstr));
+    free(viewstr);
+    free(gridstr);
+
+    // a different palette only changes the characters
+    const cpalette extended = cpalcompile(MINMAX, palette_extended, sizeof(palette_extended));
+    char* const    remapped = to_grid_string(&loaded, &extended, NULL);
+    assert(remapped && strlen(remapped) == 4 * 4 && remapped[3] == '\n' && remapped[15] == '\n');
+    free(remapped);
+    gridfree(&grid);
+    gridfree(&loaded);
+    #pragma endregion
+
+    #pragma region __TEST_COLOUR__
+    // a run of cells of the same colour shares one escape, spaces get none, and without the escapes it's the plain render
+    blockfixed colourcells[8] = { 0 }; // 2 rows of 4 cells, the second one black i.e spaces
+    for (unsigned i = 0; i < 3; ++i) colourcells[i] = (blockfixed) { 200U << FIXED_SHIFT, 200U << FIXED_SHIFT, 200U << FIXED_SHIFT };
+    colourcells[3]             = (blockfixed) { ._blue = 50U << FIXED_SHIFT, ._green = 200U << FIXED_SHIFT, ._red = 10U << FIXED_SHIFT };
+    const blockgrid colourgrid = { ._cells = colourcells, ._columns = 4, ._rows = 2, ._arena = NULL };
+    char* const     colourstr  = to_colour_string(&colourgrid, &gridcpal, NULL, NULL);
+    char* const     plainstr   = to_grid_string(&colourgrid, &gridcpal, NULL);
+    char            colourexpected[128] = { 0 };
+    assert(colourstr && plainstr && !strcmp(plainstr + 5, "    \n")); // 200 and 50 quantize to 203 and 48, 10 to 8
+    snprintf(colourexpected, sizeof(colourexpected), "\x1b[38;2;203;203;203m%.3s\x1b[38;2;8;203;48m%c" COLOUR_RESET "\n    \n", plainstr,
+             plainstr[3]);
+    assert(!strcmp(colourstr, colourexpected));
+    free(colourstr);
+    free(plainstr);
+    #pragma endregion
+
+    #pragma region __TEST_SUBCELL__
+    // a cell of one colour is a space on that background, the colours in effect the other way around make a lower half block, and the
+    // last row of an odd grid leaves the lower halves to the terminal, the grid is 3 x 3
+    const blockfixed whitecell    = { 255U << FIXED_SHIFT, 255U << FIXED_SHIFT, 255U << FIXED_SHIFT };
+    const blockfixed blackcell    = { 0 };
+    const blockfixed redcell      = { ._red = 255U << FIXED_SHIFT };
+    const blockfixed greencell    = { ._green = 255U << FIXED_SHIFT };
+    blockfixed       halfcells[9] = { whitecell, redcell, blackcell, whitecell, blackcell, redcell, greencell, greencell, greencell };
+    const blockgrid  halfgrid     = { ._cells = halfcells, ._columns = 3, ._rows = 3, ._arena = NULL };
+    char* const      halfblockstr = to_halfblock_string(&halfgrid, NULL, NULL);
+    assert(halfblockstr && !strcmp(halfblockstr, "\x1b[48;2;255;255;255m \x1b[38;2;255;0;0;48;2;0;0;0m" SUBCELL_UPPER SUBCELL_LOWER
+                                                  COLOUR_RESET "\n\x1b[38;2;0;255;0m" SUBCELL_UPPER SUBCELL_UPPER SUBCELL_UPPER
+                                                  COLOUR_RESET "\n"));
+    free(halfblockstr);
+
+    // the samples brighter than the average raise their dots, 2 x 4 to a pattern
+    blockfixed braillecells[15] = { 0 }; // 3 x 5, everything black but for four samples
+    braillecells[0] = braillecells[4] = braillecells[9] = braillecells[14] = whitecell;
+    const blockgrid braillegrid = { ._cells = braillecells, ._columns = 3, ._rows = 5, ._arena = NULL };
+    char* const     braillestr  = to_braille_string(&braillegrid, &gridcpal, NULL, NULL);
+    assert(braillestr && !strcmp(braillestr, "\u2851\u2800\n\u2800\u2801\n")); // dots 1, 5 and 7, nothing, nothing and dot 1
+    free(braillestr);
+    #pragma endregion
+
+    #pragma region __TEST_CACHE__
+    // reference values of XXH64, the second one spans a full 32 byte stripe
+    assert(xxh64((const unsigned char*) "", 0, 0) == 0xEF46DB3751D8E999LLU);
+    assert(xxh64((const unsigned char*) "abc", 3, 0) == 0x44BC2CF5AD770999LLU);
+    assert(xxh64((const unsigned char*) "Nobody inspects the spammish repetition", 39, 0) == 0xFBCEA83C8A378BF1LLU);
+
+    // entries round trip, hold a fixed number of strings, and the least recently used one goes first once the cap is exceeded
+    resultcache       cache       = { 0 };
+    char*             found[2]    = { 0 };
+    const char* const stored[2]   = { "####\n", "#\n" };
+    const cachekey    keys[3]     = { { 1, 1 }, { 1, 2 }, { 2, 1 } };
+    assert(cacheopen(&cache, "./cache.tmp", 16)); // room for two entries of 8 bytes
+    assert(!cachefind(&cache, keys[0], found, 2, NULL));
+    cachestore(&cache, keys[0], stored, 2);
+    assert(cachefind(&cache, keys[0], found, 2, NULL) && !strcmp(found[0], stored[0]) && !strcmp(found[1], stored[1]));
+    free(found[0]);
+    assert(!cachefind(&cache, keys[0], found, 1, NULL)); // not what the caller asked for
+    cachestore(&cache, keys[1], stored, 2);
+    cachestore(&cache, keys[2], stored, 2); // 24 bytes, evicts down to 14, i.e the two oldest
+    assert(!cachefind(&cache, keys[0], found, 2, NULL) && cachefind(&cache, keys[2], found, 2, NULL));
+    free(found[0]);
+    assert(cache._stats._nstores == 3 && cache._stats._nevictions == 2 && cache._stats._nhits == 2);
+    unlink("./cache.tmp/0000000000000002" "0000000000000001");
+    rmdir("./cache.tmp");
+
+    // a key follows the mapper and the palette an image is rendered with, a NULL compiled palette being the one of smapper and spalette
+    bitmap         keyed       = bmpread("./test/girl.bmp", NULL);
+    const cpalette keycpals[3] = { cpalcompile(smapper, spalette, sizeof(spalette)),
+                                   cpalcompile(LUMINOSITY, spalette, sizeof(spalette)),
+                                   cpalcompile(smapper, palette_extended, sizeof(palette_extended)) };
+    const cachekey keydefault  = cachekeyof(&keyed, NULL, NULL, 0);
+    assert(keyed._pixels && !memcmp(&keydefault, (const cachekey[]) { cachekeyof(&keyed, keycpals, NULL, 0) }, sizeof(cachekey)));
+    for (unsigned i = 1; i < 3; ++i) {
+        const cachekey other = cachekeyof(&keyed, keycpals + i, NULL, 0);
+        assert(other._content == keydefault._content && other._config != keydefault._config);
+    }
+    bmpclose(&keyed);
+    #pragma endregion
+
+    #pragma region __TEST_STREAM__
+    // 24 and 32 bit bitmaps, stored bottom up and top down, wide enough to be downscaled and narrow enough to be mapped pixel by pixel
+    // render the same streamed, split in bands across a pool and in one piece. 1001 pixels pad the 24 bit scanlines and leave incomplete
+    // blocks at the right edge, 333 scanlines leave incomplete blocks at the bottom edge and a partial chunk at the end of the stream
+    static const char* const streampaths[8] = { "./stream0.tmp", "./stream1.tmp", "./stream2.tmp", "./stream3.tmp",
+                                                "./stream4.tmp", "./stream5.tmp", "./stream6.tmp", "./stream7.tmp" };
+    char*                    unsplit[8]     = { 0 };
+    threadpool               streampool     = { 0 };
+    assert(tpoolcreate(&streampool, 4));
+    for (unsigned i = 0; i < 8; ++i) { // bit 0 picks the bit count, bit 1 the storage order and bit 2 the width
+        const long long        width  = i & 4 ? 101 : 1001;
+        const BITMAPINFOHEADER head   = { .biSize        = 40,
+                                          .biWidth       = width,
+                                          .biHeight      = i & 2 ? -333 : 333,
+                                          .biPlanes      = 1,
+                                          .biBitCount    = i & 1 ? 32 : 24,
+                                          .biCompression = RGB };
+        const long long        nbytes = bmpstride(&head) * 333;
+        const BITMAPFILEHEADER fhead  = { .bfType = 0x4D42, .bfSize = 54 + nbytes, .bfOffBits = 54 };
+        FILE* const            file   = fopen(streampaths[i], "wb");
+        assert(file && fwrite(&fhead, sizeof(fhead), 1, file) == 1 && fwrite(&head, sizeof(head), 1, file) == 1);
+        for (long long b = 0; b < nbytes; ++b) fputc(rand(), file);
+        assert(!fclose(file));
+
+        bitmap      image    = bmpread(streampaths[i], NULL);
+        char* const banded   = to_string(&image, NULL, &streampool, NULL);
+        char* const streamed = to_streamed_string(streampaths[i], NULL);
+        unsplit[i]           = to_string(&image, NULL, NULL, NULL);
+        assert(unsplit[i] && banded && streamed && !strcmp(banded, unsplit[i]) && !strcmp(streamed, unsplit[i]));
+        assert(width > CONSOLE_WIDTH || strlen(unsplit[i]) == 333LLU * (width + 1));
+        free(banded);
+        free(streamed);
+        bmpclose(&image);
+    }
+
+    // batch mode emits them in the order of the paths, whichever of them the pool gets done first, loaded whole and streamed
+    for (unsigned stream = 0; stream < 2; ++stream) {
+        batchexpect expect = { ._paths = streampaths, ._expected = unsplit };
+        assert(batchrun(&streampool, NULL, streampaths, 8, 3, stream, batchcheck, &expect, NULL) && expect._nemitted == 8);
+    }
+    tpooldestroy(&streampool);
+    for (unsigned i = 0; i < 8; ++i) {
+        free(unsplit[i]);
+        unlink(streampaths[i]);
+    }
+    #pragma endregion
+
+    #pragma region __TEST_SERVER__
+    // a bitmap sent down a connection comes back as the converters render it, a failed conversion leaves the connection usable and a
+    // malformed request closes it
+    unsigned char          bmpbytes[54 + sizeof(bottomup)] = { 0 };
+    const BITMAPFILEHEADER bmphead                         = { .bfType = 0x4D42, .bfSize = sizeof(bmpbytes), .bfOffBits = 54 };
+    memcpy(bmpbytes, &bmphead, sizeof(BITMAPFILEHEADER));
+    memcpy(bmpbytes + sizeof(BITMAPFILEHEADER), &buhead, sizeof(BITMAPINFOHEADER));
+    memcpy(bmpbytes + 54, bottomup, sizeof(bottomup));
+
+    int             ends[2]         = { 0 };
+    threadpool      serverpool      = { 0 };
+    char*           served[2]       = { 0 };
+    const long long servedwidths[2] = { 3, 1 };
+    assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, ends) && tpoolcreate(&serverpool, 1));
+    assert(tpoolsubmit(&serverpool, serveconnection, (void*) (intptr_t) ends[1]));
+
+    char* const servedview = to_view_string(&buview, NULL, NULL, NULL);
+    assert(clientconvert(ends[0], SERVER_BITMAP, bmpbytes, sizeof(bmpbytes), NULL, 0, smapper, 1, served, NULL) == SERVER_OK);
+    assert(servedview && !strcmp(served[0], servedview));
+    free(served[0]);
+    assert(clientconvert(ends[0], SERVER_BITMAP, bmpbytes, sizeof(bmpbytes), servedwidths, 2, smapper, 1, served, NULL) == SERVER_OK);
+    assert(strlen(served[0]) == 4 * 4 && strlen(served[1]) == 2 * 2); // a column and a LF per block row
+    free(served[0]);
+    free(servedview);
+
+    // the mapper and the palette of a request pick the compiled palette the render maps with
+    const cpalette lumcpal = cpalcompile(LUMINOSITY, palette_extended, sizeof(palette_extended));
+    char* const    lumview = to_view_string(&buview, &lumcpal, NULL, NULL);
+    assert(clientconvert(ends[0], SERVER_BITMAP, bmpbytes, sizeof(bmpbytes), NULL, 0, LUMINOSITY, 2, served, NULL) == SERVER_OK);
+    assert(lumview && !strcmp(served[0], lumview));
+    free(served[0]);
+    free(lumview);
+
+    const char* const          missing      = "./missing.bmp";
+    const unsigned char* const missingbytes = (const unsigned char*) missing;
+    assert(clientconvert(ends[0], SERVER_PATH, missingbytes, strlen(missing), NULL, 0, smapper, 1, served, NULL) == SERVER_FAILED);
+    assert(clientconvert(ends[0], SERVER_PATH, missingbytes, 0, NULL, 0, smapper, 1, served, NULL) == SERVER_BADREQUEST);
+    assert(clientconvert(ends[0], SERVER_BITMAP, bmpbytes, sizeof(bmpbytes), NULL, 0, smapper, 1, served, NULL) == SERVER_DISCONNECTED);
+    close(ends[0]);
+
+    // a palette that doesn't exist makes for a malformed request too
+    assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, ends) && tpoolsubmit(&serverpool, serveconnection, (void*) (intptr_t) ends[1]));
+    const SERVER_STATUS nopalette =
+        clientconvert(ends[0], SERVER_BITMAP, bmpbytes, sizeof(bmpbytes), NULL, 0, smapper, CPAL_NPALETTES, served, NULL);
+    assert(nopalette == SERVER_BADREQUEST);
+    close(ends[0]);
+    tpooldestroy(&serverpool); // the connections were closed on the server's end, so the jobs are done
+    #pragma endregion
+
+    #pragma region __TEST_OUTPUT__
+    // an image goes into a pipe with its separators, the reader gets exactly the bytes the strings held when they were written, even
+    // when their memory is reused before the reader gets to them
+    int               outpipe[2]    = { 0 };
+    char              outread[512]  = { 0 };
+    int               outunread     = 0;
+    char              outfirst[]    = "ab\n";
+    const char* const outstrings[2] = { outfirst, "cd\n" };
+    output            out           = { 0 };
+    assert(!pipe(outpipe) && outputopen(&out, outpipe[1], 0) && outputstrings(&out, outstrings, 2));
+    memcpy(outfirst, "xy\n", 3);
+    assert(read(outpipe[0], outread, sizeof(outread)) == 2 * (3 + sizeof(OUTPUT_SEPARATOR) - 1));
+    assert(!strcmp(outread, "ab\n" OUTPUT_SEPARATOR "cd\n" OUTPUT_SEPARATOR));
+    assert(outputclose(&out));
+
+    // batched, small images wait in the buffer until it fills up or the output is closed, larger ones go straight through
+    char outlarge[100] = { 0 };
+    memset(outlarge, 'x', sizeof(outlarge) - 1);
+    const char* const outlarges[1] = { outlarge };
+    memcpy(outfirst, "ab\n", 3);
+    assert(outputopen(&out, outpipe[1], 64) && outputstrings(&out, outstrings, 2));
+    assert(!ioctl(outpipe[0], FIONREAD, &outunread) && !outunread);
+    assert(outputstrings(&out, outlarges, 1));
+    memset(outread, 0, sizeof(outread));
+    assert(read(outpipe[0], outread, sizeof(outread)) == 2 * 7 + 99 + 4);
+    assert(!strncmp(outread, "ab\n" OUTPUT_SEPARATOR "cd\n" OUTPUT_SEPARATOR, 14) && !strncmp(outread + 14, outlarge, 99));
+    assert(outputclose(&out));
+    close(outpipe[0]);
+    close(outpipe[1]);
+    #pragma endregion
+
+    #pragma region __TEST_SEQUENCE__
+    // the first frame clears the screen and is written in full, the frames after it only rewrite the cells that changed
+    sequence seq = { 0 };
+    char*    update = NULL;
+    sequenceopen(&seq, false);
+    assert((update = sequenceframe(&seq, "ab\ncd\n", NULL)) && !strcmp(update, SEQUENCE_BEGIN "\x1b[1;1Hab\x1b[2;1Hcd"));
+    free(update);
+    assert((update = sequenceframe(&seq, "ab\ncx\n", NULL)) && !strcmp(update, "\x1b[2;2Hx"));
+    free(update);
+    assert((update = sequenceframe(&seq, "ab\ncx\n", NULL)) && !strcmp(update, ""));
+    free(update);
+
+    // the gap between two changes is rewritten when it's shorter than the cursor move past it, a shape change starts over
+    assert((update = sequenceframe(&seq, "abcdefghij\n", NULL)) && !strcmp(update, SEQUENCE_BEGIN "\x1b[1;1Habcdefghij"));
+    free(update);
+    assert((update = sequenceframe(&seq, "aXcYefghij\n", NULL)) && !strcmp(update, "\x1b[1;2HXcY"));
+    free(update);
+    assert((update = sequenceframe(&seq, "AXcYefghiZ\n", NULL)) && !strcmp(update, "\x1b[1;1HA\x1b[1;10HZ"));
+    free(update);
+
+    char seqfinish[SEQUENCE_MAXMOVE + sizeof(SEQUENCE_END) + 1] = { 0 };
+    assert(sequencefinish(&seq, seqfinish) == 6 + sizeof(SEQUENCE_END) && !strcmp(seqfinish, "\x1b[1;1H\n" SEQUENCE_END));
+    assert(seq._stats._nframes == 6 && seq._stats._nwritten == 4 + 1 + 10 + 3 + 2 && !seq._stats._nskipped);
+    sequenceclose(&seq);
+
+    // a fresh screen is blank, and with row hashes the rows that hash the same are skipped without comparing their cells
+    sequenceopen(&seq, true);
+    assert((update = sequenceframe(&seq, "  \nab\n", NULL)) && !strcmp(update, SEQUENCE_BEGIN "\x1b[2;1Hab"));
+    free(update);
+    assert((update = sequenceframe(&seq, "  \naX\n", NULL)) && !strcmp(update, "\x1b[2;2HX") && seq._stats._nskipped == 1);
+    free(update);
+    sequenceclose(&seq);
+    #pragma endregion
+
+    #pragma region __TEST_ARENA__
+    arena memory = { 0 };
+    // an empty arena spills everything to the heap, and grows to fit it all at the next reset
+    for (unsigned image = 0; image < 3; ++image) {
+        unsigned char* const first  = arenaalloc(&memory, 1000);
+        unsigned char* const second = arenacalloc(&memory, 10, 10);
+        assert(first && second && !second[0] && !second[99]);
+        if (image) { // carved out of the buffer, one after the other
+            assert(!((uintptr_t) first % ARENA_ALIGNMENT) && second == first + 1024);
+            memset(second, 0xFF, 100); // must be zeroed again the next time around
+        }
+        arenareset(&memory);
+    }
+    assert(memory._stats._nallocs == 6 && memory._stats._nreused == 4 && memory._stats._ngrows == 1);
+    assert(memory._stats._highwater == 1024 + 128);
+    arenadestroy(&memory);
+    assert(!memory._base && memory._stats._nresets == 3);
+    #pragma endregion
+
+    #pragma region __TEST_RECIPROCALS__
+    // the reciprocal divisions used by the block averaging must be exact, for every block size a downscaler could ever see
+    // dividends span the whole range of fixed point block sums, (255 * blocksize) << FIXED_SHIFT
+    uint64_t state = 0x9E3779B97F4A7C15LLU; // xorshift64 state
+    for (uint64_t divisor = 1; divisor < (1LLU << 20); divisor += 1 + (divisor >> 6)) {
+        const reciprocal rcp = rcpcompute(divisor);
+        const uint64_t   top = (255LLU * divisor) << FIXED_SHIFT;
+        assert(!rcpdivide(0, rcp) && rcpdivide(top, rcp) == top / divisor && rcpdivide(divisor, rcp) == 1);
+        for (unsigned i = 0; i < 64; ++i) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            assert(rcpdivide(state % (top + 1), rcp) == state % (top + 1) / divisor);
+        }
+    }
+
+    // the downscaled averages are the exact rational means of the blocks rounded down to FIXED_SHIFT fractional bits, i.e never above the
+    // mean and less than 2 ^ -FIXED_SHIFT below it. the float averages the block mappers used to take were rounded to the nearest float
+    // instead, within half an ulp (2 ^ -17 above 128) either side, so a block whose offset lands within 2 ^ -16 of a step of the mapper
+    // can map to the neighbouring character. 302 x 200 pixels take 3 x 3 blocks, incomplete ones on the right and at the bottom
+    static RGBQUAD         dspixels[200][302] = { 0 };
+    const BITMAPINFOHEADER dshead             = { .biSize = 40, .biWidth = 302, .biHeight = -200, .biBitCount = 32, .biCompression = RGB };
+    for (unsigned r = 0; r < 200; ++r)
+        for (unsigned c = 0; c < 302; ++c) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            dspixels[r][c] = (RGBQUAD) { .rgbBlue = state, .rgbGreen = state >> 8, .rgbRed = state >> 16 };
+        }
+
+    const imview   dsview = imscanlines(dummybmp, &dshead, (const unsigned char*) dspixels, 200, false);
+    const cpalette dscpal = cpalcompile(smapper, spalette, sizeof(spalette));
+    blockgrid      dsgrid = { 0 };
+    char* const    dsstr  = to_view_string(&dsview, NULL, NULL, NULL);
+    assert(dsstr && gridbuild(&dsgrid, &dsview, NULL, NULL) && dsgrid._columns == 101 && dsgrid._rows == 67);
+    for (long long r = 0; r < 67; ++r)
+        for (long long c = 0; c < 101; ++c) {
+            uint64_t        sums[3] = { 0 };
+            const long long npixels = (min(3 * r + 3, 200LL) - 3 * r) * (min(3 * c + 3, 302LL) - 3 * c);
+            for (long long y = 3 * r; y < min(3 * r + 3, 200LL); ++y)
+                for (long long x = 3 * c; x < min(3 * c + 3, 302LL); ++x) {
+                    sums[0] += dspixels[y][x].rgbBlue;
+                    sums[1] += dspixels[y][x].rgbGreen;
+                    sums[2] += dspixels[y][x].rgbRed;
+                }
+
+            const blockfixed* const cell  = dsgrid._cells + r * 101 + c;
+            const uint32_t          got[] = { cell->_blue, cell->_green, cell->_red };
+            for (unsigned i = 0; i < 3; ++i)
+                assert((uint64_t) got[i] * npixels <= sums[i] << FIXED_SHIFT && (got[i] + 1LLU) * npixels > sums[i] << FIXED_SHIFT);
+            assert(dsstr[r * 102 + c] == blockfixedmap(cell, &dscpal));
+        }
+    free(dsstr);
+    gridfree(&dsgrid);
+    #pragma endregion
+
     #pragma region __TEST_PARSERS__
-    const BITMAPFILEHEADER bmpfh = parse_fileheader(dummybmp, __crt_countof(dummybmp));
+    const BITMAPFILEHEADER bmpfh = fileheader(dummybmp, __crt_countof(dummybmp));
     assert(bmpfh.bfType == START_TAG_LE);
     assert(bmpfh.bfSize == 1409334); // size of the image where this buffer was extracted from, in bytes
     assert(bmpfh.bfReserved1 == 0);
     assert(bmpfh.bfReserved2 == 0);
     assert(bmpfh.bfOffBits == 54);
 
-    const BITMAPINFOHEADER bmpinfh = parse_infoheader(dummybmp, __crt_countof(dummybmp));
+    const BITMAPINFOHEADER bmpinfh = infoheader(dummybmp, __crt_countof(dummybmp));
     assert(bmpinfh.biSize == 40); // header size
     assert(bmpinfh.biWidth == 734);
     assert(bmpinfh.biHeight == 480);
@@ -222,37 +996,31 @@ int wmain(void) {
     assert(bmpinfh.biClrUsed == 0);
     assert(bmpinfh.biClrImportant == 0);
 
-    const BITMAP_PIXEL_ORDERING order = get_pixel_order(&bmpinfh);
+    const BITMAP_PIXEL_ORDERING order = pixelorder(&bmpinfh);
     assert(order == BOTTOMUP);
     #pragma endregion
 
     #pragma region __TEST_ALL__
     // all of these test images will cause to_string to reroute to to_raw_string
-    static const wchar_t* const filenames[] = { L"./test/bobmarley.bmp", L"./test/football.bmp",  L"./test/garfield.bmp",
-                                                L"./test/gewn.bmp",      L"./test/girl.bmp",      L"./test/jennifer.bmp",
-                                                L"./test/messi.bmp",     L"./test/supergirl.bmp", L"./test/time.bmp",
-                                                L"./test/uefa2024.bmp",  L"./test/vendetta.bmp",  NULL };
-
-    const wchar_t** _ptr                    = filenames;
-    while (*_ptr) {
-        bitmap_t image                     = bmpread(*_ptr);
-        const wchar_t* const restrict wstr = to_string(&image);
-        if (!wstr) {
-            wprintf_s(L"Error :: cannot process %s!\n", *_ptr);
-            bmpclose(&image);
-            continue;
-        }
+    static const char* const filenames[] = { "./test/bobmarley.bmp", "./test/football.bmp",  "./test/garfield.bmp",
+                                             "./test/gewn.bmp",      "./test/girl.bmp",      "./test/jennifer.bmp",
+                                             "./test/messi.bmp",     "./test/supergirl.bmp", "./test/time.bmp",
+                                             "./test/uefa2024.bmp",  "./test/vendetta.bmp",  NULL };
+
+    for (const char* const* _ptr = filenames; *_ptr; ++_ptr) {
+        bitmap            image = bmpread(*_ptr, NULL);
+        char* const restrict str = to_string(&image, NULL, NULL, NULL);
+        assert(str);
 
-        _putws(wstr);
-        _putws(L"\n\n");
+        fputs(str, stdout);
+        fputs(OUTPUT_SEPARATOR, stdout);
 
-        free(wstr);
+        free(str);
         bmpclose(&image);
-        _ptr++;
     }
     #pragma endregion
 
-    _putws(L"all's good :)");
+    fputs("all's good :)\n", stdout);
     return EXIT_SUCCESS;
 }
 